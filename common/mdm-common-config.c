@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <locale.h>
 #include <syslog.h>
+#include <dirent.h>
 
 #include <glib.h>
 
@@ -156,6 +157,146 @@ mdm_common_config_load_from_dirs (const char  *filename,
 	return config;
 }
 
+static gboolean
+find_program (const char *tryexec,
+	      char      **path_dirs)
+{
+	char   **argv;
+	gboolean found;
+	int      i;
+
+	/* Do not look for any arguments */
+	argv = g_strsplit (tryexec, " ", 2);
+	if (argv == NULL || argv[0] == NULL || argv[0][0] == '\0') {
+		g_strfreev (argv);
+		return FALSE;
+	}
+
+	found = FALSE;
+	if (strchr (argv[0], '/') != NULL) {
+		found = g_file_test (argv[0], G_FILE_TEST_IS_EXECUTABLE) &&
+			! g_file_test (argv[0], G_FILE_TEST_IS_DIR);
+	} else {
+		for (i = 0; ! found && path_dirs[i] != NULL; i++) {
+			char *path;
+
+			if (path_dirs[i][0] == '\0')
+				continue;
+
+			path = g_build_filename (path_dirs[i], argv[0], NULL);
+			found = g_file_test (path, G_FILE_TEST_IS_EXECUTABLE) &&
+				! g_file_test (path, G_FILE_TEST_IS_DIR);
+			g_free (path);
+		}
+	}
+
+	g_strfreev (argv);
+	return found;
+}
+
+/**
+ * mdm_common_config_load_sessions
+ *
+ * Reads every session .desktop file in the colon separated
+ * @session_dirs into one key file.  Each session gets a group named
+ * after its file, holding that file's "Desktop Entry" keys untouched
+ * (so translated names still work) plus X-Mdm-File and X-Mdm-Available,
+ * the latter being FALSE if the TryExec cannot be found in
+ * @search_path.  The first file wins when a name appears in more than
+ * one directory.  The MDM_SESSIONS_GROUP group records the directories,
+ * the search path and whether any of the directories could be read.
+ */
+GKeyFile *
+mdm_common_config_load_sessions (const char *session_dirs,
+				 const char *search_path)
+{
+	GKeyFile *sessions;
+	gboolean  some_dir_exists;
+	char    **dirs;
+	char    **path_dirs;
+	int       i;
+
+	sessions = g_key_file_new ();
+	some_dir_exists = FALSE;
+
+	dirs = g_strsplit (session_dirs != NULL ? session_dirs : "", ":", -1);
+	path_dirs = g_strsplit (search_path != NULL ? search_path : "", ":", -1);
+
+	for (i = 0; dirs[i] != NULL; i++) {
+		struct dirent *dent;
+		DIR           *dir;
+
+		if (dirs[i][0] == '\0' || access (dirs[i], R_OK|X_OK) != 0)
+			continue;
+
+		some_dir_exists = TRUE;
+
+		dir = opendir (dirs[i]);
+		if (dir == NULL)
+			continue;
+
+		while ((dent = readdir (dir)) != NULL) {
+			GKeyFile *cfg;
+			char     *file;
+			char     *ext;
+			char     *tryexec;
+			char    **keys;
+			gboolean  available;
+			int       k;
+
+			/* ignore everything but the .desktop files */
+			ext = strstr (dent->d_name, ".desktop");
+			if (ext == NULL || strcmp (ext, ".desktop") != 0)
+				continue;
+
+			/* already found this session */
+			if (g_key_file_has_group (sessions, dent->d_name))
+				continue;
+
+			file = g_build_filename (dirs[i], dent->d_name, NULL);
+			cfg = mdm_common_config_load (file, NULL);
+
+			available = TRUE;
+			if (cfg != NULL) {
+				keys = g_key_file_get_keys (cfg, "Desktop Entry", NULL, NULL);
+				for (k = 0; keys != NULL && keys[k] != NULL; k++) {
+					char *value;
+
+					value = g_key_file_get_value (cfg, "Desktop Entry", keys[k], NULL);
+					if (value != NULL)
+						g_key_file_set_value (sessions, dent->d_name, keys[k], value);
+					g_free (value);
+				}
+				g_strfreev (keys);
+
+				tryexec = g_key_file_get_string (cfg, "Desktop Entry", "TryExec", NULL);
+				if (tryexec != NULL && tryexec[0] != '\0')
+					available = find_program (tryexec, path_dirs);
+				g_free (tryexec);
+
+				g_key_file_free (cfg);
+			}
+
+			g_key_file_set_string (sessions, dent->d_name, "X-Mdm-File", file);
+			g_key_file_set_boolean (sessions, dent->d_name, "X-Mdm-Available", available);
+			g_free (file);
+		}
+
+		closedir (dir);
+	}
+
+	g_key_file_set_string (sessions, MDM_SESSIONS_GROUP, "SessionDesktopDir",
+			       session_dirs != NULL ? session_dirs : "");
+	g_key_file_set_string (sessions, MDM_SESSIONS_GROUP, "SearchPath",
+			       search_path != NULL ? search_path : "");
+	g_key_file_set_boolean (sessions, MDM_SESSIONS_GROUP, "DirsFound", some_dir_exists);
+
+	g_strfreev (dirs);
+	g_strfreev (path_dirs);
+
+	return sessions;
+}
+
 gboolean
 mdm_common_config_save (GKeyFile   *config,
 			const char *filename,
@@ -25,11 +25,17 @@
 
 G_BEGIN_DECLS
 
+/* Session catalogue, see mdm_common_config_load_sessions */
+#define MDM_SESSION_CATALOGUE	".mdm-sessions"
+#define MDM_SESSIONS_GROUP	"MDM Sessions"
+
 GKeyFile * mdm_common_config_load             (const char *filename,
 					       GError    **error);
 GKeyFile * mdm_common_config_load_from_dirs   (const char  *filename,
 					       const char **dirs,
 					       GError    **error);
+GKeyFile * mdm_common_config_load_sessions    (const char *session_dirs,
+					       const char *search_path);
 gboolean   mdm_common_config_save             (GKeyFile   *config,
 					       const char *filename,
 					       GError    **error);
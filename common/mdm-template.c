@@ -0,0 +1,344 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mdm-template.h"
+
+/* A literal segment has param -1 and points into text */
+typedef struct {
+	gsize offset;
+	gsize len;
+	gint  param;
+} MdmTemplateSegment;
+
+struct _MdmTemplate {
+	gint                refcount;
+	char               *text;
+	gsize               text_len;
+	guint               n_params;
+	GArray             *segments;
+};
+
+typedef struct {
+	MdmTemplate *tmpl;
+	time_t       mtime;
+	off_t        size;
+} MdmTemplateCacheEntry;
+
+static GHashTable *template_cache = NULL;
+
+/* The entities lack the ';' on purpose, themes have always got them
+ * like this */
+static const char *
+html_escape_char (char c)
+{
+	switch (c) {
+	case '\'':
+		return "&#39";
+	case '"':
+		return "&#34";
+	case ';':
+		return "&#59";
+	case '<':
+		return "&#60";
+	case '>':
+		return "&#62";
+	case '\n':
+		return "<br/>";
+	default:
+		return NULL;
+	}
+}
+
+static gsize
+html_escape_len (const char *text)
+{
+	const char *p;
+	const char *esc;
+	gsize       len = 0;
+
+	for (p = text; *p != '\0'; p++) {
+		esc = html_escape_char (*p);
+		len += (esc != NULL) ? strlen (esc) : 1;
+	}
+
+	return len;
+}
+
+static char *
+html_escape_into (char *dest, const char *text)
+{
+	const char *p;
+	const char *esc;
+
+	for (p = text; *p != '\0'; p++) {
+		esc = html_escape_char (*p);
+		if (esc == NULL) {
+			*dest++ = *p;
+		} else {
+			while (*esc != '\0')
+				*dest++ = *esc++;
+		}
+	}
+
+	return dest;
+}
+
+static void
+add_segment (GArray *segments, gsize offset, gsize len, gint param)
+{
+	MdmTemplateSegment seg;
+
+	/* Empty literals happen between adjacent placeholders */
+	if (param < 0 && len == 0)
+		return;
+
+	seg.offset = offset;
+	seg.len    = len;
+	seg.param  = param;
+	g_array_append_val (segments, seg);
+}
+
+/**
+ * mdm_template_new
+ *
+ * Compiles @text against the placeholder names in @params, only the
+ * names are used.  Where names share a prefix the longest one wins.
+ * A '$' not followed by a known name stays as it is.
+ */
+MdmTemplate *
+mdm_template_new (const char             *text,
+		  gsize                   len,
+		  const MdmTemplateParam *params,
+		  guint                   n_params)
+{
+	MdmTemplate *tmpl;
+	const char  *p;
+	const char  *end;
+	const char  *lit;
+	const char  *dollar;
+	gsize       *name_len;
+	guint        i;
+
+	tmpl = g_new0 (MdmTemplate, 1);
+	tmpl->refcount = 1;
+	tmpl->text = g_strndup (text, len);
+	tmpl->text_len = len;
+	tmpl->n_params = n_params;
+	tmpl->segments = g_array_new (FALSE, FALSE, sizeof (MdmTemplateSegment));
+
+	name_len = g_newa (gsize, n_params);
+	for (i = 0; i < n_params; i++)
+		name_len[i] = strlen (params[i].name);
+
+	p = lit = tmpl->text;
+	end = tmpl->text + len;
+	while (p < end &&
+	       (dollar = memchr (p, '$', end - p)) != NULL) {
+		gint  best = -1;
+		gsize best_len = 0;
+
+		for (i = 0; i < n_params; i++) {
+			if (name_len[i] > best_len &&
+			    (gsize) (end - dollar - 1) >= name_len[i] &&
+			    memcmp (dollar + 1, params[i].name, name_len[i]) == 0) {
+				best = i;
+				best_len = name_len[i];
+			}
+		}
+
+		if (best < 0) {
+			p = dollar + 1;
+			continue;
+		}
+
+		add_segment (tmpl->segments, lit - tmpl->text, dollar - lit, -1);
+		add_segment (tmpl->segments, 0, 0, best);
+		p = lit = dollar + 1 + best_len;
+	}
+	add_segment (tmpl->segments, lit - tmpl->text, end - lit, -1);
+
+	return tmpl;
+}
+
+/**
+ * mdm_template_load
+ *
+ * Loads and compiles the template in @filename.  The compiled form is
+ * kept for as long as the file does not change, so @params must name
+ * the same placeholders on every call for a file.
+ */
+MdmTemplate *
+mdm_template_load (const char             *filename,
+		   const MdmTemplateParam *params,
+		   guint                   n_params,
+		   GError                **error)
+{
+	MdmTemplateCacheEntry *entry;
+	struct stat            s;
+	char                  *contents;
+	gsize                  len;
+
+	if (template_cache == NULL)
+		template_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	if (g_stat (filename, &s) != 0)
+		s.st_mtime = s.st_size = 0;
+
+	entry = g_hash_table_lookup (template_cache, filename);
+	if (entry != NULL &&
+	    entry->mtime == s.st_mtime &&
+	    entry->size == s.st_size &&
+	    entry->tmpl->n_params == n_params)
+		return mdm_template_ref (entry->tmpl);
+
+	if ( ! g_file_get_contents (filename, &contents, &len, error))
+		return NULL;
+
+	if (entry == NULL) {
+		entry = g_new0 (MdmTemplateCacheEntry, 1);
+		g_hash_table_insert (template_cache, g_strdup (filename), entry);
+	} else {
+		mdm_template_unref (entry->tmpl);
+	}
+	entry->tmpl  = mdm_template_new (contents, len, params, n_params);
+	entry->mtime = s.st_mtime;
+	entry->size  = s.st_size;
+	g_free (contents);
+
+	return mdm_template_ref (entry->tmpl);
+}
+
+MdmTemplate *
+mdm_template_ref (MdmTemplate *tmpl)
+{
+	g_return_val_if_fail (tmpl != NULL, NULL);
+
+	tmpl->refcount++;
+	return tmpl;
+}
+
+void
+mdm_template_unref (MdmTemplate *tmpl)
+{
+	if (tmpl == NULL || --tmpl->refcount > 0)
+		return;
+
+	g_array_free (tmpl->segments, TRUE);
+	g_free (tmpl->text);
+	g_free (tmpl);
+}
+
+/**
+ * mdm_template_render
+ *
+ * Fills in the values of @params, the same placeholders in the same
+ * order as the template was compiled with.  The result is sized up
+ * front and allocated once.
+ */
+char *
+mdm_template_render (MdmTemplate            *tmpl,
+		     const MdmTemplateParam *params)
+{
+	gssize *value_len;
+	gsize   total;
+	char   *ret;
+	char   *dest;
+	guint   i;
+
+	g_return_val_if_fail (tmpl != NULL, NULL);
+
+	value_len = g_newa (gssize, tmpl->n_params);
+	for (i = 0; i < tmpl->n_params; i++)
+		value_len[i] = -1;
+
+	total = 0;
+	for (i = 0; i < tmpl->segments->len; i++) {
+		MdmTemplateSegment *seg = &g_array_index (tmpl->segments, MdmTemplateSegment, i);
+		const char         *value;
+
+		if (seg->param < 0) {
+			total += seg->len;
+			continue;
+		}
+
+		if (value_len[seg->param] < 0) {
+			value = params[seg->param].value;
+			if (value == NULL)
+				value_len[seg->param] = 0;
+			else if (params[seg->param].escape)
+				value_len[seg->param] = html_escape_len (value);
+			else
+				value_len[seg->param] = strlen (value);
+		}
+		total += value_len[seg->param];
+	}
+
+	ret = dest = g_malloc (total + 1);
+	for (i = 0; i < tmpl->segments->len; i++) {
+		MdmTemplateSegment *seg = &g_array_index (tmpl->segments, MdmTemplateSegment, i);
+		const char         *value;
+
+		if (seg->param < 0) {
+			memcpy (dest, tmpl->text + seg->offset, seg->len);
+			dest += seg->len;
+			continue;
+		}
+
+		value = params[seg->param].value;
+		if (value == NULL)
+			continue;
+		if (params[seg->param].escape) {
+			dest = html_escape_into (dest, value);
+		} else {
+			memcpy (dest, value, value_len[seg->param]);
+			dest += value_len[seg->param];
+		}
+	}
+	*dest = '\0';
+
+	return ret;
+}
+
+/**
+ * mdm_template_html_escape
+ *
+ * Encodes @text the way placeholder values with escape set are.
+ */
+char *
+mdm_template_html_escape (const char *text)
+{
+	char *ret;
+	char *end;
+
+	g_return_val_if_fail (text != NULL, NULL);
+
+	ret = g_malloc (html_escape_len (text) + 1);
+	end = html_escape_into (ret, text);
+	*end = '\0';
+
+	return ret;
+}
@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MDM_TEMPLATE_H
+#define _MDM_TEMPLATE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Templates are text with $name placeholders, as used by the HTML
+ * greeter themes.  A template is split into literal and placeholder
+ * segments once, rendering then only copies. */
+
+typedef struct _MdmTemplate MdmTemplate;
+
+typedef struct {
+	const char *name;	/* without the '$' */
+	const char *value;	/* NULL renders as "" */
+	gboolean    escape;	/* HTML encode the value */
+} MdmTemplateParam;
+
+MdmTemplate * mdm_template_new         (const char             *text,
+					gsize                   len,
+					const MdmTemplateParam *params,
+					guint                   n_params);
+MdmTemplate * mdm_template_load        (const char             *filename,
+					const MdmTemplateParam *params,
+					guint                   n_params,
+					GError                **error);
+MdmTemplate * mdm_template_ref         (MdmTemplate            *tmpl);
+void          mdm_template_unref       (MdmTemplate            *tmpl);
+
+char *        mdm_template_render      (MdmTemplate            *tmpl,
+					const MdmTemplateParam *params);
+char *        mdm_template_html_escape (const char             *text);
+
+G_END_DECLS
+
+#endif /* _MDM_TEMPLATE_H */
@@ -0,0 +1,204 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "mdm-template.h"
+
+/* Usage: test-template [theme size in KiB] [renders] */
+
+static MdmTemplateParam params[] = {
+        { "session", "Session", TRUE },
+        { "selectsession", "Select a \"session\"", TRUE },
+        { "hostname", "<host>", FALSE },
+        { "label", "Line one\nLine two; 'quoted'", TRUE },
+        { "empty", NULL, FALSE },
+};
+
+/* What webkit_init did before templates: one split and join over the
+ * whole document per placeholder */
+static char *
+str_replace (const char *string, const char *delimiter, const char *replacement)
+{
+        char **split;
+        char  *ret;
+
+        split = g_strsplit (string, delimiter, 0);
+        ret = g_strjoinv (replacement, split);
+        g_strfreev (split);
+        return ret;
+}
+
+static char *
+naive_escape (const char *string)
+{
+        const char *from[] = { "'", "\"", ";", "<", ">", "\n" };
+        const char *to[] = { "&#39", "&#34", "&#59", "&#60", "&#62", "<br/>" };
+        char       *ret = g_strdup (string);
+        char       *tmp;
+        int         i;
+
+        for (i = 0; i < G_N_ELEMENTS (from); i++) {
+                tmp = str_replace (ret, from[i], to[i]);
+                g_free (ret);
+                ret = tmp;
+        }
+        return ret;
+}
+
+/* Longer names first, like the themes expect */
+static char *
+naive_render (const char *text)
+{
+        static const int order[] = { 1, 0, 2, 3, 4 };
+        char *ret = g_strdup (text);
+        char *name;
+        char *value;
+        char *tmp;
+        int   i;
+
+        for (i = 0; i < G_N_ELEMENTS (order); i++) {
+                const MdmTemplateParam *p = &params[order[i]];
+
+                name = g_strconcat ("$", p->name, NULL);
+                if (p->value == NULL)
+                        value = g_strdup ("");
+                else if (p->escape)
+                        value = naive_escape (p->value);
+                else
+                        value = g_strdup (p->value);
+                tmp = str_replace (ret, name, value);
+                g_free (ret);
+                g_free (name);
+                g_free (value);
+                ret = tmp;
+        }
+        return ret;
+}
+
+static void
+check (const char *text)
+{
+        MdmTemplate *tmpl;
+        char        *got;
+        char        *want;
+
+        tmpl = mdm_template_new (text, strlen (text), params, G_N_ELEMENTS (params));
+        got = mdm_template_render (tmpl, params);
+        want = naive_render (text);
+        if (strcmp (got, want) != 0)
+                g_error ("Rendering '%s' gave '%s', expected '%s'", text, got, want);
+
+        mdm_template_unref (tmpl);
+        g_free (got);
+        g_free (want);
+}
+
+static void
+test_render (void)
+{
+        char *escaped;
+
+        check ("");
+        check ("no placeholders at all");
+        check ("$session");
+        check ("<b>$selectsession</b> or $session, $$session$");
+        check ("$hostname$label$empty$unknown $");
+        check ("$sessionx $sessio $selectsessions");
+
+        escaped = mdm_template_html_escape ("a'b\"c;d<e>f\ng");
+        if (strcmp (escaped, "a&#39b&#34c&#59d&#60e&#62f<br/>g") != 0)
+                g_error ("Escaping gave '%s'", escaped);
+        g_free (escaped);
+
+        g_message ("Rendering matches the old replacement chain");
+}
+
+static void
+bench_render (int kib, int renders)
+{
+        GString     *theme;
+        MdmTemplate *tmpl;
+        GTimer      *timer;
+        double       compile;
+        double       fast;
+        double       slow;
+        char        *html;
+        int          i;
+
+        /* Something like a theme with an inline script and a label
+         * every few lines */
+        theme = g_string_new (NULL);
+        for (i = 0; theme->len < (gsize) kib * 1024; i++) {
+                g_string_append_printf (theme,
+                                        "<div class=\"row\" id=\"row%d\"><span>$session</span>"
+                                        "<a href=\"#\" onclick=\"select(%d); return false;\">$selectsession</a>"
+                                        "<p>$label</p><!-- $hostname --></div>\n"
+                                        "<script>var price%d = \"$5\"; items.push(%d);</script>\n",
+                                        i, i, i, i);
+        }
+
+        timer = g_timer_new ();
+        tmpl = mdm_template_new (theme->str, theme->len, params, G_N_ELEMENTS (params));
+        compile = g_timer_elapsed (timer, NULL);
+
+        g_timer_start (timer);
+        for (i = 0; i < renders; i++) {
+                html = mdm_template_render (tmpl, params);
+                g_free (html);
+        }
+        fast = g_timer_elapsed (timer, NULL) / renders;
+
+        g_timer_start (timer);
+        for (i = 0; i < renders; i++) {
+                html = naive_render (theme->str);
+                g_free (html);
+        }
+        slow = g_timer_elapsed (timer, NULL) / renders;
+
+        g_message ("%d KiB theme: compile %.2f ms, render %.2f ms, replacement chain %.2f ms",
+                   kib, compile * 1000, fast * 1000, slow * 1000);
+
+        g_timer_destroy (timer);
+        mdm_template_unref (tmpl);
+        g_string_free (theme, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+        int kib = 1024;
+        int renders = 10;
+
+        if (argc > 1)
+                kib = MAX (1, atoi (argv[1]));
+        if (argc > 2)
+                renders = MAX (1, atoi (argv[2]));
+
+        test_render ();
+        bench_render (kib, renders);
+
+        return 0;
+}
@@ -37,6 +37,7 @@
 #include "slave.h"
 #include "misc.h"
 #include "auth.h"
+#include "sessions.h"
 #include "mdm-net.h"
 
 #include "mdm-common.h"
@@ -111,9 +112,19 @@ mdm_display_alloc (gint id, const gchar *command, const gchar *device)
     d->last_start_time = 0;
     d->retry_count = 0;
     d->sleep_before_run = 0;
+    d->restart_streak = 0;
+
+    d->start_count = 0;
+    d->last_start_delay = 0;
+    d->last_exit_status = -1;
     d->login = NULL;
     d->preset_user = NULL;
 
+    d->warm = FALSE;
+    d->warm_ready = FALSE;
+    d->warm_return_vt = -1;
+    d->flexi_request_time = 0;
+
     d->timed_login_ok = FALSE;
 
     d->slave_notify_fd = -1;
@@ -131,9 +142,91 @@ mdm_display_alloc (gint id, const gchar *command, const gchar *device)
     return d;
 }
 
+typedef struct {
+	const char *name;
+	/* sleep before a start that is not a quick restart */
+	int first_delay;
+	/* sleep before the next quick restart */
+	int (*retry_delay) (MdmDisplay *disp, time_t since_last);
+} MdmRestartPolicy;
+
+static int
+restart_delay_fixed (MdmDisplay *disp, time_t since_last)
+{
+	/* At least 8 seconds between start attempts, but only after
+	 * the second start attempt, so you can try to kill mdm from the console
+	 * in these gaps.
+	 */
+	if (disp->retry_count > 2 && since_last < 8)
+		return 8 - since_last;
+
+	/* wait one second just for safety (avoids X server races) */
+	return 1;
+}
+
+static int
+restart_delay_backoff (MdmDisplay *disp, time_t since_last)
+{
+	int max;
+	int delay;
+	int jitter;
+
+	/* The first restart is free, most of the time it's just
+	 * someone zapping X */
+	if (disp->restart_streak <= 1)
+		return 0;
+
+	max = mdm_daemon_config_get_value_int (MDM_KEY_RESTART_BACKOFF_MAX);
+	if (max < 1)
+		max = 1;
+
+	delay = 1 << MIN (disp->restart_streak - 2, 16);
+	delay = MIN (delay, max);
+
+	/* so that displays that died together don't all come
+	 * back at the very same time */
+	jitter = delay / 4;
+	if (jitter > 0)
+		delay += g_random_int_range (-jitter, jitter + 1);
+
+	/* time already spent since the last start counts */
+	delay -= since_last;
+
+	return MAX (delay, 0);
+}
+
+/* How many displays of one batch may start per second */
+#define MDM_RESTARTS_PER_SECOND 2
+
+/* Number of displays started in the current batch, -1 if no batch */
+static int restart_batch = -1;
+
+static const MdmRestartPolicy restart_policies[] = {
+	{ "backoff", 0, restart_delay_backoff },
+	{ "fixed",   1, restart_delay_fixed }
+};
+
+static const MdmRestartPolicy *
+mdm_display_restart_policy (void)
+{
+	const char *name;
+	guint i;
+
+	name = mdm_daemon_config_get_value_string (MDM_KEY_RESTART_POLICY);
+
+	for (i = 0; i < G_N_ELEMENTS (restart_policies); i++) {
+		if (name != NULL &&
+		    g_ascii_strcasecmp (name, restart_policies[i].name) == 0)
+			return &restart_policies[i];
+	}
+
+	return &restart_policies[0];
+}
+
 static gboolean
 mdm_display_check_loop (MdmDisplay *disp)
 {
+  const MdmRestartPolicy *policy;
   time_t now;
   time_t since_last;
   time_t since_loop;
@@ -170,6 +263,10 @@ mdm_display_check_loop (MdmDisplay *disp)
       disp->last_start_time = now;
       disp->retry_count = 1;
 
+      /* only a display that actually stayed up gets its backoff back */
+      if (since_last >= 30)
+        disp->restart_streak = 0;
+
       mdm_debug ("Resetting counts for loop of death detection, 90 seconds elapsed since loop started or session lasted more then 30 seconds.");
       
       return TRUE;
@@ -216,25 +313,16 @@ mdm_display_check_loop (MdmDisplay *disp)
 	  return TRUE;
   }
   
-  /* At least 8 seconds between start attempts, but only after
-   * the second start attempt, so you can try to kill mdm from the console
-   * in these gaps.
-   */
-  if (disp->retry_count > 2 && since_last < 8)
-    {
-      mdm_debug ("Will sleep %ld seconds before next X server restart attempt",
-                 (long)(8 - since_last));
-      now = time (NULL) + 8 - since_last;
-      disp->sleep_before_run = 8 - since_last;
-      /* well, "last" start time will really be in the future */
-      disp->last_start_time = now + disp->sleep_before_run;
-    }
-  else
-    {
-      /* wait one second just for safety (avoids X server races) */
-      disp->sleep_before_run = 1;
-      disp->last_start_time = now;
-    }
+  disp->restart_streak++;
+
+  policy = mdm_display_restart_policy ();
+  disp->sleep_before_run = policy->retry_delay (disp, since_last);
+  /* well, "last" start time will really be in the future */
+  disp->last_start_time = now + disp->sleep_before_run;
+
+  if (disp->sleep_before_run > 1)
+    mdm_debug ("Will sleep %d seconds before next X server restart attempt (%s, restart %d in a row)",
+               disp->sleep_before_run, policy->name, disp->restart_streak);
 
   disp->retry_count++;
 
@@ -313,7 +401,7 @@ wait_again:
 		    d->servpid = 0;
 	    }
     }
-    d->slavepid = 0;
+    mdm_daemon_config_display_set_slavepid (d, 0);
 }
 
 /**
@@ -341,6 +429,20 @@ mdm_display_manage (MdmDisplay *d)
     if ( ! mdm_display_check_loop (d))
 	    return FALSE;
 
+    /* Don't bring a whole batch of displays back at the same time */
+    if (restart_batch >= 0) {
+	    int stagger = restart_batch++ / MDM_RESTARTS_PER_SECOND;
+
+	    if (d->sleep_before_run < stagger) {
+		    mdm_debug ("mdm_display_manage: Staggering start of %s by %d seconds", d->name, stagger);
+		    d->sleep_before_run = stagger;
+	    }
+    }
+
+    d->start_history[d->start_count % MDM_DISPLAY_START_HISTORY] = time (NULL) + d->sleep_before_run;
+    d->start_count++;
+    d->last_start_delay = d->sleep_before_run;
+
     if (d->slavepid != 0)
 	    mdm_debug ("mdm_display_manage: Old slave pid is %d", (int)d->slavepid);
 
@@ -358,7 +460,7 @@ mdm_display_manage (MdmDisplay *d)
     mdm_debug ("Forking slave process");
 
     /* Fork slave process */
-    pid = d->slavepid = fork ();
+    pid = fork ();
 
     switch (pid) {
 
@@ -381,6 +483,7 @@ mdm_display_manage (MdmDisplay *d)
 	pipeconn = NULL;
 	mdm_connection_close (unixconn);
 	unixconn = NULL;
+	mdm_sessions_stop_monitor ();
 
 	mdm_log_shutdown ();
 
@@ -418,13 +521,14 @@ mdm_display_manage (MdmDisplay *d)
 	break;
 
     case -1:
-	d->slavepid = 0;
+	mdm_daemon_config_display_set_slavepid (d, 0);
 	mdm_error ("mdm_display_manage: Failed forking MDM slave process for %s", d->name);
 
 	return FALSE;
 
     default:
 	mdm_debug ("mdm_display_manage: Forked slave: %d", (int)pid);
+	mdm_daemon_config_display_set_slavepid (d, pid);
 	d->master_notify_fd = fds[1];
 	VE_IGNORE_EINTR (close (fds[0]));
 	break;
@@ -443,13 +547,33 @@ mdm_display_manage (MdmDisplay *d)
 	    d->dispstat = DISPLAY_ALIVE;
     }
 
-    /* reset sleep to 1, to sleep just in case (avoids X server races) */
-    d->sleep_before_run = 1;
+    /* reset sleep for the next start, the fixed policy sleeps just in
+     * case (avoids X server races) */
+    d->sleep_before_run = mdm_display_restart_policy ()->first_delay;
 
     return TRUE;
 }
 
 
+/**
+ * mdm_display_restart_batch_begin:
+ *
+ * Displays managed until mdm_display_restart_batch_end() is called are
+ * started a bit apart from each other.
+ */
+void
+mdm_display_restart_batch_begin (void)
+{
+    restart_batch = 0;
+}
+
+void
+mdm_display_restart_batch_end (void)
+{
+    restart_batch = -1;
+}
+
+
 /**
  * mdm_display_unmanage:
  * @d: Pointer to a MdmDisplay struct
@@ -646,22 +770,8 @@ mdm_display_dispose (MdmDisplay *d)
 MdmDisplay *
 mdm_display_lookup (pid_t pid)
 {
-    GSList *li;
-    GSList *displays;
-
-    displays = mdm_daemon_config_get_display_list ();
-
     /* Find slave in display list */
-    for (li = displays; li != NULL; li = li->next) {
-	    MdmDisplay *d = li->data;
-
-	    if (d != NULL &&
-		pid == d->slavepid)
-		    return d;
-    }
-     
-    /* Slave not found */
-    return NULL;
+    return mdm_daemon_config_lookup_display_by_slavepid (pid);
 }
 
 
@@ -38,6 +38,8 @@ typedef struct _MdmDisplay MdmDisplay;
 #define SERVER_IS_LOCAL(d) ((d)->type == TYPE_STATIC || (d)->type == TYPE_FLEXI)
 #define SERVER_IS_FLEXI(d) ((d)->type == TYPE_FLEXI)
 
+#define MDM_DISPLAY_START_HISTORY 16 /* start times kept for RESTART_STATS */
+
 /* Use this to get the right authfile name */
 #define MDM_AUTHFILE(display) \
 	(display->authfile_mdm != NULL ? display->authfile_mdm : display->authfile)
@@ -86,6 +88,13 @@ struct _MdmDisplay
 	time_t last_loop_start_time;
 	gint retry_count;
 	int sleep_before_run;
+	gint restart_streak; /* restarts since the display last stayed up */
+
+	/* restart statistics, see RESTART_STATS */
+	guint start_count;
+	time_t start_history[MDM_DISPLAY_START_HISTORY];
+	int last_start_delay;
+	int last_exit_status; /* raw waitpid status, -1 if none yet */
 
 	gchar *cookie;
 	gchar *bcookie;
@@ -180,6 +189,12 @@ struct _MdmDisplay
 	uid_t server_uid;
 	MdmConnection *socket_conn;
 
+	/* Pre-started flexi display waiting in the warm pool */
+	gboolean warm;
+	gboolean warm_ready;
+	int warm_return_vt;
+	gint64 flexi_request_time;
+
 };
 
 MdmDisplay *mdm_display_alloc    (gint id, const gchar *command, const gchar *device);
@@ -187,6 +202,8 @@ gboolean    mdm_display_manage   (MdmDisplay *d);
 void        mdm_display_dispose  (MdmDisplay *d);
 void        mdm_display_unmanage (MdmDisplay *d);
 MdmDisplay *mdm_display_lookup   (pid_t pid);
+void        mdm_display_restart_batch_begin (void);
+void        mdm_display_restart_batch_end   (void);
 
 #endif /* _MDM_DISPLAY_H */
 
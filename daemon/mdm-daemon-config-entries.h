@@ -85,10 +85,15 @@ typedef enum {
 	MDM_ID_FLEXI_REAP_DELAY_MINUTES,
 	MDM_ID_STANDARD_XSERVER,
 	MDM_ID_FLEXIBLE_XSERVERS,
+	MDM_ID_FLEXI_WARM_POOL_SIZE,
 	MDM_ID_FIRST_VT,
 	MDM_ID_VT_ALLOCATION,
 	MDM_ID_CONSOLE_CANNOT_HANDLE,
 	MDM_ID_XSERVER_TIMEOUT,
+	MDM_ID_RESTART_POLICY,
+	MDM_ID_RESTART_BACKOFF_MAX,
+	MDM_ID_FACE_CACHE_DIR,
+	MDM_ID_GREETER_PREFETCH,
 	MDM_ID_SERVER_PREFIX,
 	MDM_ID_SERVER_NAME,
 	MDM_ID_SERVER_COMMAND,
@@ -112,12 +117,15 @@ typedef enum {
 	MDM_ID_GTKRC,
 	MDM_ID_MAX_ICON_WIDTH,
 	MDM_ID_MAX_ICON_HEIGHT,
+	MDM_ID_FACE_DECODE_THREADS,
 	MDM_ID_ALLOW_GTK_THEME_CHANGE,
 	MDM_ID_GTK_THEMES_TO_ALLOW,
 	MDM_ID_BROWSER,
 	MDM_ID_INCLUDE,
 	MDM_ID_EXCLUDE,
 	MDM_ID_INCLUDE_ALL,
+	MDM_ID_INCLUDE_ALL_MAX_USERS,
+	MDM_ID_INCLUDE_ALL_TIME_LIMIT,
 	MDM_ID_MINIMAL_UID,
 	MDM_ID_DEFAULT_FACE,
 	MDM_ID_GLOBAL_FACE_DIR,
@@ -137,6 +145,7 @@ typedef enum {
 	MDM_ID_BACKGROUND_IMAGE,
 	MDM_ID_BACKGROUND_COLOR,
 	MDM_ID_BACKGROUND_TYPE,		
+	MDM_ID_BACKGROUND_CACHE,
 	MDM_ID_USE_24_CLOCK,
 	MDM_ID_ENTRY_CIRCLES,
 	MDM_ID_ENTRY_INVISIBLE,
@@ -297,6 +306,7 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 
 	{ MDM_CONFIG_GROUP_DAEMON, "StandardXServer", MDM_CONFIG_VALUE_STRING, X_SERVER, MDM_ID_STANDARD_XSERVER },
 	{ MDM_CONFIG_GROUP_DAEMON, "FlexibleXServers", MDM_CONFIG_VALUE_INT, "5", MDM_ID_FLEXIBLE_XSERVERS },
+	{ MDM_CONFIG_GROUP_DAEMON, "FlexiWarmPoolSize", MDM_CONFIG_VALUE_INT, "0", MDM_ID_FLEXI_WARM_POOL_SIZE },
 
 	/* Keys for automatic VT allocation rather then letting it up to the X server */
 	{ MDM_CONFIG_GROUP_DAEMON, "FirstVT", MDM_CONFIG_VALUE_INT, "7", MDM_ID_FIRST_VT },
@@ -307,6 +317,16 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 	/* How long to wait before assuming an Xserver has timed out */
 	{ MDM_CONFIG_GROUP_DAEMON, "MdmXserverTimeout", MDM_CONFIG_VALUE_INT, "10", MDM_ID_XSERVER_TIMEOUT },
 
+	/* How long to wait before restarting a display that keeps dying */
+	{ MDM_CONFIG_GROUP_DAEMON, "RestartPolicy", MDM_CONFIG_VALUE_STRING, "backoff", MDM_ID_RESTART_POLICY },
+	{ MDM_CONFIG_GROUP_DAEMON, "RestartBackoffMax", MDM_CONFIG_VALUE_INT, "60", MDM_ID_RESTART_BACKOFF_MAX },
+
+	/* Where the slave keeps pre-scaled user faces for the greeter */
+	{ MDM_CONFIG_GROUP_DAEMON, "FaceCacheDir", MDM_CONFIG_VALUE_STRING, FACECACHEDIR, MDM_ID_FACE_CACHE_DIR },
+
+	/* Read what the greeter needs while the X server starts */
+	{ MDM_CONFIG_GROUP_DAEMON, "GreeterPrefetch", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_GREETER_PREFETCH },
+
 	{ MDM_CONFIG_GROUP_DAEMON, "SystemCommandsInMenu", MDM_CONFIG_VALUE_STRING_ARRAY, "HALT;REBOOT;SUSPEND", MDM_ID_SYSTEM_COMMANDS_IN_MENU },
 	{ MDM_CONFIG_GROUP_DAEMON, "AllowLogoutActions", MDM_CONFIG_VALUE_STRING_ARRAY, "HALT;REBOOT;SUSPEND", MDM_ID_ALLOW_LOGOUT_ACTIONS },
 	{ MDM_CONFIG_GROUP_DAEMON, "RBACSystemCommandKeys", MDM_CONFIG_VALUE_STRING_ARRAY, MDM_RBAC_SYSCMD_KEYS, MDM_ID_RBAC_SYSTEM_COMMAND_KEYS },
@@ -329,6 +349,7 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 	{ MDM_CONFIG_GROUP_GUI, "GtkRC", MDM_CONFIG_VALUE_STRING, DATADIR "/themes/Default/gtk-2.0/gtkrc", MDM_ID_GTKRC },
 	{ MDM_CONFIG_GROUP_GUI, "MaxIconWidth", MDM_CONFIG_VALUE_INT, "128", MDM_ID_MAX_ICON_WIDTH },
 	{ MDM_CONFIG_GROUP_GUI, "MaxIconHeight", MDM_CONFIG_VALUE_INT, "128", MDM_ID_MAX_ICON_HEIGHT },
+	{ MDM_CONFIG_GROUP_GUI, "FaceDecodeThreads", MDM_CONFIG_VALUE_INT, "2", MDM_ID_FACE_DECODE_THREADS },
 
 	{ MDM_CONFIG_GROUP_GUI, "AllowGtkThemeChange", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_ALLOW_GTK_THEME_CHANGE },
 	{ MDM_CONFIG_GROUP_GUI, "GtkThemesToAllow", MDM_CONFIG_VALUE_STRING, "all", MDM_ID_GTK_THEMES_TO_ALLOW },
@@ -337,6 +358,8 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 	{ MDM_CONFIG_GROUP_GREETER, "Include", MDM_CONFIG_VALUE_STRING, "", MDM_ID_INCLUDE },
 	{ MDM_CONFIG_GROUP_GREETER, "Exclude", MDM_CONFIG_VALUE_STRING, "bin,daemon,adm,lp,sync,shutdown,halt,mail,news,uucp,operator,nobody,mdm,postgres,pvm,rpm,nfsnobody,pcap", MDM_ID_EXCLUDE },
 	{ MDM_CONFIG_GROUP_GREETER, "IncludeAll", MDM_CONFIG_VALUE_BOOL, "false", MDM_ID_INCLUDE_ALL },
+	{ MDM_CONFIG_GROUP_GREETER, "IncludeAllMaxUsers", MDM_CONFIG_VALUE_INT, "1000", MDM_ID_INCLUDE_ALL_MAX_USERS },
+	{ MDM_CONFIG_GROUP_GREETER, "IncludeAllTimeLimit", MDM_CONFIG_VALUE_INT, "5", MDM_ID_INCLUDE_ALL_TIME_LIMIT },
 	{ MDM_CONFIG_GROUP_GREETER, "MinimalUID", MDM_CONFIG_VALUE_INT, "100", MDM_ID_MINIMAL_UID },
 	{ MDM_CONFIG_GROUP_GREETER, "DefaultFace", MDM_CONFIG_VALUE_STRING, PIXMAPDIR "/nobody.png", MDM_ID_DEFAULT_FACE },
 	{ MDM_CONFIG_GROUP_GREETER, "GlobalFaceDir", MDM_CONFIG_VALUE_STRING, DATADIR "/pixmaps/faces/", MDM_ID_GLOBAL_FACE_DIR },
@@ -367,6 +390,8 @@ static const MdmConfigEntry mdm_daemon_config_entries [] = {
 	{ MDM_CONFIG_GROUP_GREETER, "BackgroundImage", MDM_CONFIG_VALUE_STRING, "", MDM_ID_BACKGROUND_IMAGE },
 	{ MDM_CONFIG_GROUP_GREETER, "BackgroundColor", MDM_CONFIG_VALUE_STRING, "#000000", MDM_ID_BACKGROUND_COLOR },
 	{ MDM_CONFIG_GROUP_GREETER, "BackgroundType", MDM_CONFIG_VALUE_INT, "2", MDM_ID_BACKGROUND_TYPE },		
+	/* Keep the scaled background image in ServAuthDir */
+	{ MDM_CONFIG_GROUP_GREETER, "BackgroundCache", MDM_CONFIG_VALUE_BOOL, "true", MDM_ID_BACKGROUND_CACHE },
 	{ MDM_CONFIG_GROUP_GREETER, "Use24Clock", MDM_CONFIG_VALUE_STRING, "true", MDM_ID_USE_24_CLOCK },
 	{ MDM_CONFIG_GROUP_GREETER, "UseCirclesInEntry", MDM_CONFIG_VALUE_BOOL, "false", MDM_ID_ENTRY_CIRCLES },
 	{ MDM_CONFIG_GROUP_GREETER, "UseInvisibleInEntry", MDM_CONFIG_VALUE_BOOL, "false", MDM_ID_ENTRY_INVISIBLE },
@@ -82,10 +82,15 @@ G_BEGIN_DECLS
 #define MDM_KEY_FLEXI_REAP_DELAY_MINUTES "daemon/FlexiReapDelayMinutes=0"
 #define MDM_KEY_STANDARD_XSERVER "daemon/StandardXServer=" X_SERVER
 #define MDM_KEY_FLEXIBLE_XSERVERS "daemon/FlexibleXServers=5"
+#define MDM_KEY_FLEXI_WARM_POOL_SIZE "daemon/FlexiWarmPoolSize=0"
 #define MDM_KEY_FIRST_VT "daemon/FirstVT=7"
 #define MDM_KEY_VT_ALLOCATION "daemon/VTAllocation=true"
 #define MDM_KEY_CONSOLE_CANNOT_HANDLE "daemon/ConsoleCannotHandle=am,ar,az,bn,el,fa,gu,hi,ja,ko,ml,mr,pa,ta,zh"
 #define MDM_KEY_XSERVER_TIMEOUT "daemon/MdmXserverTimeout=10"
+#define MDM_KEY_RESTART_POLICY "daemon/RestartPolicy=backoff"
+#define MDM_KEY_RESTART_BACKOFF_MAX "daemon/RestartBackoffMax=60"
+#define MDM_KEY_FACE_CACHE_DIR "daemon/FaceCacheDir=" FACECACHEDIR
+#define MDM_KEY_GREETER_PREFETCH "daemon/GreeterPrefetch=true"
 #define MDM_KEY_SYSTEM_COMMANDS_IN_MENU "daemon/SystemCommandsInMenu=HALT;REBOOT;SUSPEND"
 #define MDM_KEY_ALLOW_LOGOUT_ACTIONS "daemon/AllowLogoutActions=HALT;REBOOT;SUSPEND"
 #define MDM_KEY_RBAC_SYSTEM_COMMAND_KEYS "daemon/RBACSystemCommandKeys=" MDM_RBAC_SYSCMD_KEYS
@@ -114,12 +119,15 @@ G_BEGIN_DECLS
 #define MDM_KEY_GTKRC "gui/GtkRC=" DATADIR "/themes/Default/gtk-2.0/gtkrc"
 #define MDM_KEY_MAX_ICON_WIDTH "gui/MaxIconWidth=128"
 #define MDM_KEY_MAX_ICON_HEIGHT "gui/MaxIconHeight=128"
+#define MDM_KEY_FACE_DECODE_THREADS "gui/FaceDecodeThreads=2"
 #define MDM_KEY_ALLOW_GTK_THEME_CHANGE "gui/AllowGtkThemeChange=true"
 #define MDM_KEY_GTK_THEMES_TO_ALLOW "gui/GtkThemesToAllow=all"
 #define MDM_KEY_BROWSER "greeter/Browser=true"
 #define MDM_KEY_INCLUDE "greeter/Include="
 #define MDM_KEY_EXCLUDE "greeter/Exclude=bin,daemon,adm,lp,sync,shutdown,halt,mail,news,uucp,operator,nobody,mdm,postgres,pvm,rpm,nfsnobody,pcap"
 #define MDM_KEY_INCLUDE_ALL "greeter/IncludeAll=false"
+#define MDM_KEY_INCLUDE_ALL_MAX_USERS "greeter/IncludeAllMaxUsers=1000"
+#define MDM_KEY_INCLUDE_ALL_TIME_LIMIT "greeter/IncludeAllTimeLimit=5"
 #define MDM_KEY_MINIMAL_UID "greeter/MinimalUID=100"
 #define MDM_KEY_DEFAULT_FACE "greeter/DefaultFace=" PIXMAPDIR "/nobody.png"
 #define MDM_KEY_GLOBAL_FACE_DIR "greeter/GlobalFaceDir=" DATADIR "/pixmaps/faces/"
@@ -139,6 +147,7 @@ G_BEGIN_DECLS
 #define MDM_KEY_BACKGROUND_IMAGE "greeter/BackgroundImage="
 #define MDM_KEY_BACKGROUND_COLOR "greeter/BackgroundColor=#000000"
 #define MDM_KEY_BACKGROUND_TYPE "greeter/BackgroundType=2"
+#define MDM_KEY_BACKGROUND_CACHE "greeter/BackgroundCache=true"
 #define MDM_KEY_USE_24_CLOCK "greeter/Use24Clock=true"
 #define MDM_KEY_ENTRY_CIRCLES "greeter/UseCirclesInEntry=false"
 #define MDM_KEY_ENTRY_INVISIBLE "greeter/UseInvisibleInEntry=false"
@@ -185,6 +194,7 @@ G_BEGIN_DECLS
 #define MDM_NOTIFY_SOFT_RESTART_SERVERS "SOFT_RESTART_SERVERS"
 #define MDM_NOTIFY_GO "GO"
 #define MDM_NOTIFY_TWIDDLE_POINTER "TWIDDLE_POINTER"
+#define MDM_NOTIFY_FLEXI_TAKEN "FLEXI_TAKEN"
 
 G_END_DECLS
 
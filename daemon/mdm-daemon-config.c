@@ -57,6 +57,7 @@
 #include "server.h"
 #include "filecheck.h"
 #include "slave.h"
+#include "sessions.h"
 
 #include "mdm-common.h"
 #include "mdm-config.h"
@@ -70,6 +71,11 @@ static MdmConfig *daemon_config = NULL;
 static GSList *displays = NULL;
 static GSList *xservers = NULL;
 
+/* Indexes into displays, so that slave messages and child reaping
+ * don't have to walk the whole list */
+static GHashTable *displays_by_slavepid = NULL;
+static GHashTable *displays_by_dispnum = NULL;
+
 static gint high_display_num = 0;
 static const char *default_config_file = NULL;
 static char *custom_config_file = NULL;
@@ -149,10 +155,56 @@ mdm_daemon_config_get_display_list (void)
 	return displays;
 }
 
+static void
+display_index_init (void)
+{
+	if (displays_by_slavepid != NULL)
+		return;
+
+	displays_by_slavepid = g_hash_table_new (NULL, NULL);
+	displays_by_dispnum  = g_hash_table_new (NULL, NULL);
+}
+
+static void
+display_index_clear (void)
+{
+	if (displays_by_slavepid == NULL)
+		return;
+
+	g_hash_table_remove_all (displays_by_slavepid);
+	g_hash_table_remove_all (displays_by_dispnum);
+}
+
+/* Only drop the entry if it's still ours, someone else may have
+ * picked up the key in the meantime */
+static void
+display_index_remove (GHashTable *index, int key, MdmDisplay *display)
+{
+	if (g_hash_table_lookup (index, GINT_TO_POINTER (key)) == display)
+		g_hash_table_remove (index, GINT_TO_POINTER (key));
+}
+
+static void
+display_index_add (MdmDisplay *display)
+{
+	display_index_init ();
+
+	if (display->slavepid > 0)
+		g_hash_table_insert (displays_by_slavepid,
+				     GINT_TO_POINTER (display->slavepid), display);
+	/* flexi displays have no number until the slave finds one */
+	if (display->dispnum != G_MAXUINT16)
+		g_hash_table_insert (displays_by_dispnum,
+				     GINT_TO_POINTER ((int)display->dispnum), display);
+}
+
 GSList *
 mdm_daemon_config_display_list_append (MdmDisplay *display)
 {
 	displays = g_slist_append (displays, display);
+	display_index_add (display);
+	if (SERVER_IS_LOCAL (display))
+		mdm_display_number_reserve (display->dispnum);
 	return displays;
 }
 
@@ -162,6 +214,9 @@ mdm_daemon_config_display_list_insert (MdmDisplay *display)
         displays = g_slist_insert_sorted (displays,
                                           display,
                                           mdm_daemon_config_compare_displays);
+	display_index_add (display);
+	if (SERVER_IS_LOCAL (display))
+		mdm_display_number_reserve (display->dispnum);
 	return displays;
 }
 
@@ -169,10 +224,138 @@ GSList *
 mdm_daemon_config_display_list_remove (MdmDisplay *display)
 {
 	displays = g_slist_remove (displays, display);
+	mdm_daemon_config_display_number_changed (display, display->dispnum, -1);
+
+	if (displays_by_slavepid != NULL)
+		display_index_remove (displays_by_slavepid, display->slavepid, display);
 
 	return displays;
 }
 
+/**
+ * mdm_daemon_config_display_set_slavepid
+ *
+ * Sets the slave pid of a display, keeping the pid index in sync.
+ */
+void
+mdm_daemon_config_display_set_slavepid (MdmDisplay *display,
+					pid_t       pid)
+{
+	display_index_init ();
+
+	display_index_remove (displays_by_slavepid, display->slavepid, display);
+	display->slavepid = pid;
+	if (pid > 0)
+		g_hash_table_insert (displays_by_slavepid,
+				     GINT_TO_POINTER (pid), display);
+}
+
+/**
+ * mdm_daemon_config_lookup_display_by_slavepid
+ *
+ * Returns the display whose slave has @pid, or NULL.
+ */
+MdmDisplay *
+mdm_daemon_config_lookup_display_by_slavepid (pid_t pid)
+{
+	MdmDisplay *d;
+
+	if (pid <= 0 || displays_by_slavepid == NULL)
+		return NULL;
+
+	d = g_hash_table_lookup (displays_by_slavepid, GINT_TO_POINTER (pid));
+	if (d != NULL && d->slavepid == pid)
+		return d;
+
+	return NULL;
+}
+
+/**
+ * mdm_daemon_config_lookup_display_by_number
+ *
+ * Returns the display running on X display number @num, or NULL.
+ */
+MdmDisplay *
+mdm_daemon_config_lookup_display_by_number (int num)
+{
+	MdmDisplay *d;
+
+	if (num < 0 || num >= G_MAXUINT16 || displays_by_dispnum == NULL)
+		return NULL;
+
+	d = g_hash_table_lookup (displays_by_dispnum, GINT_TO_POINTER (num));
+	if (d != NULL && d->dispnum == num)
+		return d;
+
+	return NULL;
+}
+
+/**
+ * mdm_daemon_config_lookup_display_by_name
+ *
+ * Returns the display called @name (e.g. ":0"), or NULL.
+ */
+MdmDisplay *
+mdm_daemon_config_lookup_display_by_name (const char *name)
+{
+	MdmDisplay *d;
+	char *end;
+	long num;
+
+	if (name == NULL || name[0] != ':')
+		return NULL;
+
+	num = strtol (&name[1], &end, 10);
+	if (end == &name[1] || num < 0 || num >= G_MAXUINT16)
+		return NULL;
+
+	d = mdm_daemon_config_lookup_display_by_number ((int)num);
+	if (d != NULL && d->name != NULL && strcmp (d->name, name) == 0)
+		return d;
+
+	return NULL;
+}
+
+/**
+ * mdm_daemon_config_display_number_changed
+ *
+ * Keeps the reserved display numbers in sync when a display gets a
+ * new number (or @new_num of -1 when it goes away).  The old number is
+ * only given up if no other display still claims it.
+ */
+void
+mdm_daemon_config_display_number_changed (MdmDisplay *display,
+					  int         old_num,
+					  int         new_num)
+{
+	GSList *li;
+
+	for (li = displays; li != NULL; li = li->next) {
+		MdmDisplay *d = li->data;
+
+		if (d != display &&
+		    SERVER_IS_LOCAL (d) &&
+		    d->dispnum == old_num)
+			break;
+	}
+	if (li == NULL)
+		mdm_display_number_release (old_num);
+
+	if (new_num >= 0 && SERVER_IS_LOCAL (display))
+		mdm_display_number_reserve (new_num);
+
+	if (displays_by_dispnum != NULL) {
+		display_index_remove (displays_by_dispnum, old_num, display);
+		/* hand the old number back to whoever else has it */
+		if (li != NULL)
+			g_hash_table_insert (displays_by_dispnum,
+					     GINT_TO_POINTER (old_num), li->data);
+		if (new_num >= 0)
+			g_hash_table_insert (displays_by_dispnum,
+					     GINT_TO_POINTER (new_num), display);
+	}
+}
+
 /**
  * mdm_daemon_config_get_value_int
  *
@@ -1382,8 +1565,7 @@ mdm_daemon_config_load_displays (MdmConfig *config)
 			continue;
 		}
 
-		displays = g_slist_insert_sorted (displays, disp,
-			mdm_daemon_config_compare_displays);
+		mdm_daemon_config_display_list_insert (disp);
 		if (keynum > high_display_num) {
 			high_display_num = keynum;
 		}
@@ -1806,7 +1988,7 @@ handle_no_displays (MdmConfig *config,
 		d = mdm_display_alloc (num, server, NULL);
 		d->is_emergency_server = TRUE;
 
-		displays = g_slist_append (displays, d);
+		mdm_daemon_config_display_list_append (d);
 
 		/* ALWAYS run the greeter and don't log anyone in,
 		 * this is just an emergency session */
@@ -2127,6 +2309,7 @@ mdm_daemon_config_parse (const char *config_file,
 
 	displays            = NULL;
 	high_display_num    = 0;
+	display_index_clear ();
 
 	/* Not NULL if config_file was set by command-line option. */
 	if (config_file == NULL) {
@@ -2269,175 +2452,155 @@ mdm_daemon_config_signal_terminthup_was_notified (void)
 	}
 }
 
-static gboolean
-is_prog_in_path (const char *prog)
-{
-	char    *f;
-	gboolean ret;
-
-	f = g_find_program_in_path (prog);
-	ret = (f != NULL);
-	g_free (f);
-	return ret;
-}
-
 /**
  * mdm_daemon_config_get_session_exec
  *
- * This function accesses the MDM session desktop file and returns
- * the execution command for starting the session.
+ * This function looks the session up in the session catalogue and
+ * returns the execution command for starting the session.
  *
- * Must be called with the PATH set correctly to find session exec.
+ * TryExec has been resolved against the greeter's PATH when the
+ * catalogue was built.
  */
 char *
 mdm_daemon_config_get_session_exec (const char *session_name,
 				    gboolean    check_try_exec)
 {
 	char        *session_filename;
-	const char  *path_str;
-	char       **search_dirs;
-	GKeyFile    *cfg;
-	static char *exec;
-	static char *cached = NULL;
+	GKeyFile    *sessions;
+	char        *key;
 	gboolean     hidden;
-	char        *ret;
+	gboolean     available;
+	char        *exec;
 
-	cfg = NULL;
-
-	/* clear cache */
-	if (session_name == NULL) {
-		g_free (exec);
-		exec = NULL;
-		g_free (cached);
-		cached = NULL;
+	/* The catalogue keeps itself up to date, nothing to clear */
+	if (session_name == NULL)
 		return NULL;
-	}
-
-	if (cached != NULL && strcmp (ve_sure_string (session_name), ve_sure_string (cached)) == 0)
-		return g_strdup (exec);
-
-	g_free (exec);
-	exec = NULL;
-	g_free (cached);
-	cached = g_strdup (session_name);
 
+	sessions = mdm_sessions_get ();
 	session_filename = mdm_ensure_extension (session_name, ".desktop");
+	exec = NULL;
 
-	path_str = mdm_daemon_config_get_value_string (MDM_KEY_SESSION_DESKTOP_DIR);
-	if (path_str == NULL) {
-		mdm_error ("No session desktop directories defined");
-		goto out;
-	}
-
-	search_dirs = g_strsplit (path_str, ":", -1);
-
-	cfg = mdm_common_config_load_from_dirs (session_filename,
-						(const char **)search_dirs,
-						NULL);
-	g_strfreev (search_dirs);
-
-	if (cfg == NULL) {
-		g_free (exec);
-		exec = NULL;
+	if (sessions == NULL || ! g_key_file_has_group (sessions, session_filename))
 		goto out;
-	}
 
 	hidden = FALSE;
-	mdm_common_config_get_boolean (cfg, "Desktop Entry/Hidden=false", &hidden, NULL);
-	if (hidden) {
-		g_free (exec);
-		exec = NULL;
+	key = g_strconcat (session_filename, "/Hidden=false", NULL);
+	mdm_common_config_get_boolean (sessions, key, &hidden, NULL);
+	g_free (key);
+	if (hidden)
 		goto out;
-	}
 
 	if (check_try_exec) {
-		char *tryexec;
-
-		tryexec = NULL;
-		mdm_common_config_get_string (cfg, "Desktop Entry/TryExec", &tryexec, NULL);
-
-		if (tryexec != NULL &&
-		    tryexec[0] != '\0' &&
-		    ! is_prog_in_path (tryexec)) {
-			g_free (tryexec);
-			g_free (exec);
-			exec = NULL;
+		available = TRUE;
+		key = g_strconcat (session_filename, "/X-Mdm-Available=true", NULL);
+		mdm_common_config_get_boolean (sessions, key, &available, NULL);
+		g_free (key);
+		if ( ! available)
 			goto out;
-		}
-		g_free (tryexec);
 	}
 
-	exec = NULL;
-	mdm_common_config_get_string (cfg, "Desktop Entry/Exec", &exec, NULL);
+	key = g_strconcat (session_filename, "/Exec", NULL);
+	mdm_common_config_get_string (sessions, key, &exec, NULL);
+	g_free (key);
 
  out:
+	g_free (session_filename);
 
-	ret = g_strdup (exec);
-
-	g_key_file_free (cfg);
-
-	return ret;
+	return exec;
 }
 
 /**
  * mdm_daemon_config_get_session_xserver_args
  *
- * This function accesses the MDM session desktop file and returns
- * additional Xserver arguments to be used with this session
+ * This function looks the session up in the session catalogue and
+ * returns additional Xserver arguments to be used with this session
  */
 char *
 mdm_daemon_config_get_session_xserver_args (const char *session_name)
 {
 	char        *session_filename;
-	const char  *path_str;
-	char       **search_dirs;
-	GKeyFile    *cfg;
-	static char *xserver_args;
-	static char *cached = NULL;
-	char        *ret;
-
-	cfg = NULL;
-
-	/* clear cache */
-	if (session_name == NULL) {
-		g_free (xserver_args);
-		xserver_args = NULL;
-		g_free (cached);
-		cached = NULL;
-		return NULL;
-	}
+	GKeyFile    *sessions;
+	char        *key;
+	char        *xserver_args;
 
-	if (cached != NULL && strcmp (ve_sure_string (session_name), ve_sure_string (cached)) == 0)
-		return g_strdup (xserver_args);
+	if (session_name == NULL)
+		return NULL;
 
-	g_free (xserver_args);
+	sessions = mdm_sessions_get ();
+	session_filename = mdm_ensure_extension (session_name, ".desktop");
 	xserver_args = NULL;
-	g_free (cached);
-	cached = g_strdup (session_name);
 
-	path_str = mdm_daemon_config_get_value_string (MDM_KEY_SESSION_DESKTOP_DIR);
-	if (path_str == NULL) {
-		mdm_error ("No session desktop directories defined");
-		goto out;
+	if (sessions != NULL && g_key_file_has_group (sessions, session_filename)) {
+		key = g_strconcat (session_filename, "/X-Mdm-XserverArgs", NULL);
+		mdm_common_config_get_string (sessions, key, &xserver_args, NULL);
+		g_free (key);
 	}
 
-	search_dirs = g_strsplit (path_str, ":", -1);
+	g_free (session_filename);
 
-	cfg = mdm_common_config_load_from_dirs (session_filename,
-						(const char **)search_dirs,
-						NULL);
-	g_strfreev (search_dirs);
+	return xserver_args;
+}
 
-	xserver_args = NULL;
-	mdm_common_config_get_string (cfg, "Desktop Entry/X-Mdm-XserverArgs", &xserver_args, NULL);
+/*
+ * The greeter asks for the .dmrc settings each time a user is picked
+ * and the session start reads them again, which hurts with NFS homes.
+ * Keep the parsed files around as long as the owner, inode, mtime and
+ * size stay the same.
+ */
+typedef struct {
+	GKeyFile *dmrc;
+	uid_t     uid;
+	dev_t     dev;
+	ino_t     ino;
+	time_t    mtime;
+	off_t     size;
+} MdmDmrcCacheEntry;
 
- out:
+static GHashTable *dmrc_cache = NULL;
 
-	ret = g_strdup (xserver_args);
+static void
+dmrc_cache_entry_free (MdmDmrcCacheEntry *entry)
+{
+	if (entry->dmrc != NULL)
+		g_key_file_free (entry->dmrc);
+	g_free (entry);
+}
 
-	g_key_file_free (cfg);
+/* Returns the parsed file, owned by the cache, or NULL if there is none */
+static GKeyFile *
+dmrc_lookup (const char *cfgfile)
+{
+	MdmDmrcCacheEntry *entry;
+	struct stat        s;
 
-	return ret;
+	if (dmrc_cache == NULL)
+		dmrc_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						    (GDestroyNotify) dmrc_cache_entry_free);
+
+	if (g_stat (cfgfile, &s) != 0) {
+		g_hash_table_remove (dmrc_cache, cfgfile);
+		return NULL;
+	}
+
+	entry = g_hash_table_lookup (dmrc_cache, cfgfile);
+	if (entry != NULL &&
+	    entry->uid == s.st_uid &&
+	    entry->dev == s.st_dev &&
+	    entry->ino == s.st_ino &&
+	    entry->mtime == s.st_mtime &&
+	    entry->size == s.st_size)
+		return entry->dmrc;
+
+	entry = g_new0 (MdmDmrcCacheEntry, 1);
+	entry->dmrc = mdm_common_config_load (cfgfile, NULL);
+	entry->uid = s.st_uid;
+	entry->dev = s.st_dev;
+	entry->ino = s.st_ino;
+	entry->mtime = s.st_mtime;
+	entry->size = s.st_size;
+	g_hash_table_replace (dmrc_cache, g_strdup (cfgfile), entry);
+
+	return entry->dmrc;
 }
 
 /**
@@ -2455,48 +2618,65 @@ mdm_daemon_config_set_user_session_lang (gboolean savesess,
 {
 	GKeyFile *dmrc;
 	gchar *cfgstr;
+	gchar *old;
+	gboolean changed;
+
+	if ( ! savesess && ! savelang)
+		return;
 
 	cfgstr = g_build_filename (home_dir, ".dmrc", NULL);
-	dmrc = mdm_common_config_load (cfgstr, NULL);
+
+	/* Both settings are written at once and only if they changed.
+	 * mdm_common_config_save writes a temporary file and renames it
+	 * over the old one, so there is never a half written .dmrc */
+	dmrc = dmrc_lookup (cfgstr);
 	if (dmrc == NULL) {
-		gint fd = -1;
 		mdm_debug ("The user dmrc file %s does not exist - creating it", cfgstr);
-		VE_IGNORE_EINTR (fd = g_open (cfgstr,
-			O_CREAT | O_TRUNC | O_RDWR, 0644));
-
-		if (fd < 0)
-			return;
-
-		write (fd, "\n", 2);
-		close (fd);
-		dmrc = mdm_common_config_load (cfgstr, NULL);
+		dmrc = g_key_file_new ();
+		g_hash_table_remove (dmrc_cache, cfgstr);
+	} else {
+		MdmDmrcCacheEntry *entry;
 
-		if (dmrc == NULL) {
-			mdm_debug ("Failed to open dmrc file %s after trying to create it", cfgstr);
-			return;
-		}
+		/* We are about to change it, so take it out of the cache */
+		entry = g_hash_table_lookup (dmrc_cache, cfgstr);
+		entry->dmrc = NULL;
+		g_hash_table_remove (dmrc_cache, cfgstr);
 	}
 
+	changed = FALSE;
+
 	if (savesess) {
-		g_key_file_set_string (dmrc, "Desktop", "Session", ve_sure_string (save_session));
+		old = g_key_file_get_string (dmrc, "Desktop", "Session", NULL);
+		if (old == NULL || strcmp (old, ve_sure_string (save_session)) != 0) {
+			g_key_file_set_string (dmrc, "Desktop", "Session", ve_sure_string (save_session));
+			changed = TRUE;
+		}
+		g_free (old);
 	}
 
 	if (savelang) {
+		old = g_key_file_get_string (dmrc, "Desktop", "Language", NULL);
 		if (ve_string_empty (save_language)) {
 			/*
 			 * We chose the system default language so wipe the
 			 * lang key
 			 */
-			g_key_file_remove_key (dmrc, "Desktop", "Language", NULL);
-		} else {
+			if (old != NULL) {
+				g_key_file_remove_key (dmrc, "Desktop", "Language", NULL);
+				changed = TRUE;
+			}
+		} else if (old == NULL || strcmp (old, save_language) != 0) {
 			g_key_file_set_string (dmrc, "Desktop", "Language", save_language);
+			changed = TRUE;
 		}
+		g_free (old);
 	}
 
-	if (dmrc != NULL) {
+	if (changed) {
 		mode_t oldmode;
 		oldmode = umask (077);
-		mdm_common_config_save (dmrc, cfgstr, NULL);
+		if ( ! mdm_common_config_save (dmrc, cfgstr, NULL))
+			mdm_debug ("Failed to write dmrc file %s", cfgstr);
 		umask (oldmode);
 	}
 
@@ -2516,13 +2696,12 @@ mdm_daemon_config_get_user_session_lang (char      **usrsess,
 	char *lang = NULL;
 
 	cfgfile = g_build_filename (home_dir, ".dmrc", NULL);
-	cfg = mdm_common_config_load (cfgfile, NULL);
+	cfg = dmrc_lookup (cfgfile);
 	g_free (cfgfile);
 
 	if (cfg != NULL) {
 		mdm_common_config_get_string (cfg, "Desktop/Session", &session, NULL);
 		mdm_common_config_get_string (cfg, "Desktop/Language", &lang, NULL);
-		g_key_file_free (cfg);
 	}
 
 	if (session == NULL || strcmp(session, "default") == 0) {
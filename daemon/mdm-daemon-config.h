@@ -39,6 +39,14 @@ GSList *       mdm_daemon_config_get_display_list     (void);
 GSList *       mdm_daemon_config_display_list_append  (MdmDisplay *display);
 GSList *       mdm_daemon_config_display_list_insert  (MdmDisplay *display);
 GSList *       mdm_daemon_config_display_list_remove  (MdmDisplay *display);
+void           mdm_daemon_config_display_number_changed (MdmDisplay *display,
+                                                         int         old_num,
+                                                         int         new_num);
+void           mdm_daemon_config_display_set_slavepid (MdmDisplay *display,
+                                                       pid_t       pid);
+MdmDisplay *   mdm_daemon_config_lookup_display_by_slavepid (pid_t pid);
+MdmDisplay *   mdm_daemon_config_lookup_display_by_number   (int num);
+MdmDisplay *   mdm_daemon_config_lookup_display_by_name     (const char *name);
 uid_t          mdm_daemon_config_get_mdmuid           (void);
 uid_t          mdm_daemon_config_get_mdmgid           (void);
 gint           mdm_daemon_config_get_high_display_num (void);
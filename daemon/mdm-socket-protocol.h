@@ -34,7 +34,7 @@
 
 /* This will change if there are incompatible
  * protocol changes */
-#define MDM_GREETER_PROTOCOL_VERSION "3"
+#define MDM_GREETER_PROTOCOL_VERSION "5"
 
 #define MDM_MSG        'D'
 #define MDM_NOECHO     'U'
@@ -54,9 +54,12 @@
 #define MDM_DISABLE    '-' /* disable the login screen */
 #define MDM_ENABLE     '+' /* enable the login screen */
 #define MDM_RESETOK    'r' /* reset but don't shake */
-#define MDM_NEEDPIC    '#' /* need a user picture?, sent after greeter
-			    *  is started */
-#define MDM_READPIC    '%' /* Send a user picture in a temp file */
+#define MDM_NEEDPIC    '#' /* need user pictures?, sent after greeter
+			    *  is started, answered with logins */
+#define MDM_READPIC    '%' /* Send a batch of user pictures */
+/* The size the greeters show user pictures at, and the size of the
+ * thumbnails in the face cache */
+#define MDM_FACE_THUMB_SIZE 48
 #define MDM_ERRBOX     'e' /* Puts string in the error box */
 #define MDM_ERRDLG     'E' /* Puts string up in an error dialog */
 #define MDM_NOFOCUS    'f' /* Don't focus the login window (optional) */
@@ -74,6 +77,7 @@
 #define MDM_INTERRUPT_THEME       'H'
 #define MDM_INTERRUPT_CANCEL      'X'
 #define MDM_INTERRUPT_SELECT_LANG 'O'
+#define MDM_INTERRUPT_PICTURES    'P' /* send the pictures of more users */
 
 /* List delimiter for config file lists */
 #define MDM_DELIMITER_MODULES ":"
@@ -176,6 +180,7 @@
 #define MDM_SUP_GET_CUSTOM_CONFIG_FILE  "GET_CUSTOM_CONFIG_FILE"
 #define MDM_SUP_UPDATE_CONFIG "UPDATE_CONFIG"
 #define MDM_SUP_GREETERPIDS  "GREETERPIDS"
+#define MDM_SUP_RESTART_STATS "RESTART_STATS"
 #define MDM_SUP_QUERY_LOGOUT_ACTION "QUERY_LOGOUT_ACTION"
 #define MDM_SUP_SET_LOGOUT_ACTION "SET_LOGOUT_ACTION"
 #define MDM_SUP_SET_SAFE_LOGOUT_ACTION "SET_SAFE_LOGOUT_ACTION"
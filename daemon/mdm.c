@@ -66,6 +66,7 @@
 #include "cookie.h"
 #include "filecheck.h"
 #include "errorgui.h"
+#include "sessions.h"
 
 #include "mdm-socket-protocol.h"
 #include "mdm-daemon-config.h"
@@ -78,11 +79,13 @@ static void mdm_daemonify (void);
 static void mdm_safe_restart (void);
 static void mdm_try_logout_action (MdmDisplay *disp);
 static void mdm_restart_now (void);
-static void handle_flexi_server (MdmConnection *conn, int type, const gchar *server, gboolean handled, const gchar *username);
+static void handle_flexi_server (MdmConnection *conn, int type, const gchar *server, gboolean handled, const gchar *username, gboolean warm);
+static void flexi_pool_schedule_refill (guint delay);
 
 /* Global vars */
 
 gint flexi_servers         = 0; /* Number of flexi servers */
+static guint flexi_pool_refill_id = 0; /* Pending warm pool refill */
 pid_t extra_process = 0;        /* An extra process.  Used for quickie
                                    processes, so that they also get whacked */
 static int extra_status    = 0; /* Last status from the last extra process */
@@ -742,20 +745,13 @@ mdm_exec_script (const gchar *dir,
   }
 }
 
-static gboolean
-mdm_cleanup_children (void)
+static void
+mdm_cleanup_child (pid_t pid, gint exitstatus)
 {
-	gint exitstatus = 0, status;
+	gint status;
 	MdmDisplay *d = NULL;
 	gboolean crashed;
 	gboolean sysmenu;
-	pid_t pid;
-
-	/* Pid and exit status of slave that died */
-	pid = waitpid (-1, &exitstatus, WNOHANG);
-
-	if (pid <= 0)
-		return FALSE;
 
 	if G_LIKELY (WIFEXITED (exitstatus)) {
 		status = WEXITSTATUS (exitstatus);
@@ -786,36 +782,23 @@ mdm_cleanup_children (void)
 		/* An extra process died, yay! */
 		extra_process = 0;
 		extra_status  = exitstatus;
-		return TRUE;
+		return;
 	}
 
 	/* Find out who this slave belongs to */
 	d = mdm_display_lookup (pid);
 
 	if (d == NULL)
-		return TRUE;
+		return;
+
+	d->last_exit_status = exitstatus;
 
 	/* Whack connections about this display */
 	if (unixconn != NULL)
 		mdm_kill_subconnections_with_display (unixconn, d);
 
-	if G_UNLIKELY (crashed) {
-		mdm_error ("mdm_cleanup_children: Slave crashed, killing its "
-			   "children");
-
-		if (d->sesspid > 1)
-			kill (-(d->sesspid), SIGTERM);
-		d->sesspid = 0;
-		if (d->greetpid > 1)
-			kill (-(d->greetpid), SIGTERM);
-		d->greetpid = 0;	
-		if (d->servpid > 1)
-			kill (d->servpid, SIGTERM);
-		d->servpid = 0;	
-
-		/* Race avoider */
-		mdm_sleep_no_signal (1);
-	}
+	/* if the slave crashed, its children were already killed off
+	 * by mdm_cleanup_children */
 
 	/* null all these, they are not valid most definately */
 	d->servpid    = 0;
@@ -828,7 +811,7 @@ mdm_cleanup_children (void)
 	d->login = NULL;
 
 	/* Declare the display dead */
-	d->slavepid = 0;
+	mdm_daemon_config_display_set_slavepid (d, 0);
 	d->dispstat = DISPLAY_DEAD;
 
 	/* Run SuperPost script */
@@ -1029,6 +1012,14 @@ mdm_cleanup_children (void)
 				 * start them now */
 				mdm_start_first_unborn_local (3 /* delay */);
 			}
+		} else if (d->type == TYPE_FLEXI && d->warm) {
+			/* Nobody was looking at a pooled display, so don't
+			 * touch the VT, just start another one later on.  The
+			 * delay keeps a broken server from respawning in a
+			 * tight loop */
+			mdm_debug ("mdm_child_action: Pre-started flexible server died");
+			mdm_display_unmanage (d);
+			flexi_pool_schedule_refill (30);
 		} else if (d->type == TYPE_FLEXI) {
 			/* A flexi server is dying, scan for a greeter.
 			 * If there's one, chvt() into it			 
@@ -1065,8 +1056,82 @@ mdm_cleanup_children (void)
 
 	mdm_try_logout_action (d);
 	mdm_safe_restart ();
+}
 
-	return TRUE;
+/* Kill off what a crashed slave left behind */
+static void
+mdm_kill_crashed_slave_children (MdmDisplay *d)
+{
+	mdm_error ("mdm_cleanup_children: Slave crashed, killing its "
+		   "children");
+
+	if (d->sesspid > 1)
+		kill (-(d->sesspid), SIGTERM);
+	d->sesspid = 0;
+	if (d->greetpid > 1)
+		kill (-(d->greetpid), SIGTERM);
+	d->greetpid = 0;	
+	if (d->servpid > 1)
+		kill (d->servpid, SIGTERM);
+	d->servpid = 0;
+}
+
+typedef struct {
+	pid_t pid;
+	gint exitstatus;
+} MdmChildExit;
+
+/*
+ * Reap everything that exited since the last SIGCHLD in one go, so that
+ * a whole lot of slaves dying together (everyone logging out at once)
+ * is handled as one batch: one race avoiding sleep for all crashed
+ * slaves, and the displays that get restarted are staggered rather
+ * than all starting their X servers at the same time.
+ */
+static void
+mdm_cleanup_children (void)
+{
+	GArray *exits;
+	MdmChildExit ex;
+	gboolean any_crashed = FALSE;
+	guint i;
+
+	exits = g_array_new (FALSE, FALSE, sizeof (MdmChildExit));
+
+	/* Pid and exit status of slaves that died */
+	while ((ex.pid = waitpid (-1, &ex.exitstatus, WNOHANG)) > 0)
+		g_array_append_val (exits, ex);
+
+	if (exits->len > 1)
+		mdm_debug ("mdm_cleanup_children: %u children exited together",
+			   exits->len);
+
+	for (i = 0; i < exits->len; i++) {
+		MdmDisplay *d;
+
+		ex = g_array_index (exits, MdmChildExit, i);
+		if (WIFEXITED (ex.exitstatus) || ex.pid == extra_process)
+			continue;
+
+		d = mdm_display_lookup (ex.pid);
+		if (d != NULL) {
+			mdm_kill_crashed_slave_children (d);
+			any_crashed = TRUE;
+		}
+	}
+
+	/* Race avoider */
+	if G_UNLIKELY (any_crashed)
+		mdm_sleep_no_signal (1);
+
+	mdm_display_restart_batch_begin ();
+	for (i = 0; i < exits->len; i++) {
+		ex = g_array_index (exits, MdmChildExit, i);
+		mdm_cleanup_child (ex.pid, ex.exitstatus);
+	}
+	mdm_display_restart_batch_end ();
+
+	g_array_free (exits, TRUE);
 }
 
 static void
@@ -1172,8 +1237,7 @@ mainloop_sig_callback (int sig, gpointer data)
 		{
 		case SIGCHLD:
 			mdm_debug ("mainloop_sig_callback: Got SIGCHLD!");
-			while (mdm_cleanup_children ())
-				;
+			mdm_cleanup_children ();
 			break;
 
 		case SIGINT:
@@ -1636,6 +1700,9 @@ main (int argc, char *argv[])
 	/* Make us a unique global cookie to authenticate */
 	mdm_make_global_cookie ();
 
+	/* Read the sessions once for the greeters and slaves */
+	mdm_sessions_init ();
+
 	/* Start static X servers */
 	mdm_start_first_unborn_local (0 /* delay */);	
 
@@ -1912,6 +1979,13 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 		if (d != NULL) {
 			d->greetpid = pid;
 			mdm_debug ("Got GREETPID == %ld", (long)pid);
+
+			if (pid > 0 && d->flexi_request_time > 0) {
+				mdm_info ("Login screen on flexible display %s ready after %ld ms",
+					  d->name,
+					  (long) ((g_get_monotonic_time () - d->flexi_request_time) / 1000));
+				d->flexi_request_time = 0;
+			}
 			/* send ack */
 			send_slave_ack (d, NULL);
 		}
@@ -1932,6 +2006,15 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 			mdm_debug ("Got logged in == %s",
 				   d->logged_in ? "TRUE" : "FALSE");
 
+			/* Someone found their way onto a pooled display
+			 * without asking for it, it's not spare anymore.
+			 * A login anywhere is also what first fills the
+			 * pool, since before that nobody can switch user */
+			if (d->logged_in) {
+				d->warm = FALSE;
+				flexi_pool_schedule_refill (0);
+			}
+
 			/* whack connections about this display if a user
 			 * just logged out since we don't want such
 			 * connections persisting to be authenticated */
@@ -1962,6 +2045,7 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 		d = mdm_display_lookup (slave_pid);
 
 		if (d != NULL) {
+			mdm_daemon_config_display_number_changed (d, d->dispnum, disp_num);
 			g_free (d->name);
 			d->name = g_strdup_printf (":%d", disp_num);
 			d->dispnum = disp_num;
@@ -2075,12 +2159,9 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 	} else if (strncmp (msg, MDM_SOP_MIGRATE " ",
 		            strlen (MDM_SOP_MIGRATE " ")) == 0) {
 		MdmDisplay *d;
+		MdmDisplay *di;
 		long slave_pid;
 		char *p;
-		GSList *li;
-		GSList *displays;
-
-		displays = mdm_daemon_config_get_display_list ();
 
 		if (sscanf (msg, MDM_SOP_MIGRATE " %ld", &slave_pid) != 1)
 			return;
@@ -2098,12 +2179,10 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 			return;
 
 		mdm_debug ("Got MIGRATE %s", p);
-		for (li = displays; li != NULL; li = li->next) {
-			MdmDisplay *di = li->data;
-			if (di->logged_in && strcmp (di->name, p) == 0) {
-				if (d->attached && di->vt > 0)
-					mdm_change_vt (di->vt);				
-			}
+		di = mdm_daemon_config_lookup_display_by_name (p);
+		if (di != NULL && di->logged_in) {
+			if (d->attached && di->vt > 0)
+				mdm_change_vt (di->vt);
 		}
 		send_slave_ack (d, NULL);
 	} else if (strncmp (msg, MDM_SOP_COOKIE " ",
@@ -2223,6 +2302,17 @@ mdm_handle_message (MdmConnection *conn, const char *msg, gpointer data)
 			mdm_debug ("Got FLEXI_OK");
 			/* send ack */
 			send_slave_ack (d, NULL);
+
+			if (d->warm) {
+				/* The X server grabbed the console when it
+				 * started, give it back */
+				if (d->warm_return_vt > 0 &&
+				    mdm_get_current_vt () != d->warm_return_vt)
+					mdm_change_vt (d->warm_return_vt);
+				d->warm_ready = TRUE;
+				mdm_debug ("Pre-started flexible display %s is up", d->name);
+				flexi_pool_schedule_refill (0);
+			}
 		}
 	} else if (strcmp (msg, MDM_SOP_START_NEXT_LOCAL) == 0) {
 		mdm_start_first_unborn_local (3 /* delay */);
@@ -2522,15 +2612,143 @@ close_conn (gpointer data)
 	}
 }
 
+static MdmDisplay *
+flexi_pool_take (void)
+{
+	GSList *li;
+	MdmDisplay *found = NULL;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *disp = li->data;
+
+		if ( ! disp->warm || ! disp->warm_ready || disp->vt <= 0)
+			continue;
+
+		/* Prefer one whose login screen is already up */
+		if (disp->greetpid > 0)
+			return disp;
+		if (found == NULL)
+			found = disp;
+	}
+
+	return found;
+}
+
+/*
+ * Whether the console shows one of our login screens.  A pre-started X
+ * server grabs the console until it's up, which is only fine if nobody
+ * is using it.
+ */
+static gboolean
+console_shows_greeter (void)
+{
+	GSList *li;
+	int vt;
+
+	vt = mdm_get_current_vt ();
+	if (vt <= 0)
+		return TRUE;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *disp = li->data;
+
+		if (disp->vt == vt || disp->vtnum == vt)
+			return ! disp->logged_in;
+	}
+
+	/* a text console, or somebody else's display */
+	return FALSE;
+}
+
+static gboolean
+flexi_pool_refill (gpointer data)
+{
+	GSList *li;
+	int size;
+	int warm = 0;
+
+	flexi_pool_refill_id = 0;
+
+	size = mdm_daemon_config_get_value_int (MDM_KEY_FLEXI_WARM_POOL_SIZE);
+	if (size <= 0 || mdm_wait_for_go)
+		return FALSE;
+
+	for (li = mdm_daemon_config_get_display_list (); li != NULL; li = li->next) {
+		MdmDisplay *disp = li->data;
+
+		if (disp->warm) {
+			/* Start one at a time, the next one gets
+			 * started when this one is up */
+			if ( ! disp->warm_ready)
+				return FALSE;
+			warm++;
+		}
+	}
+
+	if (warm >= size)
+		return FALSE;
+
+	if (flexi_servers >= mdm_daemon_config_get_value_int (MDM_KEY_FLEXIBLE_XSERVERS)) {
+		mdm_debug ("flexi_pool_refill: No more flexi servers allowed, not pre-starting one");
+		return FALSE;
+	}
+
+	if ( ! console_shows_greeter ()) {
+		mdm_debug ("flexi_pool_refill: The console is in use, trying again later");
+		flexi_pool_schedule_refill (30);
+		return FALSE;
+	}
+
+	mdm_debug ("flexi_pool_refill: Pre-starting flexible display (%d of %d)",
+		   warm + 1, size);
+	handle_flexi_server (NULL, TYPE_FLEXI,
+			     mdm_daemon_config_get_value_string (MDM_KEY_STANDARD_XSERVER),
+			     TRUE, NULL, TRUE);
+
+	return FALSE;
+}
+
 static void
-handle_flexi_server (MdmConnection *conn, int type, const char *server, gboolean handled, const char *username)
+flexi_pool_schedule_refill (guint delay)
+{
+	if (flexi_pool_refill_id != 0 ||
+	    mdm_daemon_config_get_value_int (MDM_KEY_FLEXI_WARM_POOL_SIZE) <= 0)
+		return;
+
+	if (delay == 0)
+		flexi_pool_refill_id = g_idle_add (flexi_pool_refill, NULL);
+	else
+		flexi_pool_refill_id = g_timeout_add_seconds (delay, flexi_pool_refill, NULL);
+}
+
+static void
+handle_flexi_server (MdmConnection *conn, int type, const char *server, gboolean handled, const char *username, gboolean warm)
 {
 	MdmDisplay *display;
 	gchar *bin;
 	uid_t server_uid = 0;
+	gint64 request_time;
 
 	mdm_debug ("flexi server: '%s'", server);
 
+	request_time = g_get_monotonic_time ();
+
+	/* Hand out a pre-started display if we have one */
+	if ( ! warm && type == TYPE_FLEXI && handled && username == NULL &&
+	    (display = flexi_pool_take ()) != NULL) {
+		display->warm = FALSE;
+		mdm_change_vt (display->vt);
+		send_slave_command (display, MDM_NOTIFY_FLEXI_TAKEN);
+		send_slave_command (display, MDM_NOTIFY_TWIDDLE_POINTER);
+		if (conn != NULL)
+			mdm_connection_printf (conn, "OK %s\n", display->name);
+		mdm_info ("Switched to pre-started flexible display %s in %ld ms",
+			  display->name,
+			  (long) ((g_get_monotonic_time () - request_time) / 1000));
+		flexi_pool_schedule_refill (0);
+		return;
+	}
+
 	if (mdm_wait_for_go) {
 		if (conn != NULL)
 			mdm_connection_write (conn,
@@ -2574,6 +2792,13 @@ handle_flexi_server (MdmConnection *conn, int type, const char *server, gboolean
 	display->preset_user = g_strdup (username);
 	display->type = type;
 	display->socket_conn = conn;
+
+	if (warm) {
+		display->warm = TRUE;
+		display->warm_return_vt = mdm_get_current_vt ();
+	} else if (conn != NULL) {
+		display->flexi_request_time = request_time;
+	}
 		
 	if (conn != NULL)
 		mdm_connection_set_close_notify (conn, display, close_conn);
@@ -2670,7 +2895,7 @@ sup_handle_attached_servers (MdmConnection *conn,
 	for (li = displays; li != NULL; li = li->next) {
 		MdmDisplay *disp = li->data;
 
-		if ( ! disp->attached)
+		if ( ! disp->attached || disp->warm)
 			continue;
 		if (!(strlen (key)) || (g_pattern_match_simple (key, disp->command))) {
 			g_string_append_printf (retMsg, "%s%s,%s,", sep,
@@ -2880,6 +3105,57 @@ sup_handle_greeterpids (MdmConnection *conn,
 	g_string_free (reply, TRUE);
 }
 
+static void
+sup_handle_restart_stats (MdmConnection *conn,
+			  const char    *msg,
+			  gpointer       data)
+{
+	GString *reply;
+	GSList *li;
+	const gchar *sep = " ";
+	GSList *displays;
+
+	displays = mdm_daemon_config_get_display_list ();
+
+	reply = g_string_new ("OK");
+	for (li = displays; li != NULL; li = li->next) {
+		MdmDisplay *disp = li->data;
+		guint first;
+		guint i;
+
+		g_string_append_printf (reply, "%s%s,%u,%d,%d,", sep,
+					ve_sure_string (disp->name),
+					disp->start_count,
+					disp->restart_streak,
+					disp->last_start_delay);
+		sep = ";";
+
+		if (disp->last_exit_status == -1)
+			g_string_append (reply, "none");
+		else if (WIFEXITED (disp->last_exit_status))
+			g_string_append_printf (reply, "exit=%d",
+						WEXITSTATUS (disp->last_exit_status));
+		else if (WIFSIGNALED (disp->last_exit_status))
+			g_string_append_printf (reply, "signal=%d",
+						WTERMSIG (disp->last_exit_status));
+		else
+			g_string_append (reply, "unknown");
+
+		/* oldest start first */
+		g_string_append_c (reply, ',');
+		first = disp->start_count > MDM_DISPLAY_START_HISTORY ?
+			disp->start_count - MDM_DISPLAY_START_HISTORY : 0;
+		for (i = first; i < disp->start_count; i++) {
+			g_string_append_printf (reply, "%s%ld",
+						i == first ? "" : " ",
+						(long)disp->start_history[i % MDM_DISPLAY_START_HISTORY]);
+		}
+	}
+	g_string_append (reply, "\n");
+	mdm_connection_write (conn, reply->str);
+	g_string_free (reply, TRUE);
+}
+
 static void
 sup_handle_set_logout_action (MdmConnection *conn,
 			      const char    *msg,
@@ -3076,7 +3352,7 @@ mdm_handle_user_message (MdmConnection *conn,
 			return;
 		}
 
-		handle_flexi_server (conn, TYPE_FLEXI, mdm_daemon_config_get_value_string (MDM_KEY_STANDARD_XSERVER), TRUE, NULL);
+		handle_flexi_server (conn, TYPE_FLEXI, mdm_daemon_config_get_value_string (MDM_KEY_STANDARD_XSERVER), TRUE, NULL, FALSE);
 
 	} else if ((strncmp (msg, MDM_SUP_ATTACHED_SERVERS,
 	                     strlen (MDM_SUP_ATTACHED_SERVERS)) == 0)) {
@@ -3087,6 +3363,10 @@ mdm_handle_user_message (MdmConnection *conn,
 
 		sup_handle_greeterpids (conn, msg, data);
 
+	} else if (strcmp (msg, MDM_SUP_RESTART_STATS) == 0) {
+
+		sup_handle_restart_stats (conn, msg, data);
+
 	} else if (strncmp (msg, MDM_SUP_UPDATE_CONFIG " ",
 			    strlen (MDM_SUP_UPDATE_CONFIG " ")) == 0) {
 		const char *key;
@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -195,137 +196,232 @@ mdm_restoreenv (void)
 	}
 }
 
-/* Evil function to figure out which display number is free */
-int
-mdm_get_free_display (int start, uid_t server_uid)
+/*
+ * Display numbers owned by this daemon.  Kept up to date as displays
+ * enter and leave the display list, so that finding a free number does
+ * not need to look at the list (or the network) for every candidate.
+ * Slaves inherit a snapshot of this when they are forked.
+ */
+static guint32 display_number_map[(MDM_MAX_DISPLAY_NUM + 31) / 32];
+
+void
+mdm_display_number_reserve (int num)
+{
+	if (num < 0 || num >= MDM_MAX_DISPLAY_NUM)
+		return;
+
+	display_number_map[num / 32] |= (1U << (num % 32));
+}
+
+void
+mdm_display_number_release (int num)
+{
+	if (num < 0 || num >= MDM_MAX_DISPLAY_NUM)
+		return;
+
+	display_number_map[num / 32] &= ~(1U << (num % 32));
+}
+
+gboolean
+mdm_display_number_is_reserved (int num)
+{
+	if (num < 0 || num >= MDM_MAX_DISPLAY_NUM)
+		return FALSE;
+
+	return (display_number_map[num / 32] & (1U << (num % 32))) != 0;
+}
+
+/*
+ * The old way of finding out if a display number is taken: see if
+ * anything answers on the X TCP port.  Only used when the lock file and
+ * the unix socket can't give us a straight answer.
+ */
+static gboolean
+display_tcp_port_in_use (int num)
 {
 	int sock;
-	int i;
 	struct sockaddr_in serv_addr = { 0 };
+	gboolean try_ipv4 = TRUE;
 
 	serv_addr.sin_family = AF_INET;
 	serv_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
 
-	/*
-         * Cap this at 3000, I'm not sure we can ever seriously
-	 * go that far
-         */
-	for (i = start; i < 3000; i++) {
-		FILE *fp;
-		GSList *li;
-		GSList *displays;
-		struct stat s;
-		char buf[256];
-		int r;
-		gboolean try_ipv4 = TRUE;
-
-                displays = mdm_daemon_config_get_display_list ();
-
-		for (li = displays; li != NULL; li = li->next) {
-			MdmDisplay *dsp = li->data;
-			if (SERVER_IS_LOCAL (dsp) &&
-			    dsp->dispnum == i)
-				break;
-		}
-		if (li != NULL) {
-			/* found one */
-			continue;
-		}
+	sock = -1;
+	errno = 0;
 
 #ifdef ENABLE_IPV6
-		if (have_ipv6 ()) {
-			struct sockaddr_in6 serv6_addr = { 0 };
+	if (have_ipv6 ()) {
+		struct sockaddr_in6 serv6_addr = { 0 };
 
-			sock = socket (AF_INET6, SOCK_STREAM,0);
+		sock = socket (AF_INET6, SOCK_STREAM, 0);
 
-			serv6_addr.sin6_family = AF_INET6;
-			serv6_addr.sin6_addr = in6addr_loopback;
-			serv6_addr.sin6_port = htons (6000 + i);
-			errno = 0;
-			VE_IGNORE_EINTR (connect (sock,
-                                      (struct sockaddr *)&serv6_addr,
-                                      sizeof (serv6_addr)));
+		serv6_addr.sin6_family = AF_INET6;
+		serv6_addr.sin6_addr = in6addr_loopback;
+		serv6_addr.sin6_port = htons (6000 + num);
+		errno = 0;
+		VE_IGNORE_EINTR (connect (sock,
+					  (struct sockaddr *)&serv6_addr,
+					  sizeof (serv6_addr)));
 
-			/*
-			 * If IPv6 returns the network is unreachable,
-			 * then try fallbacking to IPv4.  In all other
-			 * cases, do not fallback.  This problem can
-			 * happen if IPv6 is enabled, but the
-			 * administrator has disabled it.
-			 */
-			if (errno != ENETUNREACH)
-				try_ipv4 = FALSE;
-		}
+		/*
+		 * If IPv6 returns the network is unreachable,
+		 * then try fallbacking to IPv4.  In all other
+		 * cases, do not fallback.  This problem can
+		 * happen if IPv6 is enabled, but the
+		 * administrator has disabled it.
+		 */
+		if (errno != ENETUNREACH)
+			try_ipv4 = FALSE;
+		else
+			VE_IGNORE_EINTR (close (sock));
+	}
 #endif
 
-		if (try_ipv4)
-		{
-			sock = socket (AF_INET, SOCK_STREAM, 0);
+	if (try_ipv4) {
+		sock = socket (AF_INET, SOCK_STREAM, 0);
 
-			serv_addr.sin_port = htons (6000 + i);
+		serv_addr.sin_port = htons (6000 + num);
 
-			errno = 0;
-			VE_IGNORE_EINTR (connect (sock,
-				       (struct sockaddr *)&serv_addr,
-				       sizeof (serv_addr)));
-		}
-		if (errno != 0 && errno != ECONNREFUSED) {
-			VE_IGNORE_EINTR (close (sock));
-			continue;
-		}
+		errno = 0;
+		VE_IGNORE_EINTR (connect (sock,
+					  (struct sockaddr *)&serv_addr,
+					  sizeof (serv_addr)));
+	}
+
+	if (errno != 0 && errno != ECONNREFUSED) {
 		VE_IGNORE_EINTR (close (sock));
+		return TRUE;
+	}
+	VE_IGNORE_EINTR (close (sock));
 
-		/* if lock file exists and the process exists */
-		g_snprintf (buf, sizeof (buf), "/tmp/.X%d-lock", i);
-		VE_IGNORE_EINTR (r = g_stat (buf, &s));
-		if (r == 0 &&
-		    ! S_ISREG (s.st_mode)) {
-			/*
-                         * Eeeek! not a regular file?  Perhaps someone
-			 * is trying to play tricks on us
-                         */
-			continue;
-		}
-		VE_IGNORE_EINTR (fp = fopen (buf, "r"));
-		if (fp != NULL) {
-			char buf2[100];
-			char *getsret;
-			VE_IGNORE_EINTR (getsret = fgets (buf2, sizeof (buf2), fp));
-			if (getsret != NULL) {
-				gulong pid;
-				if (sscanf (buf2, "%lu", &pid) == 1 &&
-				    kill (pid, 0) == 0) {
-					VE_IGNORE_EINTR (fclose (fp));
-					continue;
-				}
+	return FALSE;
+}
 
-			}
-			VE_IGNORE_EINTR (fclose (fp));
+/*
+ * Check the X lock file for a display number.  Nobody holding the lock
+ * is proven by being able to create it ourselves with O_EXCL, in which
+ * case we drop it again right away so the X server can take it.
+ */
+static gboolean
+display_lock_is_free (int num)
+{
+	char buf[256];
+	char pidbuf[32];
+	struct stat s;
+	int fd;
+	int r;
 
-			/* whack the file, it's a stale lock file */
-			VE_IGNORE_EINTR (g_unlink (buf));
-		}
+	g_snprintf (buf, sizeof (buf), "/tmp/.X%d-lock", num);
 
-		/* If starting as root, we'll be able to overwrite any
-		 * stale sockets or lock files, but a user may not be
-		 * able to */
-		if (server_uid > 0) {
-			g_snprintf (buf, sizeof (buf),
-				    "/tmp/.X11-unix/X%d", i);
-			VE_IGNORE_EINTR (r = g_stat (buf, &s));
-			if (r == 0 &&
-			    s.st_uid != server_uid) {
-				continue;
-			}
+	/* O_EXCL also refuses to follow a planted symlink */
+	VE_IGNORE_EINTR (fd = open (buf, O_WRONLY|O_CREAT|O_EXCL, 0644));
+	if (fd >= 0) {
+		VE_IGNORE_EINTR (close (fd));
+		VE_IGNORE_EINTR (g_unlink (buf));
+		return TRUE;
+	}
 
-			g_snprintf (buf, sizeof (buf),
-				    "/tmp/.X%d-lock", i);
-			VE_IGNORE_EINTR (r = g_stat (buf, &s));
-			if (r == 0 &&
-			    s.st_uid != server_uid) {
-				continue;
-			}
-		}
+	if (errno != EEXIST)
+		return FALSE;
+
+	VE_IGNORE_EINTR (fd = open (buf, O_RDONLY
+#ifdef O_NOFOLLOW
+				    |O_NOFOLLOW
+#endif
+				    ));
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat (fd, &s) != 0 ||
+	    ! S_ISREG (s.st_mode)) {
+		/*
+		 * Eeeek! not a regular file?  Perhaps someone
+		 * is trying to play tricks on us
+		 */
+		VE_IGNORE_EINTR (close (fd));
+		return FALSE;
+	}
+
+	VE_IGNORE_EINTR (r = read (fd, pidbuf, sizeof (pidbuf) - 1));
+	VE_IGNORE_EINTR (close (fd));
+
+	if (r > 0) {
+		gulong pid;
+
+		pidbuf[r] = '\0';
+		if (sscanf (pidbuf, "%lu", &pid) == 1 &&
+		    kill (pid, 0) == 0)
+			return FALSE;
+	}
+
+	/* whack the file, it's a stale lock file */
+	VE_IGNORE_EINTR (g_unlink (buf));
+
+	return TRUE;
+}
+
+/*
+ * Check the unix socket for a display number.  A missing socket is the
+ * common case and costs one lstat.  A leftover socket is probed locally,
+ * and only if that is inconclusive do we fall back to probing TCP.
+ */
+static gboolean
+display_socket_is_free (int num, uid_t server_uid)
+{
+	struct sockaddr_un addr = { 0 };
+	struct stat s;
+	int sock;
+	int r;
+
+	addr.sun_family = AF_UNIX;
+	g_snprintf (addr.sun_path, sizeof (addr.sun_path),
+		    "/tmp/.X11-unix/X%d", num);
+
+	VE_IGNORE_EINTR (r = g_lstat (addr.sun_path, &s));
+	if (r != 0)
+		return TRUE;
+
+	/* If starting as root, we'll be able to overwrite any
+	 * stale sockets, but a user may not be able to */
+	if (server_uid > 0 &&
+	    s.st_uid != server_uid)
+		return FALSE;
+
+	if ( ! S_ISSOCK (s.st_mode))
+		return FALSE;
+
+	sock = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return ! display_tcp_port_in_use (num);
+
+	errno = 0;
+	VE_IGNORE_EINTR (r = connect (sock, (struct sockaddr *)&addr,
+				      sizeof (addr)));
+	VE_IGNORE_EINTR (close (sock));
+
+	if (r == 0)
+		return FALSE;
+	if (errno == ECONNREFUSED || errno == ENOENT)
+		return TRUE;
+
+	return ! display_tcp_port_in_use (num);
+}
+
+/* Figure out which display number is free */
+int
+mdm_get_free_display (int start, uid_t server_uid)
+{
+	int i;
+
+	for (i = MAX (start, 0); i < MDM_MAX_DISPLAY_NUM; i++) {
+		if (mdm_display_number_is_reserved (i))
+			continue;
+
+		if ( ! display_lock_is_free (i))
+			continue;
+
+		if ( ! display_socket_is_free (i, server_uid))
+			continue;
 
 		return i;
 	}
@@ -35,8 +35,19 @@ char *mdm_fdgets   (int fd);
  * note that this leak memory so only use before exec */
 void mdm_clearenv_no_lang (void);
 
+/*
+ * Cap on display numbers, I'm not sure we can ever seriously
+ * go that far
+ */
+#define MDM_MAX_DISPLAY_NUM 3000
+
 int mdm_get_free_display (int start, uid_t server_uid);
 
+/* display numbers owned by the daemon, skipped by mdm_get_free_display */
+void     mdm_display_number_reserve     (int num);
+void     mdm_display_number_release     (int num);
+gboolean mdm_display_number_is_reserved (int num);
+
 gboolean mdm_text_message_dialog (const char *msg);
 gboolean mdm_text_yesno_dialog (const char *msg, gboolean *ret);
 int	mdm_exec_wait (char * const *argv, gboolean no_display,
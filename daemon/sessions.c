@@ -0,0 +1,495 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "mdm.h"
+#include "mdm-common.h"
+#include "mdm-daemon-config.h"
+#include "mdm-log.h"
+
+#include "sessions.h"
+
+/* Give a package install time to finish before scanning again */
+#define MDM_SESSIONS_RESCAN_DELAY 500
+
+static GKeyFile *catalogue       = NULL;
+static dev_t     catalogue_dev   = 0;
+static ino_t     catalogue_ino   = 0;
+static time_t    catalogue_mtime = 0;
+
+/* Only the main daemon watches the directories and writes the
+ * snapshot, slaves just use the catalogue */
+static gboolean  monitoring      = FALSE;
+
+#ifdef HAVE_SYS_INOTIFY_H
+static int         inotify_fd       = -1;
+static guint       inotify_id       = 0;
+static guint       rescan_id        = 0;
+/* Watch descriptor to TRUE for the session directories, where any
+ * change counts, and FALSE for the directories we only watch for the
+ * missing TryExec programs */
+static GHashTable *watches          = NULL;
+/* The names of the TryExec programs that could not be found, to the
+ * directory they are expected in or NULL for the PATH */
+static GHashTable *missing_programs = NULL;
+#endif
+
+static char *
+catalogue_file (void)
+{
+	return g_build_filename (mdm_daemon_config_get_value_string (MDM_KEY_SERV_AUTHDIR),
+				 MDM_SESSION_CATALOGUE, NULL);
+}
+
+/* The slave starts sessions with DefaultPath as their PATH (see
+ * session_child_run), so resolve TryExec against the same thing */
+static char *
+session_search_path (void)
+{
+	return g_strdup (ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_PATH)));
+}
+
+static gboolean
+catalogue_matches (GKeyFile *cfg)
+{
+	char    *dirs;
+	char    *path;
+	gboolean ret;
+
+	dirs = NULL;
+	path = NULL;
+	mdm_common_config_get_string (cfg, MDM_SESSIONS_GROUP "/SessionDesktopDir", &dirs, NULL);
+	mdm_common_config_get_string (cfg, MDM_SESSIONS_GROUP "/SearchPath", &path, NULL);
+	ret = (strcmp (ve_sure_string (dirs),
+		       ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_SESSION_DESKTOP_DIR))) == 0 &&
+	       strcmp (ve_sure_string (path),
+		       ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_PATH))) == 0);
+	g_free (dirs);
+	g_free (path);
+
+	return ret;
+}
+
+static void
+catalogue_remember (const char *file)
+{
+	struct stat s;
+
+	if (stat (file, &s) == 0) {
+		catalogue_dev = s.st_dev;
+		catalogue_ino = s.st_ino;
+		catalogue_mtime = s.st_mtime;
+	} else {
+		catalogue_dev = 0;
+		catalogue_ino = 0;
+		catalogue_mtime = 0;
+	}
+}
+
+/*
+ * Load the daemon's snapshot, if it is one.  ServAuthDir is writable by
+ * the mdm group, so only a regular file owned by root and writable by
+ * nobody else is taken: the slave runs its Exec lines as root.  The
+ * checks and the read are on the same descriptor.
+ */
+static GKeyFile *
+catalogue_load (const char *file, struct stat *s)
+{
+	GKeyFile *cfg;
+	GString  *contents;
+	char      buf[4096];
+	ssize_t   len;
+	int       flags;
+	int       fd;
+
+	flags = O_RDONLY;
+#ifdef O_NOFOLLOW
+	flags |= O_NOFOLLOW;
+#endif
+#ifdef O_NOCTTY
+	flags |= O_NOCTTY;
+#endif
+
+	VE_IGNORE_EINTR (fd = open (file, flags));
+	if (fd < 0)
+		return NULL;
+
+	if (fstat (fd, s) != 0 ||
+	    ! S_ISREG (s->st_mode) ||
+	    s->st_uid != 0 ||
+	    (s->st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+		mdm_debug ("mdm_sessions: Not using %s, it was not written by the daemon", file);
+		VE_IGNORE_EINTR (close (fd));
+		return NULL;
+	}
+
+	contents = g_string_sized_new (s->st_size);
+	do {
+		VE_IGNORE_EINTR (len = read (fd, buf, sizeof (buf)));
+		if (len > 0)
+			g_string_append_len (contents, buf, len);
+	} while (len > 0);
+	VE_IGNORE_EINTR (close (fd));
+
+	cfg = g_key_file_new ();
+	if (len < 0 ||
+	    ! g_key_file_load_from_data (cfg, contents->str, contents->len,
+					 G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
+					 NULL)) {
+		g_key_file_free (cfg);
+		cfg = NULL;
+	}
+	g_string_free (contents, TRUE);
+
+	return cfg;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+static gboolean
+rescan_timeout (gpointer data)
+{
+	rescan_id = 0;
+	mdm_sessions_rescan ();
+
+	return FALSE;
+}
+
+static gboolean
+inotify_data (GIOChannel   *source,
+	      GIOCondition  cond,
+	      gpointer      data)
+{
+	char     buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	ssize_t  len;
+	gboolean rescan = FALSE;
+
+	if (cond & (G_IO_ERR | G_IO_HUP)) {
+		mdm_debug ("mdm_sessions: Lost the session directory watch");
+		VE_IGNORE_EINTR (close (inotify_fd));
+		inotify_fd = -1;
+		inotify_id = 0;
+		g_hash_table_remove_all (watches);
+		return FALSE;
+	}
+
+	do {
+		char *p;
+
+		VE_IGNORE_EINTR (len = read (inotify_fd, buf, sizeof (buf)));
+
+		for (p = buf; len > 0 && p < buf + len; ) {
+			struct inotify_event *ev = (struct inotify_event *) p;
+			gpointer session_dir;
+
+			p += sizeof (struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				rescan = TRUE;
+			} else if (g_hash_table_lookup_extended (watches, GINT_TO_POINTER (ev->wd),
+								 NULL, &session_dir)) {
+				/* in the PATH only the programs we are
+				 * waiting for matter */
+				if (GPOINTER_TO_INT (session_dir) ||
+				    (ev->len > 0 &&
+				     g_hash_table_lookup_extended (missing_programs, ev->name,
+								   NULL, NULL)))
+					rescan = TRUE;
+			}
+		}
+	} while (len > 0);
+
+	if (rescan && rescan_id == 0)
+		rescan_id = g_timeout_add (MDM_SESSIONS_RESCAN_DELAY, rescan_timeout, NULL);
+
+	return TRUE;
+}
+
+static void
+sessions_unwatch (void)
+{
+	if (rescan_id != 0) {
+		g_source_remove (rescan_id);
+		rescan_id = 0;
+	}
+	if (inotify_id != 0) {
+		g_source_remove (inotify_id);
+		inotify_id = 0;
+	}
+	if (inotify_fd >= 0) {
+		VE_IGNORE_EINTR (close (inotify_fd));
+		inotify_fd = -1;
+	}
+	if (watches != NULL)
+		g_hash_table_remove_all (watches);
+}
+
+static gboolean
+remove_watch (gpointer key, gpointer value, gpointer data)
+{
+	inotify_rm_watch (inotify_fd, GPOINTER_TO_INT (key));
+	return TRUE;
+}
+
+static void
+add_watch (const char *dir, guint32 mask, gboolean session_dir)
+{
+	int wd;
+
+	if (dir[0] == '\0')
+		return;
+
+	wd = inotify_add_watch (inotify_fd, dir, IN_ONLYDIR | IN_MASK_ADD | mask);
+	if (wd < 0)
+		return;
+
+	/* a session directory that is in the PATH too gets every change */
+	if (session_dir || g_hash_table_lookup (watches, GINT_TO_POINTER (wd)) == NULL)
+		g_hash_table_insert (watches, GINT_TO_POINTER (wd),
+				     GINT_TO_POINTER (session_dir));
+}
+
+/* Note the TryExec programs of the sessions that are not available */
+static void
+find_missing_programs (void)
+{
+	char **groups;
+	int    i;
+
+	g_hash_table_remove_all (missing_programs);
+
+	groups = g_key_file_get_groups (catalogue, NULL);
+	for (i = 0; groups != NULL && groups[i] != NULL; i++) {
+		char **argv;
+		char  *tryexec;
+
+		if (strcmp (groups[i], MDM_SESSIONS_GROUP) == 0 ||
+		    g_key_file_get_boolean (catalogue, groups[i], "X-Mdm-Available", NULL))
+			continue;
+
+		tryexec = g_key_file_get_string (catalogue, groups[i], "TryExec", NULL);
+		argv = g_strsplit (ve_sure_string (tryexec), " ", 2);
+		if (argv[0] != NULL && argv[0][0] != '\0')
+			g_hash_table_insert (missing_programs,
+					     g_path_get_basename (argv[0]),
+					     strchr (argv[0], '/') != NULL ?
+					     g_path_get_dirname (argv[0]) : NULL);
+		g_strfreev (argv);
+		g_free (tryexec);
+	}
+	g_strfreev (groups);
+}
+
+static void
+sessions_watch (const char *search_path)
+{
+	GHashTableIter iter;
+	gpointer       dir;
+	gboolean       in_path = FALSE;
+	char         **vec;
+	int            i;
+
+	if (watches == NULL) {
+		watches = g_hash_table_new (NULL, NULL);
+		missing_programs = g_hash_table_new_full (g_str_hash, g_str_equal,
+							  g_free, g_free);
+	}
+
+	if (inotify_fd < 0) {
+		GIOChannel *channel;
+
+		VE_IGNORE_EINTR (inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC));
+		if (inotify_fd < 0) {
+			mdm_debug ("mdm_sessions: Cannot watch the session directories: %s",
+				   strerror (errno));
+			return;
+		}
+
+		channel = g_io_channel_unix_new (inotify_fd);
+		inotify_id = g_io_add_watch (channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+					     inotify_data, NULL);
+		g_io_channel_unref (channel);
+	}
+
+	g_hash_table_foreach_remove (watches, remove_watch, NULL);
+
+	vec = g_strsplit (ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_SESSION_DESKTOP_DIR)), ":", -1);
+	for (i = 0; vec[i] != NULL; i++)
+		add_watch (vec[i],
+			   IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+			   IN_CLOSE_WRITE | IN_ATTRIB,
+			   TRUE);
+	g_strfreev (vec);
+
+	/* A session becomes available once its TryExec is installed, so
+	 * watch where the missing ones would turn up.  With nothing
+	 * missing, installing packages doesn't wake us up at all. */
+	find_missing_programs ();
+
+	g_hash_table_iter_init (&iter, missing_programs);
+	while (g_hash_table_iter_next (&iter, NULL, &dir)) {
+		if (dir == NULL)
+			in_path = TRUE;
+		else
+			add_watch (dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB, FALSE);
+	}
+
+	if (in_path) {
+		vec = g_strsplit (ve_sure_string (search_path), ":", -1);
+		for (i = 0; vec[i] != NULL; i++)
+			add_watch (vec[i], IN_CREATE | IN_MOVED_TO | IN_ATTRIB, FALSE);
+		g_strfreev (vec);
+	}
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/**
+ * mdm_sessions_rescan
+ *
+ * Rebuilds the session catalogue from the SessionDesktopDir
+ * directories.  In the main daemon it also rewrites the snapshot the
+ * greeters read.
+ */
+void
+mdm_sessions_rescan (void)
+{
+	char *search_path;
+	char *file;
+
+	search_path = session_search_path ();
+
+	if (catalogue != NULL)
+		g_key_file_free (catalogue);
+	catalogue = mdm_common_config_load_sessions (mdm_daemon_config_get_value_string (MDM_KEY_SESSION_DESKTOP_DIR),
+						     search_path);
+
+	if (monitoring) {
+		GError *error = NULL;
+
+#ifdef HAVE_SYS_INOTIFY_H
+		/* Set the watches up again, the directories may have
+		 * come or gone */
+		sessions_watch (search_path);
+#endif
+		file = catalogue_file ();
+		if ( ! mdm_common_config_save (catalogue, file, &error)) {
+			mdm_error ("mdm_sessions: Cannot write %s: %s", file, error->message);
+			g_error_free (error);
+			VE_IGNORE_EINTR (g_unlink (file));
+		}
+		catalogue_remember (file);
+		g_free (file);
+
+		mdm_debug ("mdm_sessions: Session catalogue rebuilt");
+	}
+
+	g_free (search_path);
+}
+
+/**
+ * mdm_sessions_init
+ *
+ * Called once by the main daemon.  Builds the catalogue and keeps it
+ * up to date when the session directories or the programs they need
+ * change.
+ */
+void
+mdm_sessions_init (void)
+{
+	monitoring = TRUE;
+	mdm_sessions_rescan ();
+}
+
+/**
+ * mdm_sessions_stop_monitor
+ *
+ * For the slave after fork: keep the catalogue, leave the watching and
+ * the snapshot to the daemon.
+ */
+void
+mdm_sessions_stop_monitor (void)
+{
+	monitoring = FALSE;
+#ifdef HAVE_SYS_INOTIFY_H
+	sessions_unwatch ();
+#endif
+}
+
+/**
+ * mdm_sessions_get
+ *
+ * Returns the current session catalogue, owned by this module.
+ */
+GKeyFile *
+mdm_sessions_get (void)
+{
+	struct stat s;
+	char       *file;
+
+	if (catalogue != NULL && ! catalogue_matches (catalogue)) {
+		mdm_sessions_rescan ();
+		return catalogue;
+	}
+
+	if (monitoring && catalogue != NULL)
+		return catalogue;
+
+	/* A slave has the catalogue as it was when it was forked, the
+	 * greeter may have sat there for days since.  Pick up the
+	 * daemon's newer snapshot if there is one. */
+	file = catalogue_file ();
+	if (stat (file, &s) == 0 &&
+	    (catalogue == NULL ||
+	     s.st_dev != catalogue_dev ||
+	     s.st_ino != catalogue_ino ||
+	     s.st_mtime != catalogue_mtime)) {
+		GKeyFile *cfg;
+
+		cfg = catalogue_load (file, &s);
+		if (cfg != NULL && catalogue_matches (cfg)) {
+			if (catalogue != NULL)
+				g_key_file_free (catalogue);
+			catalogue = cfg;
+			catalogue_dev = s.st_dev;
+			catalogue_ino = s.st_ino;
+			catalogue_mtime = s.st_mtime;
+		} else if (cfg != NULL) {
+			g_key_file_free (cfg);
+		}
+	}
+	g_free (file);
+
+	if (catalogue == NULL)
+		mdm_sessions_rescan ();
+
+	return catalogue;
+}
@@ -0,0 +1,34 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_SESSIONS_H
+#define MDM_SESSIONS_H
+
+#include <glib.h>
+
+/* The session catalogue is a key file with one group per session file,
+ * holding the "Desktop Entry" keys of that file plus what the daemon
+ * resolved for it.  The daemon keeps it up to date and writes it to
+ * ServAuthDir as MDM_SESSION_CATALOGUE for the greeters. */
+
+void		mdm_sessions_init	(void);
+void		mdm_sessions_rescan	(void);
+void		mdm_sessions_stop_monitor (void);
+GKeyFile *	mdm_sessions_get	(void);
+
+#endif /* MDM_SESSIONS_H */
@@ -191,6 +191,7 @@ static gint   mdm_slave_xioerror_handler (Display *disp);
 static void   mdm_slave_run (MdmDisplay *display);
 static void   mdm_slave_wait_for_login (void);
 static void   mdm_slave_greeter (void);
+static void   slave_prefetch_start (void);
 static void   mdm_slave_session_start (void);
 static void   mdm_slave_session_stop (gboolean run_post_session,
 					gboolean no_shutdown_check);
@@ -1324,6 +1325,9 @@ mdm_slave_run (MdmDisplay *display)
 	 * exist */
 	if (SERVER_IS_LOCAL (d) &&
 	    d->servpid <= 0) {
+		/* Get the greeter's data ready while X starts */
+		slave_prefetch_start ();
+
 		if G_UNLIKELY ( ! mdm_server_start (d,
 						    TRUE /* try_again_if_busy */,
 						    FALSE /* treat_as_flexi */,
@@ -2040,163 +2044,743 @@ mdm_slave_wait_for_login (void)
 
 }
 
-/* This is VERY evil! */
-static void
-run_pictures (void)
+/*
+ * Open the face of @login as that user, with the same checks for
+ * every user.  Returns the open file, the users uid in @uid and what
+ * fstat says about the file in @s, or NULL.  The euid/egid are back
+ * to root/mdm when this returns.
+ */
+static FILE *
+open_user_picture (const char *login, uid_t *uid, struct stat *s)
 {
-	char *response;
-	int max_write;
-	char buf[1024];
-	size_t bytes;
 	struct passwd *pwent;
 	char *picfile;
-	FILE *fp;
+	FILE *fp = NULL;
+	int r;
 
-	response = NULL;
-	for (;;) {
-		struct stat s;
-		char *tmp, *ret;
-		int i, r;
+	pwent = getpwnam (login);
+	if G_UNLIKELY (pwent == NULL)
+		return NULL;
 
-		g_free (response);
-		response = mdm_slave_greeter_ctl (MDM_NEEDPIC, "");
-		if (ve_string_empty (response)) {
-			g_free (response);
-			return;
+	NEVER_FAILS_seteuid (0);
+	if G_UNLIKELY (setegid (pwent->pw_gid) != 0 ||
+		       seteuid (pwent->pw_uid) != 0) {
+		NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
+		return NULL;
+	}
+
+	picfile = mdm_common_get_facefile (pwent->pw_dir, pwent->pw_name, pwent->pw_uid);
+
+	if (picfile != NULL) {
+		VE_IGNORE_EINTR (fp = fopen (picfile, "r"));
+		if (fp != NULL) {
+			VE_IGNORE_EINTR (r = fstat (fileno (fp), s));
+			if G_UNLIKELY (r != 0 || s->st_size > mdm_daemon_config_get_value_int (MDM_KEY_USER_MAX_FILE)) {
+				VE_IGNORE_EINTR (fclose (fp));
+				fp = NULL;
+			}
 		}
+		g_free (picfile);
+	}
 
-		pwent = getpwnam (response);
-		if G_UNLIKELY (pwent == NULL) {
-			mdm_slave_greeter_ctl_no_ret (MDM_READPIC, "");
-			continue;
+	*uid = pwent->pw_uid;
+
+	NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
+
+	return fp;
+}
+
+/*
+ * The face cache.  Faces are scaled once to the size the greeters show
+ * them at and kept as raw RGBA in a directory owned by root, under a
+ * name made of the uid and the inode, mtime and size of the face they
+ * came from.  The greeter maps them straight into a pixbuf, so with a
+ * warm cache it doesn't decode a single image.
+ */
+#define MDM_FACE_THUMB_BYTES (MDM_FACE_THUMB_SIZE * MDM_FACE_THUMB_SIZE * 4)
+
+typedef struct {
+	uid_t uid;
+	char *cachefile;
+	char *data;
+	gsize size;
+} MdmFaceMiss;
+
+static const char *
+face_cache_dir (void)
+{
+	static gboolean checked = FALSE;
+	static const char *dir = NULL;
+	const char *cfg;
+	struct stat s;
+	int r;
+
+	if (checked)
+		return dir;
+	checked = TRUE;
+
+	cfg = mdm_daemon_config_get_value_string (MDM_KEY_FACE_CACHE_DIR);
+	if (ve_string_empty (cfg) || ! g_path_is_absolute (cfg))
+		return NULL;
+
+	VE_IGNORE_EINTR (r = g_lstat (cfg, &s));
+	if (r != 0 && errno == ENOENT) {
+		char *parent = g_path_get_dirname (cfg);
+
+		/* the greeter has to be able to get through the parents */
+		g_mkdir_with_parents (parent, 0755);
+		g_free (parent);
+
+		if (g_mkdir (cfg, 0750) == 0) {
+			chown (cfg, 0, mdm_daemon_config_get_mdmgid ());
+			chmod (cfg, 0750);
 		}
+		VE_IGNORE_EINTR (r = g_lstat (cfg, &s));
+	}
 
-		picfile = NULL;
+	if G_UNLIKELY (r != 0 || ! S_ISDIR (s.st_mode) || s.st_uid != 0 ||
+		       (s.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+		mdm_error (_("%s: Face cache directory %s is not a directory only root can write to, not using it"),
+			   "face_cache_dir", cfg);
+		return NULL;
+	}
 
-		NEVER_FAILS_seteuid (0);
-		if G_UNLIKELY (setegid (pwent->pw_gid) != 0 ||
-			       seteuid (pwent->pw_uid) != 0) {
-			NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
-			mdm_slave_greeter_ctl_no_ret (MDM_READPIC, "");
-			continue;
+	dir = cfg;
+	return dir;
+}
+
+static char *
+face_cache_file (uid_t uid, const struct stat *s)
+{
+	const char *dir = face_cache_dir ();
+
+	if (dir == NULL)
+		return NULL;
+
+	return g_strdup_printf ("%s/%lu-%lu-%ld-%ld-%dx%d.rgba", dir,
+				(gulong) uid, (gulong) s->st_ino,
+				(long) s->st_mtime, (long) s->st_size,
+				MDM_FACE_THUMB_SIZE, MDM_FACE_THUMB_SIZE);
+}
+
+static gboolean
+face_cache_valid (const char *cachefile)
+{
+	struct stat s;
+	int r;
+
+	VE_IGNORE_EINTR (r = g_lstat (cachefile, &s));
+
+	return (r == 0 && S_ISREG (s.st_mode) && s.st_uid == 0 &&
+		s.st_size == MDM_FACE_THUMB_BYTES);
+}
+
+/* Remove the thumbnails of older faces of @uid */
+static void
+face_cache_prune (uid_t uid, const char *keep)
+{
+	const char *dir = face_cache_dir ();
+	const char *name;
+	char *prefix;
+	GDir *gdir;
+
+	gdir = g_dir_open (dir, 0, NULL);
+	if (gdir == NULL)
+		return;
+
+	prefix = g_strdup_printf ("%lu-", (gulong) uid);
+	while ((name = g_dir_read_name (gdir)) != NULL) {
+		if (strncmp (name, prefix, strlen (prefix)) == 0 &&
+		    strcmp (name, keep) != 0) {
+			char *path = g_build_filename (dir, name, NULL);
+			VE_IGNORE_EINTR (g_unlink (path));
+			g_free (path);
+		}
+	}
+	g_free (prefix);
+	g_dir_close (gdir);
+}
+
+/* Scale one face and write it out as raw RGBA, in the decoding child */
+static gboolean
+face_cache_write_thumb (int fd, const char *data, gsize size)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf *img, *scaled, *rgba;
+	const guchar *pixels;
+	int rowstride, y;
+	gboolean ret = TRUE;
+
+	loader = gdk_pixbuf_loader_new ();
+	gdk_pixbuf_loader_write (loader, (const guchar *) data, size, NULL);
+	gdk_pixbuf_loader_close (loader, NULL);
+
+	img = gdk_pixbuf_loader_get_pixbuf (loader);
+	if (img == NULL) {
+		g_object_unref (G_OBJECT (loader));
+		return FALSE;
+	}
+
+	scaled = gdk_pixbuf_scale_simple (img, MDM_FACE_THUMB_SIZE,
+					  MDM_FACE_THUMB_SIZE, GDK_INTERP_BILINEAR);
+	g_object_unref (G_OBJECT (loader));
+	if (scaled == NULL)
+		return FALSE;
+
+	rgba = gdk_pixbuf_add_alpha (scaled, FALSE, 0, 0, 0);
+	g_object_unref (G_OBJECT (scaled));
+	if (rgba == NULL)
+		return FALSE;
+
+	pixels = gdk_pixbuf_get_pixels (rgba);
+	rowstride = gdk_pixbuf_get_rowstride (rgba);
+	for (y = 0; ret && y < MDM_FACE_THUMB_SIZE; y++) {
+		const guchar *p = pixels + y * rowstride;
+		gsize left = MDM_FACE_THUMB_SIZE * 4;
+
+		while (left > 0) {
+			ssize_t written;
+
+			VE_IGNORE_EINTR (written = write (fd, p, left));
+			if (written <= 0) {
+				ret = FALSE;
+				break;
+			}
+			p += written;
+			left -= written;
 		}
+	}
+
+	g_object_unref (G_OBJECT (rgba));
+	return ret;
+}
+
+/*
+ * Fork a child that the slave does not wait for, mdm_slave_child_handler
+ * reaps it.  Unlike mdm_fork_extra a failed fork is returned as -1, so
+ * the caller can just skip what it wanted to do.
+ */
+static pid_t
+fork_helper (void)
+{
+	pid_t pid;
+
+	mdm_sigchld_block_push ();
+	mdm_sigterm_block_push ();
+	pid = fork ();
+	if (pid == 0)
+		mdm_unset_signals ();
+	mdm_sigterm_block_pop ();
+	mdm_sigchld_block_pop ();
+
+	if (pid == 0)
+		setsid ();
+
+	return pid;
+}
+
+/*
+ * Make thumbnails for the faces we had to send whole.  The decoding
+ * is done in a child running as the mdm user, just like the greeter
+ * would do it, and it writes into temporary files we opened as root.
+ * Only the ones that come out the right size get renamed into place.
+ * This waits for the decoding, so it is only called from children of
+ * the slave.
+ */
+static void
+face_cache_write (GSList *misses)
+{
+	GSList *li;
+	guint n, i;
+	int *fds;
+	char **tmpfiles;
+	pid_t pid;
+	int status = -1;
+
+	n = g_slist_length (misses);
+	if (n == 0)
+		return;
+
+	fds = g_new (int, n);
+	tmpfiles = g_new0 (char *, n);
 
-		picfile = mdm_common_get_facefile (pwent->pw_dir, pwent->pw_name, pwent->pw_uid);
+	for (li = misses, i = 0; li != NULL; li = li->next, i++) {
+		MdmFaceMiss *miss = li->data;
 
-		if (! picfile) {
-			NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
-			mdm_slave_greeter_ctl_no_ret (MDM_READPIC, "");
+		tmpfiles[i] = g_strconcat (miss->cachefile, ".XXXXXX", NULL);
+		fds[i] = g_mkstemp (tmpfiles[i]);
+		if (fds[i] < 0)
 			continue;
+		fchown (fds[i], 0, mdm_daemon_config_get_mdmgid ());
+		fchmod (fds[i], 0640);
+	}
+
+	pid = fork ();
+	if (pid == 0) {
+		gid_t groups[1] = { mdm_daemon_config_get_mdmgid () };
+
+		if G_UNLIKELY (setgid (mdm_daemon_config_get_mdmgid ()) != 0 ||
+			       setgroups (1, groups) != 0 ||
+			       setuid (mdm_daemon_config_get_mdmuid ()) != 0)
+			_exit (1);
+
+		for (li = misses, i = 0; li != NULL; li = li->next, i++) {
+			MdmFaceMiss *miss = li->data;
+
+			if (fds[i] >= 0 &&
+			    ! face_cache_write_thumb (fds[i], miss->data, miss->size))
+				VE_IGNORE_EINTR (ftruncate (fds[i], 0));
 		}
+		_exit (0);
+	} else if (pid > 0) {
+		VE_IGNORE_EINTR (waitpid (pid, &status, 0));
+	}
 
-		VE_IGNORE_EINTR (r = g_stat (picfile, &s));
-		if G_UNLIKELY (r < 0 || s.st_size > mdm_daemon_config_get_value_int (MDM_KEY_USER_MAX_FILE)) {
-			NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
+	for (li = misses, i = 0; li != NULL; li = li->next, i++) {
+		MdmFaceMiss *miss = li->data;
+		struct stat s;
+		int r = -1;
 
-			mdm_slave_greeter_ctl_no_ret (MDM_READPIC, "");
+		if (fds[i] < 0) {
+			g_free (tmpfiles[i]);
 			continue;
 		}
 
-		VE_IGNORE_EINTR (fp = fopen (picfile, "r"));
-		g_free (picfile);
-		if G_UNLIKELY (fp == NULL) {
-			NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
+		if (WIFEXITED (status) && WEXITSTATUS (status) == 0)
+			VE_IGNORE_EINTR (r = fstat (fds[i], &s));
+		VE_IGNORE_EINTR (close (fds[i]));
 
-			mdm_slave_greeter_ctl_no_ret (MDM_READPIC, "");
-			continue;
+		if (r == 0 && s.st_size == MDM_FACE_THUMB_BYTES &&
+		    g_rename (tmpfiles[i], miss->cachefile) == 0) {
+			char *base = g_path_get_basename (miss->cachefile);
+			face_cache_prune (miss->uid, base);
+			g_free (base);
+		} else {
+			VE_IGNORE_EINTR (g_unlink (tmpfiles[i]));
 		}
+		g_free (tmpfiles[i]);
+	}
 
-		tmp = g_strdup_printf ("buffer:%d", (int)s.st_size);
-		ret = mdm_slave_greeter_ctl (MDM_READPIC, tmp);
-		g_free (tmp);
+	g_free (fds);
+	g_free (tmpfiles);
+}
 
-		if G_UNLIKELY (ret == NULL || strcmp (ret, "OK") != 0) {
-			VE_IGNORE_EINTR (fclose (fp));
-			g_free (ret);
+/* Store the thumbnails from a child, so the slave can go right back
+ * to the greeter */
+static void
+face_cache_store (GSList *misses)
+{
+	pid_t pid;
 
-			NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
+	if (misses == NULL)
+		return;
 
-			continue;
-		}
-		g_free (ret);
+	pid = fork_helper ();
+	if (pid == 0) {
+		face_cache_write (misses);
+		_exit (0);
+	} else if (pid < 0) {
+		mdm_debug ("face_cache_store: Cannot fork, not caching %d faces",
+			   (int) g_slist_length (misses));
+	}
+}
 
-		mdm_fdprintf (greeter_fd_out, "%c", STX);
+static void
+face_miss_free (MdmFaceMiss *miss)
+{
+	g_free (miss->cachefile);
+	g_free (miss->data);
+	g_free (miss);
+}
+
+/* Takes over @cachefile; @fp is left at the start of the picture */
+static MdmFaceMiss *
+face_miss_new (uid_t uid, char *cachefile, FILE *fp, off_t size)
+{
+	MdmFaceMiss *miss = g_new0 (MdmFaceMiss, 1);
+
+	miss->uid = uid;
+	miss->cachefile = cachefile;
+	miss->data = g_malloc (size);
+	VE_IGNORE_EINTR (miss->size = fread (miss->data, 1, size, fp));
+	rewind (fp);
+
+	return miss;
+}
+
+/* Write exactly @size bytes of @fp to the greeter */
+static void
+write_picture (FILE *fp, off_t size)
+{
+	int max_write;
+	char buf[1024];
+	size_t bytes;
+	off_t i;
 
 #ifdef PIPE_BUF
-		max_write = MIN (PIPE_BUF, sizeof (buf));
+	max_write = MIN (PIPE_BUF, sizeof (buf));
 #else
-		/* apparently Hurd doesn't have PIPE_BUF */
-		max_write = fpathconf (greeter_fd_out, _PC_PIPE_BUF);
-		/* could return -1 if no limit */
-		if (max_write > 0)
-			max_write = MIN (max_write, sizeof (buf));
-		else
-			max_write = sizeof (buf);
+	/* apparently Hurd doesn't have PIPE_BUF */
+	max_write = fpathconf (greeter_fd_out, _PC_PIPE_BUF);
+	/* could return -1 if no limit */
+	if (max_write > 0)
+		max_write = MIN (max_write, sizeof (buf));
+	else
+		max_write = sizeof (buf);
 #endif
 
-		i = 0;
-		while (i < s.st_size) {
-			int written;
+	i = 0;
+	while (i < size) {
+		int written;
 
-			VE_IGNORE_EINTR (bytes = fread (buf, sizeof (char),
-							max_write, fp));
+		VE_IGNORE_EINTR (bytes = fread (buf, sizeof (char),
+						max_write, fp));
 
-			if (bytes <= 0)
-				break;
+		if (bytes <= 0)
+			break;
+
+		if G_UNLIKELY (i + bytes > size)
+			bytes = size - i;
+
+		/* write until we succeed in writing something */
+		VE_IGNORE_EINTR (written = write (greeter_fd_out, buf, bytes));
+		if G_UNLIKELY (written < 0 &&
+			       (errno == EPIPE || errno == EBADF)) {
+			/* something very, very bad has happened */
+			mdm_slave_quick_exit (DISPLAY_REMANAGE);
+		}
 
-			if G_UNLIKELY (i + bytes > s.st_size)
-				bytes = s.st_size - i;
+		if G_UNLIKELY (written < 0)
+			written = 0;
 
-			/* write until we succeed in writing something */
-			VE_IGNORE_EINTR (written = write (greeter_fd_out, buf, bytes));
-			if G_UNLIKELY (written < 0 &&
+		/* write until we succeed in writing everything */
+		while (written < bytes) {
+			int n;
+			VE_IGNORE_EINTR (n = write (greeter_fd_out, &buf[written], bytes-written));
+			if G_UNLIKELY (n < 0 &&
 				       (errno == EPIPE || errno == EBADF)) {
 				/* something very, very bad has happened */
 				mdm_slave_quick_exit (DISPLAY_REMANAGE);
+			} else if G_LIKELY (n > 0) {
+				written += n;
 			}
+		}
 
-			if G_UNLIKELY (written < 0)
-				written = 0;
-
-			/* write until we succeed in writing everything */
-			while (written < bytes) {
-				int n;
-				VE_IGNORE_EINTR (n = write (greeter_fd_out, &buf[written], bytes-written));
-				if G_UNLIKELY (n < 0 &&
-					       (errno == EPIPE || errno == EBADF)) {
-					/* something very, very bad has happened */
-					mdm_slave_quick_exit (DISPLAY_REMANAGE);
-				} else if G_LIKELY (n > 0) {
-					written += n;
-				}
-			}
+		/* we have written bytes bytes if it likes it or not */
+		i += bytes;
+	}
 
-			/* we have written bytes bytes if it likes it or not */
+	/* eek, this "could" happen, so just send some garbage */
+	while G_UNLIKELY (i < size) {
+		bytes = MIN (sizeof (buf), size - i);
+		errno = 0;
+		bytes = write (greeter_fd_out, buf, bytes);
+		if G_UNLIKELY (bytes < 0 && (errno == EPIPE || errno == EBADF)) {
+			/* something very, very bad has happened */
+			mdm_slave_quick_exit (DISPLAY_REMANAGE);
+		}
+		if (bytes > 0)
 			i += bytes;
+	}
+}
+
+/*
+ * The greeter answers MDM_NEEDPIC with a space separated list of logins.
+ * We tell it how many records are coming with "batch:<n>", and once it
+ * says OK we send an STX followed by one header line per login, in the
+ * order asked.  Either "<login> <size>\n" followed by <size> bytes of
+ * image, where a size of 0 means there is no picture, or "<login>
+ * @<file>\n" naming a thumbnail in the face cache for it to map.  This
+ * goes on until it answers MDM_NEEDPIC with nothing.  Users it lists
+ * later it asks for with MDM_INTERRUPT_PICTURES, which runs this again.
+ */
+static void
+run_pictures (void)
+{
+	char *response;
+
+	response = NULL;
+	for (;;) {
+		GSList *misses = NULL;
+		char **logins;
+		char *tmp, *ret;
+		int i, n;
+
+		g_free (response);
+		response = mdm_slave_greeter_ctl (MDM_NEEDPIC, "");
+		if (ve_string_empty (response)) {
+			g_free (response);
+			return;
 		}
 
-		VE_IGNORE_EINTR (fclose (fp));
+		logins = g_strsplit (response, " ", -1);
+		n = mdm_vector_len (logins);
 
-		/* eek, this "could" happen, so just send some garbage */
-		while G_UNLIKELY (i < s.st_size) {
-			bytes = MIN (sizeof (buf), s.st_size - i);
-			errno = 0;
-			bytes = write (greeter_fd_out, buf, bytes);
-			if G_UNLIKELY (bytes < 0 && (errno == EPIPE || errno == EBADF)) {
-				/* something very, very bad has happened */
-				mdm_slave_quick_exit (DISPLAY_REMANAGE);
+		tmp = g_strdup_printf ("batch:%d", n);
+		ret = mdm_slave_greeter_ctl (MDM_READPIC, tmp);
+		g_free (tmp);
+
+		if G_UNLIKELY (ret == NULL || strcmp (ret, "OK") != 0) {
+			g_free (ret);
+			g_strfreev (logins);
+			continue;
+		}
+		g_free (ret);
+
+		mdm_fdprintf (greeter_fd_out, "%c", STX);
+
+		for (i = 0; i < n; i++) {
+			FILE *fp;
+			struct stat s;
+			char *cachefile;
+			uid_t uid;
+
+			fp = open_user_picture (logins[i], &uid, &s);
+			if (fp == NULL) {
+				mdm_fdprintf (greeter_fd_out, "%s 0\n", logins[i]);
+				continue;
 			}
-			if (bytes > 0)
-				i += bytes;
+
+			cachefile = face_cache_file (uid, &s);
+			if (cachefile != NULL && face_cache_valid (cachefile)) {
+				mdm_fdprintf (greeter_fd_out, "%s @%s\n", logins[i], cachefile);
+				VE_IGNORE_EINTR (fclose (fp));
+				g_free (cachefile);
+				continue;
+			}
+
+			if (cachefile != NULL)
+				misses = g_slist_prepend (misses,
+							  face_miss_new (uid, cachefile, fp, s.st_size));
+
+			mdm_fdprintf (greeter_fd_out, "%s %ld\n", logins[i], (long)s.st_size);
+			write_picture (fp, s.st_size);
+			VE_IGNORE_EINTR (fclose (fp));
 		}
 
+		g_strfreev (logins);
+
 		mdm_slave_greeter_ctl_no_ret (MDM_READPIC, "done");
 
-		NEVER_FAILS_root_set_euid_egid (0, mdm_daemon_config_get_mdmgid ());
+		/* the greeter has what it needs, now make the next start faster */
+		face_cache_store (misses);
+		g_slist_foreach (misses, (GFunc) face_miss_free, NULL);
+		g_slist_free (misses);
 	}
 	g_free (response); /* not reached */
 }
 
+/*
+ * Gather what the greeter reads when it starts while the X server is
+ * still coming up.  The theme, the locale list and the session
+ * catalogue end up in the page cache, the faces in the face cache, and
+ * walking the users warms up NSS.  The greeter then finds all of it
+ * ready.  Nothing waits for these children, mdm_slave_child_handler
+ * reaps them.
+ */
+#define MDM_PREFETCH_TIMEOUT 30
+#define MDM_PREFETCH_MAX_FILE (1024 * 1024)
+
+static void
+prefetch_file (const char *file)
+{
+	char buf[8192];
+	struct stat s;
+	ssize_t r;
+	int fd;
+
+	if (ve_string_empty (file))
+		return;
+
+	VE_IGNORE_EINTR (fd = open (file, O_RDONLY));
+	if (fd < 0)
+		return;
+
+	VE_IGNORE_EINTR (r = fstat (fd, &s));
+	if (r == 0 && S_ISREG (s.st_mode) && s.st_size <= MDM_PREFETCH_MAX_FILE) {
+		do {
+			VE_IGNORE_EINTR (r = read (fd, buf, sizeof (buf)));
+		} while (r > 0);
+	}
+
+	VE_IGNORE_EINTR (close (fd));
+}
+
+/* Read the files in @dir, going @depth levels down.  Only names
+ * starting with @prefix if given, else everything but dot files. */
+static void
+prefetch_dir (const char *dir, int depth, const char *prefix)
+{
+	const char *name;
+	GDir *gdir;
+
+	if (ve_string_empty (dir))
+		return;
+
+	gdir = g_dir_open (dir, 0, NULL);
+	if (gdir == NULL)
+		return;
+
+	while ((name = g_dir_read_name (gdir)) != NULL) {
+		char *path;
+
+		if (prefix != NULL ? ! g_str_has_prefix (name, prefix) : name[0] == '.')
+			continue;
+
+		path = g_build_filename (dir, name, NULL);
+		if (g_file_test (path, G_FILE_TEST_IS_DIR)) {
+			if (depth > 0)
+				prefetch_dir (path, depth - 1, prefix);
+		} else {
+			prefetch_file (path);
+		}
+		g_free (path);
+	}
+
+	g_dir_close (gdir);
+}
+
+static void
+prefetch_greeter_files (void)
+{
+	const char *greeter = mdm_daemon_config_get_value_string (MDM_KEY_GREETER);
+	char *themedir;
+
+	/* The session catalogue and the language lists */
+	prefetch_dir (mdm_daemon_config_get_value_string (MDM_KEY_SERV_AUTHDIR), 0, ".mdm-");
+	prefetch_file (mdm_daemon_config_get_value_string (MDM_KEY_LOCALE_FILE));
+	prefetch_file (mdm_daemon_config_get_value_string (MDM_KEY_GTKRC));
+
+	if (greeter != NULL && strstr (greeter, "mdmgreeter") != NULL)
+		themedir = g_build_filename (mdm_daemon_config_get_value_string (MDM_KEY_GRAPHICAL_THEME_DIR),
+					     mdm_daemon_config_get_value_string (MDM_KEY_GRAPHICAL_THEME),
+					     NULL);
+	else
+		themedir = g_build_filename (DATADIR, "mdm", "html-themes",
+					     mdm_daemon_config_get_value_string (MDM_KEY_HTML_THEME),
+					     NULL);
+	prefetch_dir (themedir, 1, NULL);
+	g_free (themedir);
+}
+
+/* The same users the greeter will show, give or take the shell checks */
+static GSList *
+prefetch_logins (void)
+{
+	GSList *logins = NULL;
+	char **vec;
+	int i;
+
+	if (mdm_daemon_config_get_value_bool (MDM_KEY_INCLUDE_ALL)) {
+		struct passwd *pwent;
+		int minuid = mdm_daemon_config_get_value_int (MDM_KEY_MINIMAL_UID);
+		int max = mdm_daemon_config_get_value_int (MDM_KEY_INCLUDE_ALL_MAX_USERS);
+		int count = 0;
+
+		vec = g_strsplit (ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_EXCLUDE)), ",", -1);
+		for (i = 0; vec[i] != NULL; i++)
+			g_strstrip (vec[i]);
+
+		setpwent ();
+		while ((max <= 0 || count < max) &&
+		       (pwent = getpwent ()) != NULL) {
+			for (i = 0; vec[i] != NULL; i++) {
+				if (strcmp (vec[i], pwent->pw_name) == 0)
+					break;
+			}
+			if (pwent->pw_uid < minuid || vec[i] != NULL)
+				continue;
+
+			logins = g_slist_prepend (logins, g_strdup (pwent->pw_name));
+			count++;
+		}
+		endpwent ();
+	} else {
+		vec = g_strsplit (ve_sure_string (mdm_daemon_config_get_value_string (MDM_KEY_INCLUDE)), ",", -1);
+		for (i = 0; vec[i] != NULL; i++) {
+			g_strstrip (vec[i]);
+			if (vec[i][0] != '\0')
+				logins = g_slist_prepend (logins, g_strdup (vec[i]));
+		}
+	}
+	g_strfreev (vec);
+
+	return g_slist_reverse (logins);
+}
+
+static void
+prefetch_faces (void)
+{
+	GSList *logins, *li;
+	GSList *misses = NULL;
+
+	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_BROWSER))
+		return;
+
+	logins = prefetch_logins ();
+
+	for (li = logins; li != NULL; li = li->next) {
+		FILE *fp;
+		struct stat s;
+		char *cachefile;
+		uid_t uid;
+
+		fp = open_user_picture (li->data, &uid, &s);
+		if (fp == NULL)
+			continue;
+
+		cachefile = face_cache_file (uid, &s);
+		if (cachefile != NULL && ! face_cache_valid (cachefile)) {
+			misses = g_slist_prepend (misses,
+						  face_miss_new (uid, cachefile, fp, s.st_size));
+		} else {
+			/* No cache to fill, so at least get it into memory */
+			if (cachefile == NULL)
+				face_miss_free (face_miss_new (uid, NULL, fp, s.st_size));
+			g_free (cachefile);
+		}
+		VE_IGNORE_EINTR (fclose (fp));
+	}
+
+	face_cache_write (misses);
+	g_slist_foreach (misses, (GFunc) face_miss_free, NULL);
+	g_slist_free (misses);
+	g_slist_foreach (logins, (GFunc) g_free, NULL);
+	g_slist_free (logins);
+}
+
+static void
+slave_prefetch_start (void)
+{
+	pid_t pid;
+
+	if ( ! mdm_daemon_config_get_value_bool (MDM_KEY_GREETER_PREFETCH))
+		return;
+
+	/* The files and the faces do not depend on each other, the faces
+	 * may have to wait for NFS homes.  Prefetching is only a hint, if
+	 * we cannot fork it is simply not done. */
+	pid = fork_helper ();
+	if (pid == 0) {
+		alarm (MDM_PREFETCH_TIMEOUT);
+		prefetch_greeter_files ();
+		_exit (0);
+	} else if (pid < 0) {
+		mdm_debug ("slave_prefetch_start: Cannot fork to prefetch greeter files");
+	}
+
+	pid = fork_helper ();
+	if (pid == 0) {
+		alarm (MDM_PREFETCH_TIMEOUT);
+		prefetch_faces ();
+		_exit (0);
+	} else if (pid < 0) {
+		mdm_debug ("slave_prefetch_start: Cannot fork to prefetch faces");
+	}
+
+	mdm_debug ("slave_prefetch_start: Prefetching greeter data for %s", d->name);
+}
+
 static void
 exec_command (const char *command, const char *extra_arg)
 {
@@ -2385,6 +2969,21 @@ mdm_slave_greeter (void)
 			g_unsetenv ("MDM_FLEXI_SERVER");
 		}
 
+		/* pre-started displays wait in the pool, don't let
+		 * the greeter reap itself until we send it SIGUSR1.
+		 * That stays pending until it has a handler for it */
+		if (d->warm) {
+			sigset_t mask;
+
+			g_setenv ("MDM_FLEXI_WARM", "yes", TRUE);
+
+			sigemptyset (&mask);
+			sigaddset (&mask, SIGUSR1);
+			sigprocmask (SIG_BLOCK, &mask, NULL);
+		} else {
+			g_unsetenv ("MDM_FLEXI_WARM");
+		}
+
 		if G_UNLIKELY (d->is_emergency_server) {
 			mdm_errorgui_error_box (d,
 						GTK_MESSAGE_ERROR,
@@ -3973,9 +4572,6 @@ mdm_slave_session_start (void)
 		break;
 	}
 
-	/* this clears internal cache */
-	mdm_daemon_config_get_session_exec (NULL, FALSE);
-
 	if G_LIKELY (logfilefd >= 0)  {
 		d->xsession_errors_fd = logfilefd;
 		d->session_output_fd = logpipe[0];
@@ -4452,6 +5048,12 @@ mdm_slave_handle_usr2_message (void)
 				mdm_wait_for_go = FALSE;
 			} else if (strcmp (&s[1], MDM_NOTIFY_TWIDDLE_POINTER) == 0) {
 				mdm_twiddle_pointer (d);
+			} else if (strcmp (&s[1], MDM_NOTIFY_FLEXI_TAKEN) == 0) {
+				/* our pre-started display was handed out, the
+				 * greeter may now reap itself like any flexi */
+				d->warm = FALSE;
+				if (d->greetpid > 1)
+					kill (d->greetpid, SIGUSR1);
 			}
 		} else if (s[0] == MDM_SLAVE_NOTIFY_RESPONSE) {
 			mdm_got_ack = TRUE;
@@ -4608,6 +5210,12 @@ check_for_interruption (const char *msg)
 		case MDM_INTERRUPT_CANCEL:
 			do_cancel = TRUE;
 			break;		
+		case MDM_INTERRUPT_PICTURES:
+			/* The greeter listed more users, it asks for their
+			 * pictures just like at the start.  Not interrupted,
+			 * go on waiting for the answer */
+			run_pictures ();
+			return TRUE;
 		case MDM_INTERRUPT_THEME:
 			g_free (d->theme_name);
 			d->theme_name = NULL;
@@ -48,6 +48,8 @@
 #include "mdmconfig.h"
 #include "mdmsession.h"
 #include "mdmlanguages.h"
+#include "mdmuser.h"
+#include "mdmtrace.h"
 
 #include "greeter.h"
 #include "greeter_configuration.h"
@@ -192,6 +194,7 @@ process_operation (guchar       op_code,
 					mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE),
 					mdm_config_get_bool (MDM_KEY_SOUND_ON_LOGIN));
 		greeter_probably_login_prompt = TRUE;
+		greeter_item_ulist_filter (NULL);
 	}
 	if (gtk_ok_button != NULL)
                 gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
@@ -537,6 +540,7 @@ greeter_setup_items (void)
   greeter_item_pam_setup ();
 
   /* This will query the daemon for pictures through stdin/stdout! */
+  mdm_users_set_operation_func (process_operation);
   greeter_item_ulist_setup ();
 
   greeter_item_capslock_setup (window);
@@ -600,6 +604,7 @@ mdm_read_config (void)
 	mdm_config_get_string (MDM_KEY_EXCLUDE);
 	mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR);
 	mdm_config_get_string (MDM_KEY_LOCALE_FILE);
+	mdm_config_get_string (MDM_KEY_SERV_AUTHDIR);
 	mdm_config_get_string (MDM_KEY_HALT);
 	mdm_config_get_string (MDM_KEY_REBOOT);
 	mdm_config_get_string (MDM_KEY_SUSPEND);
@@ -795,31 +800,6 @@ get_theme_file (const char *in, char **theme_dir)
   return file;
 }
 
-/* The reaping stuff */
-static time_t last_reap_delay = 0;
-
-static gboolean
-delay_reaping (GSignalInvocationHint *ihint,
-	       guint	           n_param_values,
-	       const GValue	  *param_values,
-	       gpointer		   data)
-{
-	last_reap_delay = time (NULL);
-	return TRUE;
-}      
-
-static gboolean
-reap_flexiserver (gpointer data)
-{
-	int reapminutes = mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES);
-
-	if (reapminutes > 0 &&
-	    ((time (NULL) - last_reap_delay) / 60) > reapminutes) {
-		_exit (DISPLAY_REMANAGE);
-	}
-	return TRUE;
-}
-
 static gboolean
 mdm_event (GSignalInvocationHint *ihint,
            guint                n_param_values,
@@ -882,6 +862,8 @@ main (int argc, char *argv[])
   gint i;
   gchar *key_string = NULL;
 
+  mdm_trace_init ("mdmgreeter");
+
   if (g_getenv ("DOING_MDM_DEVELOPMENT") != NULL)
     DOING_MDM_DEVELOPMENT = TRUE;
 
@@ -907,6 +889,7 @@ main (int argc, char *argv[])
   }
 
   gtk_init (&argc, &argv);
+  mdm_trace_mark ("gtk_init");
 
   mdm_common_setup_cursor (GDK_WATCH);
 
@@ -916,7 +899,9 @@ main (int argc, char *argv[])
   mdm_common_setup_builtin_icons ();
 
   /* Read all configuration at once, so the values get cached */
+  mdm_trace_begin ("mdm_read_config");
   mdm_read_config ();
+  mdm_trace_end ("mdm_read_config");
 
   if ( ! ve_string_empty (mdm_config_get_string (MDM_KEY_GTKRC)))
 	  gtk_rc_parse (mdm_config_get_string (MDM_KEY_GTKRC));
@@ -937,7 +922,9 @@ main (int argc, char *argv[])
   bg_color = mdm_config_get_string (MDM_KEY_BACKGROUND_COLOR);  
   mdm_common_setup_background_color (bg_color);
   greeter_session_init ();
+  mdm_trace_begin ("mdm_lang_initialize_model");
   mdm_lang_initialize_model (mdm_config_get_string (MDM_KEY_LOCALE_FILE));
+  mdm_trace_end ("mdm_lang_initialize_model");
 
   ve_signal_add (SIGHUP, greeter_reread_config, NULL);
 
@@ -984,6 +971,7 @@ main (int argc, char *argv[])
   }
   
   window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  mdm_trace_first_expose (window);
 
   g_signal_connect (G_OBJECT (window), "key_press_event",
                     G_CALLBACK (key_press_event), NULL);
@@ -1028,11 +1016,13 @@ main (int argc, char *argv[])
   theme_file = get_theme_file (mdm_graphical_theme, &theme_dir);
   
   error = NULL;
+  mdm_trace_begin ("greeter_parse");
   root = greeter_parse (theme_file, theme_dir,
 			GNOME_CANVAS (canvas), 
 			mdm_wm_screen.width,
 			mdm_wm_screen.height,
 			&error);
+  mdm_trace_end ("greeter_parse");
 
     if G_UNLIKELY (root == NULL)
       {
@@ -1262,38 +1252,7 @@ main (int argc, char *argv[])
   }
 
   /* if a flexiserver, reap self after some time */
-  if (mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES) > 0 &&
-      ! ve_string_empty (g_getenv ("MDM_FLEXI_SERVER")) &&
-      /* but don't reap nested flexis */
-      ve_string_empty (g_getenv ("MDM_PARENT_DISPLAY")))
-    {
-      sid = g_signal_lookup ("activate",
-			     GTK_TYPE_MENU_ITEM);
-      g_signal_add_emission_hook (sid,
-				  0 /* detail */,
-				  delay_reaping,
-				  NULL /* data */,
-				  NULL /* destroy_notify */);
-
-      sid = g_signal_lookup ("key_press_event",
-			     GTK_TYPE_WIDGET);
-      g_signal_add_emission_hook (sid,
-				  0 /* detail */,
-				  delay_reaping,
-				  NULL /* data */,
-				  NULL /* destroy_notify */);
-
-      sid = g_signal_lookup ("button_press_event",
-			     GTK_TYPE_WIDGET);
-      g_signal_add_emission_hook (sid,
-				  0 /* detail */,
-				  delay_reaping,
-				  NULL /* data */,
-				  NULL /* destroy_notify */);
-
-      last_reap_delay = time (NULL);
-      g_timeout_add (60*1000, reap_flexiserver, NULL);
-    }
+  mdm_common_setup_reaping (NULL);
 
   sid = g_signal_lookup ("event",
                                GTK_TYPE_WIDGET);
@@ -1311,6 +1270,7 @@ main (int argc, char *argv[])
   mdm_common_setup_cursor (GDK_LEFT_PTR);
   mdm_wm_center_cursor ();
   mdm_common_pre_fetch_launch ();
+  mdm_trace_mark ("gtk_main");
   gtk_main ();
 
   return 0;
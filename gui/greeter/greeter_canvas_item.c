@@ -27,6 +27,7 @@
 #include "mdm.h"
 #include "mdmcommon.h"
 #include "mdmconfig.h"
+#include "mdmpixops.h"
 
 #include "mdm-common.h"
 #include "mdm-daemon-config-keys.h"
@@ -39,6 +40,7 @@
 #include "greeter_configuration.h"
 #include "greeter_canvas_text.h"
 #include "greeter_parser.h"
+#include "greeter_pixbuf_cache.h"
 
 /* Keep track of buttons so they can be set sensitive/insensitive */
 GtkButton *gtk_ok_button = NULL;
@@ -47,41 +49,12 @@ GtkButton *gtk_start_again_button = NULL;
 static void
 apply_tint (GdkPixbuf *pixbuf, guint32 tint_color)
 {
-  guchar *pixels;
-  guint r, g, b;
-  gboolean has_alpha;
-  guint w, h, stride;
-  guint pixel_stride;
-  guchar *line;
-  int i;
-  
-  pixels = gdk_pixbuf_get_pixels (pixbuf);
-  has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
-  
-  r = (tint_color & 0xff0000) >> 16;
-  g = (tint_color & 0x00ff00) >> 8;
-  b = (tint_color & 0x0000ff);
-
-  w = gdk_pixbuf_get_width (pixbuf);
-  h = gdk_pixbuf_get_height (pixbuf);
-  stride = gdk_pixbuf_get_rowstride (pixbuf);
-
-  pixel_stride = (has_alpha) ? 4 : 3;
-
-  while (h-->0)
-    {
-      line = pixels;
-
-      for (i = 0; i < w; i++)
-	{
-	  line[0] = line[0] * r / 0xff;
-	  line[1] = line[1] * g / 0xff;
-	  line[2] = line[2] * b / 0xff;
-	  line += pixel_stride;
-	}
-
-      pixels += stride;
-    }
+  mdm_pixops_tint (gdk_pixbuf_get_pixels (pixbuf),
+		   gdk_pixbuf_get_width (pixbuf),
+		   gdk_pixbuf_get_height (pixbuf),
+		   gdk_pixbuf_get_rowstride (pixbuf),
+		   gdk_pixbuf_get_n_channels (pixbuf),
+		   tint_color);
 }
 
 static GdkPixbuf *
@@ -128,6 +101,83 @@ transform_pixbuf (GdkPixbuf *orig,
   return scaled;
 }
 
+/* Replaces the pixmap's images by the ones shown, scaled, faded and
+ * tinted.  Items showing the same image the same way share those. */
+static void
+transform_pixmaps (GreeterItemInfo *item, int width, int height)
+{
+  GdkPixbuf *svgs[GREETER_ITEM_STATE_MAX] = { NULL };
+  gboolean svg = (item->item_type == GREETER_ITEM_TYPE_SVG);
+  char *num_locale = NULL;
+  int i, j;
+
+  for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+    {
+      GreeterPixbufKey key;
+      GdkPixbuf *orig = svg ? NULL : item->data.pixmap.pixbufs[i];
+      GdkPixbuf *pb;
+
+      if (item->data.pixmap.files[i] == NULL ||
+	  ( ! svg && orig == NULL))
+	{
+	  if (svg)
+	    item->data.pixmap.pixbufs[i] = NULL;
+	  continue;
+	}
+
+      key.file = item->data.pixmap.files[i];
+      key.svg = svg;
+      key.width = width;
+      key.height = height;
+      key.tint = (item->data.pixmap.have_tint & (1<<i)) ?
+	item->data.pixmap.tints[i] : GREETER_PIXBUF_NO_TINT;
+      key.alpha = item->data.pixmap.alphas[i];
+
+      pb = greeter_pixbuf_cache_lookup (&key);
+      if (pb == NULL && svg)
+	{
+	  for (j = 0; j < i && orig == NULL; j++)
+	    {
+	      if (svgs[j] != NULL &&
+		  strcmp (item->data.pixmap.files[j], item->data.pixmap.files[i]) == 0)
+		orig = g_object_ref (svgs[j]);
+	    }
+	  if (orig == NULL)
+	    {
+	      if (num_locale == NULL)
+		{
+		  num_locale = g_strdup (setlocale (LC_NUMERIC, NULL));
+		  setlocale (LC_NUMERIC, "C");
+		}
+	      orig = gdk_pixbuf_new_from_file_at_size (key.file, width, height, NULL);
+	    }
+	  svgs[i] = orig;
+	}
+      if (pb == NULL && orig != NULL)
+	{
+	  pb = transform_pixbuf (orig, key.tint != GREETER_PIXBUF_NO_TINT, key.tint,
+				 (double)key.alpha / 256.0, width, height);
+	  greeter_pixbuf_cache_insert (&key, pb);
+	}
+
+      if ( ! svg)
+	g_object_unref (item->data.pixmap.pixbufs[i]);
+      item->data.pixmap.pixbufs[i] = pb;
+    }
+
+  for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+    {
+      if (svgs[i] != NULL)
+	g_object_unref (svgs[i]);
+    }
+
+  if (num_locale != NULL)
+    {
+      setlocale (LC_NUMERIC, num_locale);
+      g_free (num_locale);
+    }
+}
+
 static void
 activate_button (GtkWidget *widget, gpointer data)
 {
@@ -282,7 +332,6 @@ greeter_item_create_canvas_item (GreeterItemInfo *item)
   GtkAllocation rect;
   char *text;
   GtkTooltips *tooltips;
-  char *num_locale;
   GdkColor c;
 
   if (item->item != NULL)
@@ -327,43 +376,9 @@ greeter_item_create_canvas_item (GreeterItemInfo *item)
 					NULL);
     break;
   case GREETER_ITEM_TYPE_SVG:
-    num_locale = g_strdup (setlocale (LC_NUMERIC, NULL));
-    setlocale (LC_NUMERIC, "C");
-    for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
-      {
-	if (item->data.pixmap.files[i] != NULL)
-	  {
-	    if (i > 0 &&
-		item->data.pixmap.files[0] != NULL &&
-		item->data.pixmap.pixbufs[0] != NULL &&
-		strcmp (item->data.pixmap.files[0], item->data.pixmap.files[i]) == 0)
-	      item->data.pixmap.pixbufs[i] = g_object_ref (item->data.pixmap.pixbufs[0]);
-	    else
-	      item->data.pixmap.pixbufs[i] =
-                  gdk_pixbuf_new_from_file_at_size (item->data.pixmap.files[i], rect.width, rect.height, NULL);
-	  }
-	else
-	  item->data.pixmap.pixbufs[i] = NULL;
-      }
-    setlocale (LC_NUMERIC, num_locale);
-    g_free (num_locale);
-    num_locale = NULL;
-
-    /* Fall through */
   case GREETER_ITEM_TYPE_PIXMAP:
-    for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
-      {
-	GdkPixbuf *pb = item->data.pixmap.pixbufs[i];
-	if (pb != NULL)
-	  {
-	    item->data.pixmap.pixbufs[i] =
-	      transform_pixbuf (pb,
-				(item->data.pixmap.have_tint & (1<<i)), item->data.pixmap.tints[i],
-				(double)item->data.pixmap.alphas[i] / 256.0, rect.width, rect.height);
-	    g_object_unref (pb);
-	  }
-      }
-    
+    transform_pixmaps (item, rect.width, rect.height);
+
     if (item->data.pixmap.pixbufs[GREETER_ITEM_STATE_NORMAL] != NULL)
       item->item = gnome_canvas_item_new (group,
 					  GNOME_TYPE_CANVAS_PIXBUF,
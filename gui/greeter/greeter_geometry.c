@@ -43,6 +43,10 @@ static void fixup_from_anchor           (GtkAllocation   *rect,
 static void update_real_max_width	(GreeterItemInfo *info,
 					 int              max_width);
 
+/* How much work the last layout did */
+static int items_measured;
+static int items_allocated;
+
 static void
 update_real_max_width (GreeterItemInfo *info, int max_width)
 {
@@ -52,6 +56,35 @@ update_real_max_width (GreeterItemInfo *info, int max_width)
 }
 
 
+static gboolean
+size_uses_parent (GreeterItemSizeType size_type, float size)
+{
+  return size_type == GREETER_ITEM_SIZE_RELATIVE ||
+	 (size_type == GREETER_ITEM_SIZE_ABSOLUTE && size <= 0);
+}
+
+/* Whether the requisition would come out the same for this
+ * parent size, only set sizes use it */
+static gboolean
+requisition_fits_parent (GreeterItemInfo *item,
+			 gint             parent_width,
+			 gint             parent_height)
+{
+  if ( ! item->has_requisition)
+    return FALSE;
+
+  if (size_uses_parent (item->width_type, item->width) &&
+      item->requisition_parent_width != parent_width)
+    return FALSE;
+
+  if (size_uses_parent (item->height_type, item->height) &&
+      item->requisition_parent_height != parent_height)
+    return FALSE;
+
+  return TRUE;
+}
+
+
 /* Position the item */
 static void
 greeter_item_size_allocate (GreeterItemInfo *item,
@@ -63,6 +96,8 @@ greeter_item_size_allocate (GreeterItemInfo *item,
   if ( ! greeter_item_is_visible (item))
     return;
 
+  items_allocated++;
+
   if (item->item == NULL)
     greeter_item_create_canvas_item (item);
 
@@ -303,12 +338,14 @@ greeter_size_allocate_box (GreeterItemInfo *box,
 		}
 	    }
 
-	  /* Dirty the child requisition, since
-	   * we now know the right parent size.
-	   */
-	  child->has_requisition = FALSE;
 	  w = (box->box_orientation == GTK_ORIENTATION_HORIZONTAL) ? child_major_size : allocation->width - 2 * box->box_x_padding;
 	  h = (box->box_orientation == GTK_ORIENTATION_HORIZONTAL) ? allocation->height - 2 * box->box_y_padding : child_major_size;
+
+	  /* Dirty the child requisition if it depends on the parent
+	   * size, since we now know the right one.
+	   */
+	  if ( ! requisition_fits_parent (child, w, h))
+	    child->has_requisition = FALSE;
       
 	  greeter_item_size_request (child,
 				     &child_requisition,
@@ -467,10 +504,14 @@ greeter_item_size_request (GreeterItemInfo *item,
       return;
     }
 
+  items_measured++;
+
   req = &item->requisition;
   
   req->width = 0;
   req->height = 0;
+  item->requisition_parent_width = parent_width;
+  item->requisition_parent_height = parent_height;
 
   if (item->width_type == GREETER_ITEM_SIZE_BOX ||
       item->height_type == GREETER_ITEM_SIZE_BOX)
@@ -556,12 +597,18 @@ greeter_item_size_request (GreeterItemInfo *item,
 
   if (item->item_type == GREETER_ITEM_TYPE_SVG)
     {
-      GdkPixbuf *svg;
+      RsvgHandle *svg;
+      RsvgDimensionData dim;
 
-      svg = rsvg_pixbuf_from_file (item->data.pixmap.files[0], NULL);
-      req->width = gdk_pixbuf_get_width (svg);
-      req->height = gdk_pixbuf_get_height (svg);
-      g_object_unref (svg);
+      /* Only the size is needed, no point rendering it */
+      svg = rsvg_handle_new_from_file (item->data.pixmap.files[0], NULL);
+      if (svg != NULL)
+        {
+          rsvg_handle_get_dimensions (svg, &dim);
+          req->width = dim.width;
+          req->height = dim.height;
+          g_object_unref (svg);
+        }
     }
 
   if (item->item_type == GREETER_ITEM_TYPE_BUTTON)
@@ -619,8 +666,14 @@ greeter_layout (GreeterItemInfo *root_item,
   root_item->allocation.y = 0;
   root_item->allocation.width = root_item->width;
   root_item->allocation.height = root_item->height;
+
+  items_measured = 0;
+  items_allocated = 0;
   
   greeter_size_allocate_fixed (root_item,
 			       root_item->fixed_children,
 			       canvas);
+
+  mdm_common_debug ("greeter_layout: measured %d items, allocated %d",
+		    items_measured, items_allocated);
 }
@@ -113,6 +113,7 @@ greeter_item_info_free (GreeterItemInfo *info)
         {
           if (info->data.text.fonts[i] != NULL)
             pango_font_description_free (info->data.text.fonts[i]);
+          g_free (info->data.text.font_names[i]);
 	}
     }
 
@@ -126,8 +127,12 @@ greeter_item_info_free (GreeterItemInfo *info)
   g_list_foreach (list, (GFunc) greeter_item_info_free, NULL);
   g_list_free (list);
 
-  if (GREETER_ITEM_TYPE_IS_TEXT (info))
-    g_free (info->data.text.orig_text);
+  if (GREETER_ITEM_TYPE_IS_TEXT (info) ||
+      info->item_type == GREETER_ITEM_TYPE_BUTTON)
+    {
+      g_free (info->data.text.orig_text);
+      g_free (info->data.text.stock_type);
+    }
 
   /* FIXME: what about custom list items! */
 
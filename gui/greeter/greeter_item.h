@@ -128,6 +128,9 @@ struct _GreeterItemInfo {
   /* geometry handling: */
   guint has_requisition:1;
   GtkRequisition requisition;
+  /* the parent size the requisition was worked out for */
+  gint requisition_parent_width;
+  gint requisition_parent_height;
   GtkAllocation allocation;
 
   /* Button can propagate states and collect states from underlying items,
@@ -161,7 +164,9 @@ struct _GreeterItemInfo {
 					true/false values */
 
 		  PangoFontDescription *fonts[GREETER_ITEM_STATE_MAX];
+		  char *font_names[GREETER_ITEM_STATE_MAX]; /* as in the theme */
 		  char *orig_text;
+		  char *stock_type; /* orig_text is the stock text for this */
 		  guint16 max_width;
 		  guint8 max_screen_percent_width;
 		  guint16 real_max_width;
@@ -20,6 +20,9 @@
 
 #include <gtk/gtk.h>
 #include <time.h>
+
+#include "mdmcommon.h"
+
 #include "greeter_item_clock.h"
 #include "greeter_parser.h"
 
@@ -35,11 +38,12 @@ update_clock (gpointer data)
 
   time (&the_time);
   the_tm = localtime (&the_time);
-  /* account for leap seconds */
-  time_til_next_min = 60 - the_tm->tm_sec;
+  /* account for leap seconds, and wait a second longer as the
+   * timeout may fire a little early and show the old minute again */
+  time_til_next_min = 60 - the_tm->tm_sec + 1;
   time_til_next_min = (time_til_next_min>=0?time_til_next_min:0);
 
-  g_timeout_add (time_til_next_min*1000, update_clock, info);
+  mdm_common_timeout_add_seconds (time_til_next_min, update_clock, info);
 
   return FALSE;
 }
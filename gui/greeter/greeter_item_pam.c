@@ -206,6 +206,9 @@ pam_key_release_event (GtkWidget *entry, GdkEventKey *event, gpointer data)
              else
 		     gtk_widget_set_sensitive (GTK_WIDGET (gtk_ok_button), FALSE);
           }
+
+       if (greeter_probably_login_prompt)
+          greeter_item_ulist_filter (gtk_entry_get_text (GTK_ENTRY (entry)));
     }
   return FALSE;
 }
@@ -381,9 +384,9 @@ greeter_item_pam_error (const char *message)
       if (strlen (message) == 0)
 	err_box_clear_handler = 0;
       else
-	err_box_clear_handler = g_timeout_add (30000,
-					       error_clear,
-					       error_info);
+	err_box_clear_handler = mdm_common_timeout_add_seconds (30,
+								error_clear,
+								error_info);
       greeter_item_pam_error_set (TRUE);
     }
 }
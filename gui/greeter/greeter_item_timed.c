@@ -22,6 +22,7 @@
 #include <glib/gi18n.h>
 
 #include "mdm.h"
+#include "mdmcommon.h"
 #include "mdmconfig.h"
 
 #include "mdm-common.h"
@@ -135,7 +136,7 @@ greeter_item_timed_start (void)
       timeddelay > 0)
     {
       mdm_timed_delay  = timeddelay;
-      timed_handler_id = g_timeout_add (1000, mdm_timer, NULL);
+      timed_handler_id = mdm_common_timeout_add_seconds (1, mdm_timer, NULL);
     }
 }
 
@@ -38,6 +38,7 @@
 #include "mdmcomm.h"
 #include "mdmconfig.h"
 #include "mdmuser.h"
+#include "mdmtrace.h"
 
 #include "mdm-common.h"
 #include "mdm-socket-protocol.h"
@@ -172,53 +173,91 @@ mdm_greeter_users_init (void)
 		mdm_common_warning ("Can't open DefaultFace: %s!", mdm_config_get_string (MDM_KEY_DEFAULT_FACE));
 	}
 
+	mdm_trace_begin ("mdm_users_init");
 	mdm_users_init (&users, &users_string, NULL, defface, &size_of_users, MDM_IS_LOCAL, !DOING_MDM_DEVELOPMENT);
+	mdm_trace_end ("mdm_users_init");
 }
 
 static void
-greeter_populate_user_list (GtkTreeModel *tm)
+greeter_add_user (GtkTreeModel *tm, MdmUser *usr)
 {
-	GList *li;
+	GtkTreeIter iter = {0};
+	char       *label;
+	char       *name;
+	gboolean    active;
+
+	if (usr->gecos && strcmp (usr->gecos, "") != 0) {
+		name = mdm_common_text_to_escaped_utf8 (usr->gecos);
+	} else {
+		name = mdm_common_text_to_escaped_utf8 (usr->login);
+	}
 
-	for (li = users; li != NULL; li = li->next) {
-		MdmUser    *usr = li->data;
-		GtkTreeIter iter = {0};
-		char       *label;
-		char       *name;
-		gboolean    active;
-
-		if (usr->gecos && strcmp (usr->gecos, "") != 0) {
-			name = mdm_common_text_to_escaped_utf8 (usr->gecos);
-		} else {
-			name = mdm_common_text_to_escaped_utf8 (usr->login);
-		}
+	if (displays_hash != NULL &&
+	    g_hash_table_lookup (displays_hash, usr->login))
+		active = TRUE;
+	else
+		active = FALSE;
+
+	if (active) {
+		label = g_strdup_printf ("<b>%s</b>\n    <i><small>%s</small></i>",
+					 name,
+					 _("Already logged in"));
+	} else {
+		label = g_strdup_printf ("<b>%s</b>\n",
+					 name);
+	}
 
-		if (g_hash_table_lookup (displays_hash, usr->login))
-			active = TRUE;
-		else
-			active = FALSE;
-
-		if (active) {
-			label = g_strdup_printf ("<b>%s</b>\n    <i><small>%s</small></i>",
-						 name,
-						 _("Already logged in"));
-		} else {
-			label = g_strdup_printf ("<b>%s</b>\n",
-						 name);
-		}
+	g_free (name);
+
+	gtk_list_store_append (GTK_LIST_STORE (tm), &iter);
+	gtk_list_store_set (GTK_LIST_STORE (tm), &iter,
+			    GREETER_ULIST_ICON_COLUMN, usr->picture,
+			    GREETER_ULIST_LOGIN_COLUMN, usr->login,
+			    GREETER_ULIST_LABEL_COLUMN, label,
+			    GREETER_ULIST_ACTIVE_COLUMN, active,
+			    -1);
+	mdm_users_set_picture_row (usr, &iter);
+	g_free (label);
+}
+
+static void
+greeter_show_users (GList *visible, gpointer data)
+{
+	GtkTreeModel *filter = data;
+	GtkTreeModel *tm;
+	GtkTreeSelection *selection;
+	GList *li;
 
-		g_free (name);
-
-		gtk_list_store_append (GTK_LIST_STORE (tm), &iter);
-		gtk_list_store_set (GTK_LIST_STORE (tm), &iter,
-				    GREETER_ULIST_ICON_COLUMN, usr->picture,
-				    GREETER_ULIST_LOGIN_COLUMN, usr->login,
-				    GREETER_ULIST_LABEL_COLUMN, label,
-				    GREETER_ULIST_ACTIVE_COLUMN, active,
-				    -1);
-		g_free (label);
-		num_users++;
+	tm = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter));
+
+	/* rows stay once added, the filter hides the ones not matching */
+	for (li = visible; li != NULL; li = li->next) {
+		if ( ! mdm_users_has_picture_row (li->data))
+			greeter_add_user (tm, li->data);
 	}
+	gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (filter));
+
+	/* the selected user may have been filtered out and back in */
+	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (user_list));
+	if (selected_user != NULL &&
+	    ! gtk_tree_selection_get_selected (selection, NULL, NULL))
+		greeter_item_ulist_set_user (selected_user);
+
+	num_users = g_list_length (users);
+}
+
+static void
+greeter_populate_user_list (GtkTreeModel *filter)
+{
+	/* only the users matching what has been typed are shown */
+	mdm_users_set_view_func (greeter_show_users, filter);
+}
+
+/* The login typed so far, to narrow down the list with */
+void
+greeter_item_ulist_filter (const char *login)
+{
+	mdm_users_filter (login);
 }
 
 void
@@ -269,6 +308,7 @@ static void
 greeter_generate_userlist (GtkWidget *tv, GreeterItemInfo *info)
 {
 	GtkTreeModel *tm;
+	GtkTreeModel *filter;
 	GtkTreeViewColumn *column_one, *column_two;
 	GtkTreeSelection *selection;
 	GList *list, *li;
@@ -298,7 +338,16 @@ greeter_generate_userlist (GtkWidget *tv, GreeterItemInfo *info)
 							 G_TYPE_STRING,
 							 G_TYPE_STRING,
 							 G_TYPE_BOOLEAN);
-		gtk_tree_view_set_model (GTK_TREE_VIEW (tv), tm);
+		filter = gtk_tree_model_filter_new (tm, NULL);
+		gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (filter),
+							mdm_users_row_visible,
+							GINT_TO_POINTER (GREETER_ULIST_LOGIN_COLUMN),
+							NULL);
+
+		gtk_tree_view_set_model (GTK_TREE_VIEW (tv), filter);
+		mdm_users_set_picture_store (GTK_LIST_STORE (tm),
+					     GREETER_ULIST_ICON_COLUMN);
+		mdm_trace_mark_expose (tv, "user_list_expose");
 		column_one = gtk_tree_view_column_new_with_attributes (_("Icon"),
 								       gtk_cell_renderer_pixbuf_new (),
 								       "pixbuf", GREETER_ULIST_ICON_COLUMN,
@@ -311,7 +360,7 @@ greeter_generate_userlist (GtkWidget *tv, GreeterItemInfo *info)
 								       NULL);
 		gtk_tree_view_append_column (GTK_TREE_VIEW (tv), column_two);
 
-		greeter_populate_user_list (tm);
+		greeter_populate_user_list (filter);
 
 		list = gtk_tree_view_column_get_cell_renderers (column_one);
 		for (li = list; li != NULL; li = li->next) {
@@ -331,10 +380,6 @@ greeter_generate_userlist (GtkWidget *tv, GreeterItemInfo *info)
 					      info->data.list.label_color, NULL);
 		}
 	}
-
-	/* we are done with the hash */
-	g_hash_table_destroy (displays_hash);
-	displays_hash = NULL;
 }
 
 static inline void
@@ -39,6 +39,7 @@
 #include "greeter_configuration.h"
 #include "greeter_parser.h"
 #include "greeter_events.h"
+#include "greeter_theme_cache.h"
 #include "mdm.h"
 
 /* FIXME: hack */
@@ -307,6 +308,56 @@ parse_pos (xmlNodePtr       node,
   return TRUE;
 }
 
+/* The text for a stock label, NULL if there is no such type */
+static char *
+stock_text (const char      *type,
+	    GreeterItemInfo *info)
+{
+  if (g_ascii_strcasecmp (type, "language") == 0)
+    return g_strdup (_("_Language"));
+  else if (g_ascii_strcasecmp (type, "session") == 0)
+    return g_strdup (_("_Session"));
+  else if (g_ascii_strcasecmp (type, "system") == 0)
+    return g_strdup (_("_Actions"));
+  else if (g_ascii_strcasecmp (type, "disconnect") == 0)
+    return g_strdup (_("D_isconnect"));
+  else if (g_ascii_strcasecmp (type, "quit") == 0)
+    return g_strdup (_("_Quit"));
+  else if (g_ascii_strcasecmp (type, "halt") == 0)
+    return g_strdup (_("Shut _Down"));
+  else if (g_ascii_strcasecmp (type, "suspend") == 0)
+    return g_strdup (_("Sus_pend"));
+  else if (g_ascii_strcasecmp (type, "reboot") == 0)
+    return g_strdup (_("_Restart"));
+  else if (g_ascii_strcasecmp (type, "chooser") == 0)
+    return g_strdup (_("Remote Login via _XDMCP"));
+  else if (g_ascii_strcasecmp (type, "config") == 0)
+    return g_strdup (_("Confi_gure"));
+  else if (g_ascii_strcasecmp (type, "options") == 0)
+    return g_strdup (_("Op_tions"));
+  else if (g_ascii_strcasecmp (type, "caps-lock-warning") == 0)
+    return g_strdup (_("Caps Lock is on."));
+  else if (g_ascii_strcasecmp (type, "timed-label") == 0)
+    return g_strdup (_("User %u will login in %t"));
+  else if (g_ascii_strcasecmp (type, "welcome-label") == 0)
+    {
+      /* FIXME: hack */
+      welcome_string_info = info;
+      return mdm_common_get_welcomemsg ();
+    }
+  /* FIXME: is this actually needed? */
+  else if (g_ascii_strcasecmp (type, "username-label") == 0)
+    return g_strdup (_("Username:"));
+  else if (g_ascii_strcasecmp (type, "ok") == 0)
+    return g_strdup (_("_OK"));
+  else if (g_ascii_strcasecmp (type, "cancel") == 0)
+    return g_strdup (_("_Cancel"));
+  else if (g_ascii_strcasecmp (type, "startagain") == 0)
+    return g_strdup (_("_Start Again"));
+
+  return NULL;
+}
+
 /* We pass the same arguments as to translated text, since we'll override it
  * with translation score */
 static gboolean
@@ -317,115 +368,29 @@ parse_stock (xmlNodePtr node,
 	     GError   **error)
 {
   xmlChar *prop;
-  int i = -1;
-  gchar * key_string = NULL;
+  char *text;
 
   prop = xmlGetProp (node,(const xmlChar *) "type");
   if (prop)
     {
-      if (g_ascii_strcasecmp ((char *) prop, "language") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Language"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "session") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Session"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "system") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Actions"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "disconnect") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("D_isconnect"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "quit") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Quit"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "halt") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Shut _Down"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "suspend") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Sus_pend"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "reboot") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Restart"));
-	}  
-      else if (g_ascii_strcasecmp ((char *) prop, "chooser") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Remote Login via _XDMCP"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "config") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Confi_gure"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "options") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Op_tions"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "caps-lock-warning") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Caps Lock is on."));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "timed-label") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("User %u will login in %t"));
+      text = stock_text ((char *) prop, info);
+      if (text == NULL)
+	{
+	  g_set_error (error,
+		       GREETER_PARSER_ERROR,
+		       GREETER_PARSER_ERROR_BAD_SPEC,
+		       "Bad stock label type");
+	  xmlFree (prop);
+	  return FALSE;
 	}
-      else if (g_ascii_strcasecmp ((char *) prop, "welcome-label") == 0)
-        {
-	  /* FIXME: hack */
-	  welcome_string_info = info;
 
-	  g_free (*translated_text);
-	  *translated_text = mdm_common_get_welcomemsg ();
-	}
-      /* FIXME: is this actually needed? */
-      else if (g_ascii_strcasecmp ((char *) prop, "username-label") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("Username:"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "ok") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_OK"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "cancel") == 0)
-        {
-	  g_free (*translated_text);
-	  *translated_text = g_strdup (_("_Cancel"));
-	}
-      else if (g_ascii_strcasecmp ((char *) prop, "startagain") == 0)
-        {
-          g_free (*translated_text);
-          *translated_text = g_strdup (_("_Start Again"));
-        }     
-      else
-      {
-	      g_set_error (error,
-			   GREETER_PARSER_ERROR,
-			   GREETER_PARSER_ERROR_BAD_SPEC,
-			   "Bad stock label type");
-	      xmlFree (prop);
-	      return FALSE;	      
-	}
+      g_free (*translated_text);
+      *translated_text = text;
+
+      /* Remembered for the theme cache, the text itself depends
+       * on the configuration */
+      g_free (info->data.text.stock_type);
+      info->data.text.stock_type = g_strdup ((char *) prop);
 
       /* This is the very very very best "translation" */
       *translation_score = -1;
@@ -470,6 +435,16 @@ do_font_size_reduction (GreeterItemInfo *info)
 }
 
 
+static void
+set_default_font (GreeterItemInfo *info)
+{
+  if (info->data.text.fonts[GREETER_ITEM_STATE_NORMAL] == NULL) {
+	  info->data.text.fonts[GREETER_ITEM_STATE_NORMAL] = pango_font_description_from_string ("Sans");
+	  if (gtk_widget_get_default_style()->font_desc)
+		pango_font_description_merge (info->data.text.fonts[GREETER_ITEM_STATE_NORMAL], gtk_widget_get_default_style()->font_desc, FALSE);
+  }
+}
+
 static gboolean
 parse_canvasbutton (xmlNodePtr node,
 		    GreeterItemInfo *info,
@@ -1191,6 +1166,8 @@ parse_state_text (xmlNodePtr node,
 	  xmlFree (prop);
 	  return FALSE;
 	}
+      g_free (info->data.text.font_names[state]);
+      info->data.text.font_names[state] = g_strdup ((char *) prop);
       xmlFree (prop);
     }
   
@@ -1428,12 +1405,7 @@ parse_label (xmlNodePtr        node,
       info->data.text.colors[i] = (info->data.text.colors[i] << 8) | (guint) info->data.text.alphas[i];
     }
   
-  if (info->data.text.fonts[GREETER_ITEM_STATE_NORMAL] == NULL) {
-	  info->data.text.fonts[GREETER_ITEM_STATE_NORMAL] = pango_font_description_from_string ("Sans");
-	  if (gtk_widget_get_default_style()->font_desc)
-		pango_font_description_merge (info->data.text.fonts[GREETER_ITEM_STATE_NORMAL], gtk_widget_get_default_style()->font_desc, FALSE);
-  }
-
+  set_default_font (info);
   do_font_size_reduction (info);
 
   info->data.text.orig_text = translated_text;
@@ -1785,32 +1757,196 @@ greeter_info_id_hash (GreeterItemInfo *key)
   return g_str_hash (key->id);
 }
 
-GreeterItemInfo *
-greeter_parse (const char *file, const char *datadir,
-	       GnomeCanvas *canvas,
-	       int width, int height, GError **error)
+/* Sets up what the theme cache does not keep, the same way the
+ * parse_* functions do */
+static gboolean
+setup_cached_items (GList   *items,
+		    GError **error)
+{
+  GList *li;
+  gboolean res;
+  int i;
+
+  for (li = items; li != NULL; li = li->next)
+    {
+      GreeterItemInfo *info = li->data;
+
+      res = TRUE;
+
+      if (info->id != NULL)
+	g_hash_table_insert (item_hash, info, info);
+
+      if (button_stack != NULL)
+	info->my_button = button_stack->data;
+      if (info->canvasbutton)
+	button_stack = g_list_prepend (button_stack, info);
+
+      switch (info->item_type)
+	{
+	case GREETER_ITEM_TYPE_LABEL:
+	case GREETER_ITEM_TYPE_ENTRY:
+	  for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	    {
+	      if (info->data.text.font_names[i] != NULL)
+		info->data.text.fonts[i] = pango_font_description_from_string (info->data.text.font_names[i]);
+	    }
+	  if (info->item_type == GREETER_ITEM_TYPE_LABEL)
+	    set_default_font (info);
+	  do_font_size_reduction (info);
+	  /* fall through */
+
+	case GREETER_ITEM_TYPE_BUTTON:
+	  if (info->data.text.stock_type != NULL)
+	    {
+	      g_free (info->data.text.orig_text);
+	      info->data.text.orig_text = stock_text (info->data.text.stock_type, info);
+	      if G_UNLIKELY (info->data.text.orig_text == NULL)
+		{
+		  g_set_error (error,
+			       GREETER_PARSER_ERROR,
+			       GREETER_PARSER_ERROR_BAD_SPEC,
+			       "Bad stock label type");
+		  res = FALSE;
+		}
+	    }
+	  break;
+
+	case GREETER_ITEM_TYPE_PIXMAP:
+	  for (i = 0; res && i < GREETER_ITEM_STATE_MAX; i++)
+	    {
+	      if (info->data.pixmap.files[i] != NULL)
+		{
+		  info->data.pixmap.pixbufs[i] = load_pixbuf (info->data.pixmap.files[i], error);
+		  if G_UNLIKELY (info->data.pixmap.pixbufs[i] == NULL)
+		    res = FALSE;
+		}
+	    }
+	  break;
+
+	case GREETER_ITEM_TYPE_LIST:
+	  if (info->data.list.items != NULL ||
+	      (info->id != NULL &&
+	       (strcmp (info->id, "session") == 0 ||
+		strcmp (info->id, "language") == 0)))
+	    custom_items = g_list_append (custom_items, info);
+	  break;
+
+	default:
+	  break;
+	}
+
+      if (res)
+	res = setup_cached_items (info->fixed_children, error) &&
+	      setup_cached_items (info->box_children, error);
+
+      if (info->canvasbutton)
+	button_stack = g_list_remove (button_stack, info);
+
+      if G_UNLIKELY (!res)
+	return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* The theme's own gtkrc and gtk-theme have to be in place before the
+ * items are set up, the default font comes from them */
+static void
+load_theme_gtk_settings (const char *file,
+			 const char *gtk_theme)
+{
+  char *dirtheme, *gtkrc;
+
+  dirtheme = g_path_get_dirname (file);
+  gtkrc = g_build_filename (dirtheme, "gtk-2.0", "gtkrc", NULL);
+  if (g_file_test (gtkrc, G_FILE_TEST_IS_REGULAR))
+    gtk_rc_parse (gtkrc);
+  g_free (dirtheme);
+  g_free (gtkrc);
+
+  /*
+   * The gtk-theme property specifies a theme specific gtk-theme to use
+   */
+  if (gtk_theme != NULL)
+    {
+      gchar *theme_dir;
+
+      /*
+       * It might be nice if we allowed this property to also supply a gtkrc file
+       * that could be included in the theme.  Perhaps we should check first in
+       * the theme directory for a gtkrc file by the provided name and use that
+       * if found.
+       */
+      theme_dir = g_strdup_printf ("%s/%s", gtk_rc_get_theme_dir (), gtk_theme);
+      if (g_file_test (theme_dir, G_FILE_TEST_IS_DIR))
+         mdm_set_theme (gtk_theme);
+      g_free (theme_dir);
+    }
+}
+
+static void
+forget_items (GList *items)
+{
+  welcome_string_info = NULL;
+
+  g_hash_table_destroy (item_hash);
+  item_hash = NULL;
+  g_list_free (custom_items);
+  custom_items = NULL;
+
+  g_list_free (button_stack);
+  button_stack = NULL;
+
+  g_list_foreach (items, (GFunc) greeter_item_info_free, NULL);
+  g_list_free (items);
+}
+
+static gboolean
+greeter_parse_cached (const char       *file,
+		      const char       *cache_file,
+		      const char       *stamp,
+		      GreeterItemInfo  *root,
+		      GList           **items_out)
+{
+  GList *items;
+  char *gtk_theme;
+  GError *error = NULL;
+
+  if (!greeter_theme_cache_load (cache_file, stamp, root, &items, &gtk_theme))
+    return FALSE;
+
+  load_theme_gtk_settings (file, gtk_theme);
+  g_free (gtk_theme);
+
+  item_hash = g_hash_table_new ((GHashFunc)greeter_info_id_hash,
+				(GEqualFunc)greeter_info_id_equal);
+
+  if G_UNLIKELY (!setup_cached_items (items, &error))
+    {
+      mdm_common_debug ("Not using the cached theme %s: %s",
+			file, error ? error->message : "");
+      if (error)
+	g_error_free (error);
+      forget_items (items);
+      return FALSE;
+    }
+
+  *items_out = items;
+  return TRUE;
+}
+
+static gboolean
+greeter_parse_xml (const char       *file,
+		   GreeterItemInfo  *root,
+		   GList           **items_out,
+		   char            **gtk_theme_out,
+		   GError          **error)
 {
-  GreeterItemInfo *root;
   xmlDocPtr doc;
   xmlNodePtr node;
   xmlChar *prop;
   gboolean res;
   GList *items;
-  char *dirtheme, *gtkrc;
-  
-  /* FIXME: EVIL! GLOBAL! */
-  g_free (file_search_path);
-  file_search_path = g_strdup (datadir);
-  
-  if G_UNLIKELY (!g_file_test (file, G_FILE_TEST_EXISTS))
-    {
-      g_set_error (error,
-		   GREETER_PARSER_ERROR,
-		   GREETER_PARSER_ERROR_NO_FILE,
-		   "Can't open file %s", file);
-      return NULL;
-    }
-  
 
   doc = xmlParseFile (file);
   if G_UNLIKELY (doc == NULL)
@@ -1819,7 +1955,7 @@ greeter_parse (const char *file, const char *datadir,
 		   GREETER_PARSER_ERROR,
 		   GREETER_PARSER_ERROR_BAD_XML,
 		   "XML Parse error reading %s", file);
-      return NULL;
+      return FALSE;
     }
   
   node = xmlDocGetRootElement (doc);
@@ -1830,7 +1966,7 @@ greeter_parse (const char *file, const char *datadir,
 		   GREETER_PARSER_ERROR,
 		   GREETER_PARSER_ERROR_BAD_XML,
 		   "Can't find the xml root node in file %s", file);
-      return NULL;
+      return FALSE;
     }
   
   if G_UNLIKELY (strcmp ((char *) node->name, "greeter") != 0)
@@ -1840,43 +1976,83 @@ greeter_parse (const char *file, const char *datadir,
 		   GREETER_PARSER_ERROR,
 		   GREETER_PARSER_ERROR_WRONG_TYPE,
 		   "The file %s has the wrong xml type", file);
-      return NULL;
+      return FALSE;
     }
 
-  dirtheme = g_path_get_dirname (file);
-  gtkrc = g_build_filename (dirtheme, "gtk-2.0", "gtkrc", NULL);
-  if (g_file_test (gtkrc, G_FILE_TEST_IS_REGULAR))
-    gtk_rc_parse (gtkrc);
-  g_free (dirtheme);
-  g_free (gtkrc);
-
-  /*
-   * The gtk-theme property specifies a theme specific gtk-theme to use
-   */
   prop = xmlGetProp (node, (const xmlChar *) "gtk-theme");
+  *gtk_theme_out = prop ? g_strdup ((char *) prop) : NULL;
   if (prop)
-    {
-      gchar *theme_dir;
+    xmlFree (prop);
 
-      /*
-       * It might be nice if we allowed this property to also supply a gtkrc file
-       * that could be included in the theme.  Perhaps we should check first in
-       * the theme directory for a gtkrc file by the provided name and use that
-       * if found.
-       */
-      theme_dir = g_strdup_printf ("%s/%s", gtk_rc_get_theme_dir (), (char *) prop);
-      if (g_file_test (theme_dir, G_FILE_TEST_IS_DIR))
-         mdm_set_theme ((char *) prop);
-
-      xmlFree (prop);
-    }
+  load_theme_gtk_settings (file, *gtk_theme_out);
 
   item_hash = g_hash_table_new ((GHashFunc)greeter_info_id_hash,
 				(GEqualFunc)greeter_info_id_equal);
   
+  res = parse_items (node, &items, root, error);
+
+  xmlFreeDoc (doc);
+
+  if G_UNLIKELY (!res)
+    {
+      forget_items (items);
+      g_free (*gtk_theme_out);
+      *gtk_theme_out = NULL;
+
+      return FALSE;
+    }
+
+  *items_out = items;
+  return TRUE;
+}
+
+GreeterItemInfo *
+greeter_parse (const char *file, const char *datadir,
+	       GnomeCanvas *canvas,
+	       int width, int height, GError **error)
+{
+  GreeterItemInfo *root;
+  GList *items;
+  char *cache_file;
+  char *stamp = NULL;
+  char *gtk_theme = NULL;
+  gboolean res;
+  
+  /* FIXME: EVIL! GLOBAL! */
+  g_free (file_search_path);
+  file_search_path = g_strdup (datadir);
+  
+  if G_UNLIKELY (!g_file_test (file, G_FILE_TEST_EXISTS))
+    {
+      g_set_error (error,
+		   GREETER_PARSER_ERROR,
+		   GREETER_PARSER_ERROR_NO_FILE,
+		   "Can't open file %s", file);
+      return NULL;
+    }
 
   root = greeter_item_info_new (NULL, GREETER_ITEM_TYPE_RECT);
-  res = parse_items (node, &items, root, error);
+
+  cache_file = greeter_theme_cache_file ();
+  if (cache_file != NULL)
+    stamp = greeter_theme_cache_stamp (file, datadir);
+
+  if (stamp != NULL &&
+      greeter_parse_cached (file, cache_file, stamp, root, &items))
+    {
+      mdm_common_debug ("Read the theme %s from %s", file, cache_file);
+      res = TRUE;
+    }
+  else
+    {
+      res = greeter_parse_xml (file, root, &items, &gtk_theme, error);
+      if (res && stamp != NULL)
+	greeter_theme_cache_save (cache_file, stamp, items, gtk_theme);
+    }
+
+  g_free (cache_file);
+  g_free (stamp);
+  g_free (gtk_theme);
 
   /* Now we can whack the hash, we don't want to keep cached
      pixbufs around anymore */
@@ -1887,29 +2063,10 @@ greeter_parse (const char *file, const char *datadir,
 
   if G_UNLIKELY (!res)
     {
-      welcome_string_info = NULL;
-
-      g_hash_table_destroy (item_hash);
-      item_hash = NULL;
-      g_list_free (custom_items);
-      custom_items = NULL;
-
-      g_list_free (button_stack);
-      button_stack = NULL;
-
-      g_list_foreach (items, (GFunc) greeter_item_info_free, NULL);
-      g_list_free (items);
-      items = NULL;
-
       greeter_item_info_free (root);
-
-      xmlFreeDoc (doc);
-
       return NULL;
     }
 
-  xmlFreeDoc (doc);
-
   root->fixed_children = items;
   
   root->x = 0;
@@ -0,0 +1,145 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "greeter_pixbuf_cache.h"
+
+/* A few screens' worth of full size theme images */
+#define PIXBUF_CACHE_BUDGET (32 * 1024 * 1024)
+
+typedef struct {
+  GreeterPixbufKey key;   /* owns key.file */
+  GdkPixbuf       *pixbuf;
+  gsize            bytes;
+  GList           *link;  /* in lru, the most recently used first */
+} CacheEntry;
+
+static GHashTable *pixbuf_cache = NULL;
+static GQueue      lru = G_QUEUE_INIT;
+static gsize       cache_bytes = 0;
+
+static guint
+key_hash (gconstpointer data)
+{
+  const GreeterPixbufKey *key = data;
+  guint hash;
+
+  hash = g_str_hash (key->file);
+  hash = hash * 31 + key->width;
+  hash = hash * 31 + key->height;
+  hash = hash * 31 + key->tint;
+  hash = hash * 31 + key->alpha;
+  hash = hash * 31 + (key->svg ? 1 : 0);
+
+  return hash;
+}
+
+static gboolean
+key_equal (gconstpointer a,
+	   gconstpointer b)
+{
+  const GreeterPixbufKey *ka = a;
+  const GreeterPixbufKey *kb = b;
+
+  return ka->width == kb->width &&
+	 ka->height == kb->height &&
+	 ka->tint == kb->tint &&
+	 ka->alpha == kb->alpha &&
+	 ! ka->svg == ! kb->svg &&
+	 strcmp (ka->file, kb->file) == 0;
+}
+
+static void
+entry_free (CacheEntry *entry)
+{
+  g_object_unref (entry->pixbuf);
+  g_free ((char *) entry->key.file);
+  g_free (entry);
+}
+
+static void
+remove_entry (CacheEntry *entry)
+{
+  g_queue_delete_link (&lru, entry->link);
+  cache_bytes -= entry->bytes;
+  /* the table only frees the entry, it is its own key */
+  g_hash_table_remove (pixbuf_cache, &entry->key);
+}
+
+GdkPixbuf *
+greeter_pixbuf_cache_lookup (const GreeterPixbufKey *key)
+{
+  CacheEntry *entry;
+
+  if (pixbuf_cache == NULL || key->file == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (pixbuf_cache, key);
+  if (entry == NULL)
+    return NULL;
+
+  if (entry->link != lru.head)
+    {
+      g_queue_unlink (&lru, entry->link);
+      g_queue_push_head_link (&lru, entry->link);
+    }
+
+  return g_object_ref (entry->pixbuf);
+}
+
+void
+greeter_pixbuf_cache_insert (const GreeterPixbufKey *key,
+			     GdkPixbuf              *pixbuf)
+{
+  CacheEntry *entry;
+  gsize bytes;
+
+  if (key->file == NULL || pixbuf == NULL)
+    return;
+
+  bytes = (gsize) gdk_pixbuf_get_rowstride (pixbuf) *
+	  gdk_pixbuf_get_height (pixbuf);
+  if (bytes > PIXBUF_CACHE_BUDGET)
+    return;
+
+  if (pixbuf_cache == NULL)
+    pixbuf_cache = g_hash_table_new_full (key_hash, key_equal,
+					  NULL, (GDestroyNotify) entry_free);
+
+  entry = g_hash_table_lookup (pixbuf_cache, key);
+  if (entry != NULL)
+    remove_entry (entry);
+
+  while (cache_bytes + bytes > PIXBUF_CACHE_BUDGET)
+    remove_entry (g_queue_peek_tail (&lru));
+
+  entry = g_new0 (CacheEntry, 1);
+  entry->key = *key;
+  entry->key.file = g_strdup (key->file);
+  entry->pixbuf = g_object_ref (pixbuf);
+  entry->bytes = bytes;
+
+  g_queue_push_head (&lru, entry);
+  entry->link = lru.head;
+  cache_bytes += bytes;
+
+  g_hash_table_insert (pixbuf_cache, &entry->key, entry);
+}
@@ -0,0 +1,44 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __GREETER_PIXBUF_CACHE_H__
+#define __GREETER_PIXBUF_CACHE_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/* Scaled, faded and tinted theme images, so that items showing the
+ * same image the same way share one pixbuf.  Least recently used
+ * images go first once the cache is over its byte budget. */
+
+#define GREETER_PIXBUF_NO_TINT G_MAXUINT32
+
+typedef struct {
+  const char *file;
+  gboolean    svg;    /* rendered at the size rather than scaled */
+  int         width;
+  int         height;
+  guint32     tint;   /* GREETER_PIXBUF_NO_TINT if not tinted */
+  guint8      alpha;
+} GreeterPixbufKey;
+
+/* Returns a new reference, NULL if not cached */
+GdkPixbuf *greeter_pixbuf_cache_lookup (const GreeterPixbufKey *key);
+void       greeter_pixbuf_cache_insert (const GreeterPixbufKey *key,
+					GdkPixbuf              *pixbuf);
+
+#endif /* __GREETER_PIXBUF_CACHE_H__ */
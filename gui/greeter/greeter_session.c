@@ -32,6 +32,7 @@
 #include "mdmcommon.h"
 #include "mdmconfig.h"
 #include "mdmsession.h"
+#include "mdmtrace.h"
 
 #include "mdm-common.h"
 #include "mdm-daemon-config-keys.h"
@@ -125,7 +126,9 @@ greeter_session_init (void)
   vbox = gtk_vbox_new (FALSE, 6);
   /* we will pack this later depending on size */
 
+    mdm_trace_begin ("mdm_session_list_init");
     mdm_session_list_init ();
+    mdm_trace_end ("mdm_session_list_init");
 
     for (tmp = sessions; tmp != NULL; tmp = tmp->next)
       {
@@ -0,0 +1,577 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <locale.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <gtk/gtk.h>
+
+#include "mdmcommon.h"
+#include "mdmconfig.h"
+
+#include "mdm-common.h"
+#include "mdm-daemon-config-keys.h"
+
+#include "greeter_item.h"
+#include "greeter_theme_cache.h"
+
+#define THEME_CACHE_MAGIC "MDM-THEME 1"
+
+/* Themes nest a few levels at most, anything deeper is not ours */
+#define THEME_CACHE_MAX_DEPTH 64
+
+#define NO_STRING 0xffffffff
+
+/*
+ * The file is the stamp followed by the gtk-theme attribute and the
+ * items, in document order, each with its children after it.  Numbers
+ * are 32 bit in host order and strings are a length followed by the
+ * bytes, the cache never leaves the machine that wrote it.
+ */
+
+typedef struct {
+  const guchar *p;
+  const guchar *end;
+  gboolean      ok;
+} CacheReader;
+
+char *
+greeter_theme_cache_file (void)
+{
+  const char *dir;
+  const char *locale;
+  char *name;
+  char *file;
+
+  dir = mdm_config_get_string (MDM_KEY_SERV_AUTHDIR);
+  if (ve_string_empty (dir))
+    return NULL;
+
+  /* The texts are picked by locale, so keep one cache per locale */
+  locale = setlocale (LC_MESSAGES, NULL);
+  if (ve_string_empty (locale))
+    locale = "C";
+
+  name = g_strdup_printf (".mdm-theme-%s", locale);
+  g_strdelimit (name, "/", '_');
+  file = g_build_filename (dir, name, NULL);
+  g_free (name);
+
+  return file;
+}
+
+char *
+greeter_theme_cache_stamp (const char *theme_file,
+			   const char *datadir)
+{
+  struct stat s;
+  struct stat dir_s;
+  char *langs;
+  char *stamp;
+
+  if (theme_file == NULL || datadir == NULL ||
+      stat (theme_file, &s) != 0 ||
+      stat (datadir, &dir_s) != 0)
+    return NULL;
+
+  /* The theme directory mtime covers the altfiles that were picked
+   * because they existed */
+  langs = g_strjoinv (":", (char **) g_get_language_names ());
+  stamp = g_strdup_printf (THEME_CACHE_MAGIC "\t%s\t%ld\t%ld\t%s\t%ld\t%s\t%s",
+			   theme_file,
+			   (long) s.st_mtime,
+			   (long) s.st_size,
+			   datadir,
+			   (long) dir_s.st_mtime,
+			   VERSION,
+			   langs);
+  g_free (langs);
+
+  return stamp;
+}
+
+static void
+put_u32 (GString *buf, guint32 val)
+{
+  g_string_append_len (buf, (const char *) &val, sizeof (val));
+}
+
+static void
+put_float (GString *buf, float val)
+{
+  g_string_append_len (buf, (const char *) &val, sizeof (val));
+}
+
+static void
+put_string (GString *buf, const char *str)
+{
+  if (str == NULL)
+    {
+      put_u32 (buf, NO_STRING);
+      return;
+    }
+
+  put_u32 (buf, strlen (str));
+  g_string_append (buf, str);
+}
+
+static void save_items (GString *buf, GList *items);
+
+static void
+save_item (GString *buf, GreeterItemInfo *info)
+{
+  GList *li;
+  int i;
+
+  put_u32 (buf, info->item_type);
+  put_u32 (buf, info->anchor);
+  put_float (buf, info->x);
+  put_float (buf, info->y);
+  put_float (buf, info->width);
+  put_float (buf, info->height);
+  put_u32 (buf, info->minimum_required_screen_width);
+  put_u32 (buf, info->minimum_required_screen_height);
+  put_u32 (buf, info->x_type);
+  put_u32 (buf, info->y_type);
+  put_u32 (buf, info->width_type);
+  put_u32 (buf, info->height_type);
+  put_u32 (buf, info->x_negative |
+	        info->y_negative << 1 |
+	        info->expand << 2 |
+	        info->box_homogeneous << 3 |
+	        info->canvasbutton << 4 |
+	        info->gtkbutton << 5 |
+	        info->background << 6);
+  put_u32 (buf, info->show_modes);
+  put_u32 (buf, info->have_state);
+  put_string (buf, info->show_type);
+  put_string (buf, info->id);
+  put_u32 (buf, info->box_orientation);
+  put_u32 (buf, info->box_x_padding);
+  put_u32 (buf, info->box_y_padding);
+  put_u32 (buf, info->box_min_width);
+  put_u32 (buf, info->box_min_height);
+  put_u32 (buf, info->box_spacing);
+
+  switch (info->item_type)
+    {
+    case GREETER_ITEM_TYPE_LABEL:
+    case GREETER_ITEM_TYPE_ENTRY:
+    case GREETER_ITEM_TYPE_BUTTON:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  put_u32 (buf, info->data.text.alphas[i]);
+	  put_u32 (buf, info->data.text.colors[i]);
+	  put_string (buf, info->data.text.font_names[i]);
+	}
+      put_u32 (buf, info->data.text.have_color);
+      put_string (buf, info->data.text.stock_type);
+      /* Stock texts come from the configuration, they are looked
+       * up again on loading */
+      put_string (buf, info->data.text.stock_type == NULL ?
+		  info->data.text.orig_text : NULL);
+      put_u32 (buf, info->data.text.max_width);
+      put_u32 (buf, info->data.text.max_screen_percent_width);
+      break;
+
+    case GREETER_ITEM_TYPE_PIXMAP:
+    case GREETER_ITEM_TYPE_SVG:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  put_u32 (buf, info->data.pixmap.alphas[i]);
+	  put_u32 (buf, info->data.pixmap.tints[i]);
+	  put_string (buf, info->data.pixmap.files[i]);
+	}
+      put_u32 (buf, info->data.pixmap.have_tint);
+      break;
+
+    case GREETER_ITEM_TYPE_LIST:
+      put_string (buf, info->data.list.icon_color);
+      put_string (buf, info->data.list.label_color);
+      put_u32 (buf, info->data.list.combo_type);
+      put_u32 (buf, g_list_length (info->data.list.items));
+      for (li = info->data.list.items; li != NULL; li = li->next)
+	{
+	  GreeterItemListItem *lit = li->data;
+
+	  put_string (buf, lit->id);
+	  put_string (buf, lit->text);
+	}
+      break;
+
+    case GREETER_ITEM_TYPE_RECT:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  put_u32 (buf, info->data.rect.alphas[i]);
+	  put_u32 (buf, info->data.rect.colors[i]);
+	}
+      put_u32 (buf, info->data.rect.have_color);
+      break;
+    }
+
+  save_items (buf, info->fixed_children);
+  save_items (buf, info->box_children);
+}
+
+static void
+save_items (GString *buf, GList *items)
+{
+  GList *li;
+
+  put_u32 (buf, g_list_length (items));
+  for (li = items; li != NULL; li = li->next)
+    save_item (buf, li->data);
+}
+
+void
+greeter_theme_cache_save (const char *file,
+			  const char *stamp,
+			  GList      *items,
+			  const char *gtk_theme)
+{
+  GString *buf;
+
+  buf = g_string_new (NULL);
+  put_string (buf, stamp);
+  put_string (buf, gtk_theme);
+  save_items (buf, items);
+
+  /* g_file_set_contents writes a temporary file and renames it
+   * into place, so a greeter never reads a half written cache */
+  if ( ! g_file_set_contents (file, buf->str, buf->len, NULL))
+    mdm_common_debug ("Could not write the theme cache %s", file);
+
+  g_string_free (buf, TRUE);
+}
+
+static guint32
+get_u32 (CacheReader *r)
+{
+  guint32 val;
+
+  if (! r->ok || (gsize) (r->end - r->p) < sizeof (val))
+    {
+      r->ok = FALSE;
+      return 0;
+    }
+
+  memcpy (&val, r->p, sizeof (val));
+  r->p += sizeof (val);
+
+  return val;
+}
+
+static float
+get_float (CacheReader *r)
+{
+  float val;
+
+  if (! r->ok || (gsize) (r->end - r->p) < sizeof (val))
+    {
+      r->ok = FALSE;
+      return 0;
+    }
+
+  memcpy (&val, r->p, sizeof (val));
+  r->p += sizeof (val);
+
+  return val;
+}
+
+static char *
+get_string (CacheReader *r)
+{
+  guint32 len;
+  char *str;
+
+  len = get_u32 (r);
+  if (! r->ok || len == NO_STRING)
+    return NULL;
+
+  if ((gsize) (r->end - r->p) < len ||
+      memchr (r->p, '\0', len) != NULL)
+    {
+      r->ok = FALSE;
+      return NULL;
+    }
+
+  str = g_strndup ((const char *) r->p, len);
+  r->p += len;
+
+  return str;
+}
+
+/* Reads a value that has to be at most max */
+static guint32
+get_enum (CacheReader *r, guint32 max)
+{
+  guint32 val = get_u32 (r);
+
+  if (val > max)
+    r->ok = FALSE;
+
+  return val;
+}
+
+static void
+free_list_items (GreeterItemInfo *info)
+{
+  GList *li;
+
+  /* greeter_item_info_free leaves these */
+  for (li = info->data.list.items; li != NULL; li = li->next)
+    {
+      GreeterItemListItem *lit = li->data;
+
+      g_free (lit->id);
+      g_free (lit->text);
+      g_free (lit);
+    }
+  g_list_free (info->data.list.items);
+  info->data.list.items = NULL;
+
+  g_free (info->data.list.icon_color);
+  g_free (info->data.list.label_color);
+}
+
+static void
+free_items (GList *items)
+{
+  GList *li;
+
+  for (li = items; li != NULL; li = li->next)
+    {
+      GreeterItemInfo *info = li->data;
+
+      if (GREETER_ITEM_TYPE_IS_LIST (info))
+	free_list_items (info);
+      free_items (info->fixed_children);
+      info->fixed_children = NULL;
+      free_items (info->box_children);
+      info->box_children = NULL;
+      greeter_item_info_free (info);
+    }
+  g_list_free (items);
+}
+
+static gboolean load_items (CacheReader      *r,
+			    GreeterItemInfo  *parent,
+			    int               depth,
+			    GList           **items_out);
+
+static GreeterItemInfo *
+load_item (CacheReader *r, GreeterItemInfo *parent, int depth)
+{
+  GreeterItemInfo *info;
+  GreeterItemType type;
+  guint32 flags;
+  guint32 n;
+  guint32 j;
+  int i;
+
+  type = get_enum (r, GREETER_ITEM_TYPE_BUTTON);
+  if (! r->ok)
+    return NULL;
+
+  info = greeter_item_info_new (parent, type);
+
+  info->anchor = get_enum (r, GTK_ANCHOR_SE);
+  info->x = get_float (r);
+  info->y = get_float (r);
+  info->width = get_float (r);
+  info->height = get_float (r);
+  info->minimum_required_screen_width = get_u32 (r);
+  info->minimum_required_screen_height = get_u32 (r);
+  info->x_type = get_enum (r, GREETER_ITEM_POS_RELATIVE);
+  info->y_type = get_enum (r, GREETER_ITEM_POS_RELATIVE);
+  info->width_type = get_enum (r, GREETER_ITEM_SIZE_SCALE);
+  info->height_type = get_enum (r, GREETER_ITEM_SIZE_SCALE);
+  flags = get_u32 (r);
+  info->x_negative = (flags & (1 << 0)) != 0;
+  info->y_negative = (flags & (1 << 1)) != 0;
+  info->expand = (flags & (1 << 2)) != 0;
+  info->box_homogeneous = (flags & (1 << 3)) != 0;
+  info->canvasbutton = (flags & (1 << 4)) != 0;
+  info->gtkbutton = (flags & (1 << 5)) != 0;
+  info->background = (flags & (1 << 6)) != 0;
+  info->show_modes = get_enum (r, GREETER_ITEM_SHOW_EVERYWHERE);
+  info->have_state = get_enum (r, (1 << GREETER_ITEM_STATE_MAX) - 1);
+  info->show_type = get_string (r);
+  info->id = get_string (r);
+  info->box_orientation = get_enum (r, GTK_ORIENTATION_VERTICAL);
+  info->box_x_padding = get_u32 (r);
+  info->box_y_padding = get_u32 (r);
+  info->box_min_width = get_u32 (r);
+  info->box_min_height = get_u32 (r);
+  info->box_spacing = get_u32 (r);
+
+  switch (info->item_type)
+    {
+    case GREETER_ITEM_TYPE_LABEL:
+    case GREETER_ITEM_TYPE_ENTRY:
+    case GREETER_ITEM_TYPE_BUTTON:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  info->data.text.alphas[i] = get_enum (r, 0xff);
+	  info->data.text.colors[i] = get_u32 (r);
+	  info->data.text.font_names[i] = get_string (r);
+	}
+      info->data.text.have_color = get_enum (r, (1 << GREETER_ITEM_STATE_MAX) - 1);
+      info->data.text.stock_type = get_string (r);
+      info->data.text.orig_text = get_string (r);
+      info->data.text.max_width = get_enum (r, 0xffff);
+      info->data.text.max_screen_percent_width = get_enum (r, 0xff);
+      break;
+
+    case GREETER_ITEM_TYPE_PIXMAP:
+    case GREETER_ITEM_TYPE_SVG:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  info->data.pixmap.alphas[i] = get_enum (r, 0xff);
+	  info->data.pixmap.tints[i] = get_u32 (r);
+	  info->data.pixmap.files[i] = get_string (r);
+	}
+      info->data.pixmap.have_tint = get_enum (r, (1 << GREETER_ITEM_STATE_MAX) - 1);
+      break;
+
+    case GREETER_ITEM_TYPE_LIST:
+      info->data.list.icon_color = get_string (r);
+      info->data.list.label_color = get_string (r);
+      info->data.list.combo_type = get_enum (r, TRUE);
+      n = get_u32 (r);
+      for (j = 0; r->ok && j < n; j++)
+	{
+	  GreeterItemListItem *lit = g_new0 (GreeterItemListItem, 1);
+
+	  lit->id = get_string (r);
+	  lit->text = get_string (r);
+	  info->data.list.items = g_list_prepend (info->data.list.items, lit);
+	}
+      info->data.list.items = g_list_reverse (info->data.list.items);
+      break;
+
+    case GREETER_ITEM_TYPE_RECT:
+      for (i = 0; i < GREETER_ITEM_STATE_MAX; i++)
+	{
+	  info->data.rect.alphas[i] = get_enum (r, 0xff);
+	  info->data.rect.colors[i] = get_u32 (r);
+	}
+      info->data.rect.have_color = get_enum (r, (1 << GREETER_ITEM_STATE_MAX) - 1);
+      break;
+    }
+
+  if (! r->ok ||
+      ! load_items (r, info, depth + 1, &info->fixed_children) ||
+      ! load_items (r, info, depth + 1, &info->box_children))
+    {
+      r->ok = FALSE;
+      free_items (g_list_prepend (NULL, info));
+      return NULL;
+    }
+
+  return info;
+}
+
+static gboolean
+load_items (CacheReader      *r,
+	    GreeterItemInfo  *parent,
+	    int               depth,
+	    GList           **items_out)
+{
+  GList *items = NULL;
+  guint32 n;
+  guint32 i;
+
+  *items_out = NULL;
+
+  n = get_u32 (r);
+  if (! r->ok || depth > THEME_CACHE_MAX_DEPTH)
+    return FALSE;
+
+  for (i = 0; i < n; i++)
+    {
+      GreeterItemInfo *info = load_item (r, parent, depth);
+
+      if (info == NULL)
+	{
+	  free_items (g_list_reverse (items));
+	  return FALSE;
+	}
+      items = g_list_prepend (items, info);
+    }
+
+  *items_out = g_list_reverse (items);
+  return TRUE;
+}
+
+/**
+ * greeter_theme_cache_load
+ *
+ * Reads the items that were saved with @stamp, as children of @root.
+ * Returns FALSE if there is no such cache or it does not add up.
+ */
+gboolean
+greeter_theme_cache_load (const char       *file,
+			  const char       *stamp,
+			  GreeterItemInfo  *root,
+			  GList           **items_out,
+			  char            **gtk_theme_out)
+{
+  CacheReader r;
+  char *contents;
+  gsize len;
+  char *file_stamp;
+  char *gtk_theme;
+  GList *items = NULL;
+
+  if (! g_file_get_contents (file, &contents, &len, NULL))
+    return FALSE;
+
+  r.p = (const guchar *) contents;
+  r.end = r.p + len;
+  r.ok = TRUE;
+
+  file_stamp = get_string (&r);
+  if (file_stamp == NULL || strcmp (file_stamp, stamp) != 0)
+    {
+      g_free (file_stamp);
+      g_free (contents);
+      return FALSE;
+    }
+  g_free (file_stamp);
+
+  gtk_theme = get_string (&r);
+  if (! load_items (&r, root, 0, &items) || r.p != r.end)
+    {
+      free_items (items);
+      g_free (gtk_theme);
+      g_free (contents);
+      mdm_common_debug ("Ignoring the broken theme cache %s", file);
+      return FALSE;
+    }
+
+  g_free (contents);
+
+  *items_out = items;
+  *gtk_theme_out = gtk_theme;
+  return TRUE;
+}
@@ -0,0 +1,43 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __GREETER_THEME_CACHE_H__
+#define __GREETER_THEME_CACHE_H__
+
+#include "greeter_item.h"
+
+/* The parsed item tree of a theme, kept in ServAuthDir so that later
+ * starts need neither libxml nor the parse.  Only what comes from the
+ * XML is stored: fonts, stock texts, pixbufs and the lookup tables
+ * are set up again by the parser after loading. */
+
+char     *greeter_theme_cache_file  (void);
+char     *greeter_theme_cache_stamp (const char       *theme_file,
+				     const char       *datadir);
+
+gboolean  greeter_theme_cache_load  (const char       *file,
+				     const char       *stamp,
+				     GreeterItemInfo  *root,
+				     GList           **items_out,
+				     char            **gtk_theme_out);
+void      greeter_theme_cache_save  (const char       *file,
+				     const char       *stamp,
+				     GList            *items,
+				     const char       *gtk_theme);
+
+#endif /* __GREETER_THEME_CACHE_H__ */
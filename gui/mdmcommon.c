@@ -30,9 +30,13 @@
 #include <time.h>
 #include <sys/utsname.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gdk/gdkx.h>
 #include <gtk/gtk.h>
 
@@ -40,6 +44,7 @@
 #include "mdmcommon.h"
 #include "mdmcomm.h"
 #include "mdmconfig.h"
+#include "mdmpixops.h"
 
 #include "mdm-common.h"
 #include "mdm-log.h"
@@ -62,6 +67,9 @@ static Atom AT_SPI_IOR;
  */
 static gboolean using_syslog = FALSE;
 
+/* With debugging on the timers count how often they wake us up */
+static gboolean count_wakeups = FALSE;
+
 void
 mdm_common_log_init (void)
 {
@@ -74,6 +82,7 @@ void
 mdm_common_log_set_debug (gboolean enable)
 {
 	mdm_log_set_debug (enable);
+	count_wakeups = enable;
 }
 
 void
@@ -197,6 +206,70 @@ mdm_common_debug (const gchar *format, ...)
 	g_free (s);
 }
 
+typedef struct {
+	GSourceFunc func;
+	gpointer    data;
+} MdmTimeout;
+
+static void
+count_wakeup (void)
+{
+	static gint64 last_second = -1;
+	static gint64 last_minute = -1;
+	static guint  wakeups = 0;
+	gint64        now = g_get_monotonic_time () / G_USEC_PER_SEC;
+
+	/* Timers that are due on the same second share the wakeup */
+	if (now == last_second)
+		return;
+	last_second = now;
+
+	if (now / 60 != last_minute) {
+		if (last_minute >= 0)
+			mdm_common_debug ("Timers woke the greeter up %u times in %d minute(s)",
+					  wakeups, (int) (now / 60 - last_minute));
+		last_minute = now / 60;
+		wakeups = 0;
+	}
+	wakeups++;
+}
+
+static gboolean
+timeout_dispatch (gpointer data)
+{
+	MdmTimeout *timeout = data;
+
+	count_wakeup ();
+
+	return timeout->func (timeout->data);
+}
+
+/*
+ * All the periodic work of the greeters goes through here.  Timeouts
+ * in seconds all fire on the same whole second, so the clock, the
+ * timed login countdown and the other timers wake the process up
+ * together rather than each at its own moment.  The price is that a
+ * timer may fire up to a quarter of a second early, so anything that
+ * must not run before a given second has to allow for that.
+ */
+guint
+mdm_common_timeout_add_seconds (guint       interval,
+				GSourceFunc func,
+				gpointer    data)
+{
+	MdmTimeout *timeout;
+
+	if ( ! count_wakeups)
+		return g_timeout_add_seconds (interval, func, data);
+
+	timeout = g_new (MdmTimeout, 1);
+	timeout->func = func;
+	timeout->data = data;
+
+	return g_timeout_add_seconds_full (G_PRIORITY_DEFAULT, interval,
+					   timeout_dispatch, timeout, g_free);
+}
+
 void
 mdm_common_setup_cursor (GdkCursorType type)
 {
@@ -277,7 +350,7 @@ typedef struct {
 static GSList *entries = NULL;
 static guint noblink_timeout = 0;
 
-#define NOBLINK_TIMEOUT (20*1000)
+#define NOBLINK_TIMEOUT 20 /* seconds */
 
 static void
 setup_blink (gboolean blink)
@@ -313,7 +386,7 @@ delay_noblink (GSignalInvocationHint *ihint,
 	if (noblink_timeout > 0)
 		g_source_remove (noblink_timeout);
 	noblink_timeout
-		= g_timeout_add (NOBLINK_TIMEOUT, no_blink, NULL);
+		= mdm_common_timeout_add_seconds (NOBLINK_TIMEOUT, no_blink, NULL);
 	return TRUE;
 }
 
@@ -356,7 +429,7 @@ mdm_common_setup_blinking (void)
 					    NULL /* destroy_notify */);
 	}
 
-	noblink_timeout = g_timeout_add (NOBLINK_TIMEOUT, no_blink, NULL);
+	noblink_timeout = mdm_common_timeout_add_seconds (NOBLINK_TIMEOUT, no_blink, NULL);
 }
 
 void
@@ -378,6 +451,125 @@ mdm_common_setup_blinking_entry (GtkWidget *entry)
 	entries = g_slist_prepend (entries, eb);
 }
 
+/* The reaping stuff, flexi displays nobody uses go away */
+static time_t last_reap_delay = 0;
+static void (*reap_cleanup) (void) = NULL;
+
+static gboolean
+delay_reaping (GSignalInvocationHint *ihint,
+	       guint	           n_param_values,
+	       const GValue	  *param_values,
+	       gpointer		   data)
+{
+	last_reap_delay = time (NULL);
+	return TRUE;
+}
+
+static gboolean
+reap_flexiserver (gpointer data)
+{
+	int reapminutes = mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES);
+
+	if (reapminutes > 0 &&
+	    ((time (NULL) - last_reap_delay) / 60) > reapminutes) {
+		if (reap_cleanup != NULL)
+			(*reap_cleanup) ();
+		_exit (DISPLAY_REMANAGE);
+	}
+	return TRUE;
+}
+
+static void
+start_reaping (void)
+{
+	static gboolean started = FALSE;
+	guint sid;
+
+	/* nested flexis are not reaped */
+	if (started ||
+	    mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES) <= 0 ||
+	    ve_string_empty (g_getenv ("MDM_FLEXI_SERVER")) ||
+	    ! ve_string_empty (g_getenv ("MDM_PARENT_DISPLAY")))
+		return;
+	started = TRUE;
+
+	sid = g_signal_lookup ("activate",
+			       GTK_TYPE_MENU_ITEM);
+	g_signal_add_emission_hook (sid,
+				    0 /* detail */,
+				    delay_reaping,
+				    NULL /* data */,
+				    NULL /* destroy_notify */);
+
+	sid = g_signal_lookup ("key_press_event",
+			       GTK_TYPE_WIDGET);
+	g_signal_add_emission_hook (sid,
+				    0 /* detail */,
+				    delay_reaping,
+				    NULL /* data */,
+				    NULL /* destroy_notify */);
+
+	sid = g_signal_lookup ("button_press_event",
+			       GTK_TYPE_WIDGET);
+	g_signal_add_emission_hook (sid,
+				    0 /* detail */,
+				    delay_reaping,
+				    NULL /* data */,
+				    NULL /* destroy_notify */);
+
+	last_reap_delay = time (NULL);
+	mdm_common_timeout_add_seconds (60, reap_flexiserver, NULL);
+}
+
+/* The slave sends SIGUSR1 when our pre-started display is handed
+ * out, from then on it is reaped like any other */
+static gboolean
+flexi_taken (int sig, gpointer data)
+{
+	start_reaping ();
+	return TRUE;
+}
+
+/*
+ * If we are on a flexi display, exit once nobody has used it for
+ * FlexiReapDelayMinutes, calling @cleanup first.  Pre-started ones
+ * wait for the slave to tell them they were handed out.  The slave
+ * starts those with SIGUSR1 blocked so that the signal waits for us,
+ * it's unblocked here in any case so that nothing we run inherits
+ * the block.
+ */
+void
+mdm_common_setup_reaping (void (*cleanup) (void))
+{
+	sigset_t mask;
+
+	reap_cleanup = cleanup;
+
+	if (ve_string_empty (g_getenv ("MDM_FLEXI_WARM"))) {
+		start_reaping ();
+	} else {
+		struct sigaction usr1;
+
+		ve_signal_add (SIGUSR1, flexi_taken, NULL);
+
+		usr1.sa_handler = ve_signal_notify;
+		usr1.sa_flags = 0;
+		sigemptyset (&usr1.sa_mask);
+		sigaddset (&usr1.sa_mask, SIGCHLD);
+
+		if G_UNLIKELY (sigaction (SIGUSR1, &usr1, NULL) < 0) {
+			if (cleanup != NULL)
+				(*cleanup) ();
+			mdm_common_fail_greeter ("%s: Error setting up %s signal handler: %s",
+						 "mdm_common_setup_reaping", "USR1", strerror (errno));
+		}
+	}
+
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGUSR1);
+	sigprocmask (SIG_UNBLOCK, &mask, NULL);
+}
+
 GdkPixbuf *
 mdm_common_get_face (const char *filename,
 		     const char *fallback_filename,
@@ -607,7 +799,297 @@ mdm_common_set_root_background (GdkPixbuf *pb)
 	gdk_error_trap_pop ();
 }
 
+/*
+ * The composited background is kept in ServAuthDir, one file per
+ * display:
+ *
+ *   MDM-BACKGROUND 1
+ *   <image>\t<mtime>\t<size>\t<screen>\t<monitors>\t<color>
+ *   <width> <height> <rowstride> <has_alpha>
+ *   <rowstride * height bytes of pixels>
+ *
+ * If the second line matches, the pixels are mapped and drawn without
+ * decoding, scaling or blending anything.
+ */
+#define BG_CACHE_MAGIC "MDM-BACKGROUND 1"
 
+static char *
+bg_cache_file (void)
+{
+	const char *authdir = mdm_config_get_string (MDM_KEY_SERV_AUTHDIR);
+	char       *display;
+	char       *name;
+	char       *file;
+
+	if (ve_string_empty (authdir))
+		return NULL;
+
+	display = g_strdup (ve_sure_string (g_getenv ("DISPLAY")));
+	g_strcanon (display, G_CSET_a_2_z G_CSET_A_2_Z G_CSET_DIGITS, '_');
+	name = g_strconcat (".mdm-background-", display, NULL);
+	file = g_build_filename (authdir, name, NULL);
+	g_free (name);
+	g_free (display);
+
+	return file;
+}
+
+static char *
+bg_cache_key (const char         *image,
+	      GdkColor           *color,
+	      const GdkRectangle *monitors,
+	      int                 n_monitors)
+{
+	struct stat s;
+	GString    *key;
+	int         i;
+
+	if (g_stat (image, &s) != 0 || strchr (image, '\n') != NULL)
+		return NULL;
+
+	key = g_string_new (NULL);
+	g_string_append_printf (key, "%s\t%ld\t%ld\t%dx%d\t",
+				image, (long) s.st_mtime, (long) s.st_size,
+				gdk_screen_width (), gdk_screen_height ());
+	for (i = 0; i < n_monitors; i++)
+		g_string_append_printf (key, "%d,%d,%d,%d;",
+					monitors[i].x, monitors[i].y,
+					monitors[i].width, monitors[i].height);
+	if (color != NULL)
+		g_string_append_printf (key, "\t#%02x%02x%02x",
+					color->red >> 8, color->green >> 8, color->blue >> 8);
+	else
+		g_string_append (key, "\t-");
+
+	return g_string_free (key, FALSE);
+}
+
+static void
+bg_cache_unmap (guchar *pixels, gpointer data)
+{
+	g_mapped_file_unref ((GMappedFile *) data);
+}
+
+static GdkPixbuf *
+bg_cache_load (const char *file, const char *key)
+{
+	GMappedFile *map;
+	const char  *data;
+	gsize        len;
+	char        *header;
+	gsize        header_len;
+	const char  *eol;
+	char         line[64];
+	int          width, height, rowstride, has_alpha;
+	gsize        n;
+
+	map = g_mapped_file_new (file, FALSE, NULL);
+	if (map == NULL)
+		return NULL;
+
+	data = g_mapped_file_get_contents (map);
+	len = g_mapped_file_get_length (map);
+
+	header = g_strdup_printf ("%s\n%s\n", BG_CACHE_MAGIC, key);
+	header_len = strlen (header);
+	if (len <= header_len || memcmp (data, header, header_len) != 0) {
+		g_free (header);
+		g_mapped_file_unref (map);
+		return NULL;
+	}
+	g_free (header);
+
+	/* The file only ever comes from bg_cache_save, but it sits in a
+	 * directory the greeter can write to, so check it adds up */
+	eol = memchr (data + header_len, '\n', MIN (len - header_len, sizeof (line) - 1));
+	if (eol == NULL) {
+		g_mapped_file_unref (map);
+		return NULL;
+	}
+	n = eol - (data + header_len) + 1;
+	memcpy (line, data + header_len, n);
+	line[n] = '\0';
+
+	if (sscanf (line, "%d %d %d %d", &width, &height, &rowstride, &has_alpha) != 4 ||
+	    width != gdk_screen_width () ||
+	    height != gdk_screen_height () ||
+	    rowstride < width * (has_alpha ? 4 : 3) ||
+	    len - header_len - n != (gsize) rowstride * height) {
+		g_mapped_file_unref (map);
+		return NULL;
+	}
+
+	return gdk_pixbuf_new_from_data ((const guchar *) data + header_len + n,
+					 GDK_COLORSPACE_RGB, has_alpha, 8,
+					 width, height, rowstride,
+					 bg_cache_unmap, map);
+}
+
+static gboolean
+bg_cache_write (int fd, const guchar *buf, gsize len)
+{
+	ssize_t ret;
+
+	while (len > 0) {
+		VE_IGNORE_EINTR (ret = write (fd, buf, len));
+		if (ret <= 0)
+			return FALSE;
+		buf += ret;
+		len -= ret;
+	}
+
+	return TRUE;
+}
+
+static void
+bg_cache_save (const char *file, const char *key, GdkPixbuf *pb)
+{
+	int           width = gdk_pixbuf_get_width (pb);
+	int           height = gdk_pixbuf_get_height (pb);
+	int           rowstride = gdk_pixbuf_get_rowstride (pb);
+	int           row_len = width * gdk_pixbuf_get_n_channels (pb);
+	const guchar *pixels = gdk_pixbuf_get_pixels (pb);
+	guchar       *pad;
+	char         *header;
+	char         *tmp;
+	gboolean      ok;
+	int           fd;
+
+	tmp = g_strconcat (file, ".XXXXXX", NULL);
+	fd = g_mkstemp_full (tmp, O_WRONLY, 0644);
+	if (fd < 0) {
+		mdm_common_debug ("Cannot write background cache %s: %s", tmp, strerror (errno));
+		g_free (tmp);
+		return;
+	}
+
+	header = g_strdup_printf ("%s\n%s\n%d %d %d %d\n", BG_CACHE_MAGIC, key,
+				  width, height, rowstride,
+				  gdk_pixbuf_get_has_alpha (pb) ? 1 : 0);
+
+	/* The last row of a pixbuf is not padded out to the rowstride */
+	pad = g_malloc0 (rowstride - row_len + 1);
+	ok = bg_cache_write (fd, (guchar *) header, strlen (header)) &&
+	     bg_cache_write (fd, pixels, (gsize) rowstride * (height - 1) + row_len) &&
+	     bg_cache_write (fd, pad, rowstride - row_len);
+	g_free (pad);
+	g_free (header);
+
+	VE_IGNORE_EINTR (close (fd));
+
+	if ( ! ok || g_rename (tmp, file) != 0) {
+		mdm_common_debug ("Cannot write background cache %s", file);
+		VE_IGNORE_EINTR (g_unlink (tmp));
+	}
+	g_free (tmp);
+}
+
+static GdkPixbuf *
+render_scaled_back (const GdkPixbuf    *pb,
+		    const GdkRectangle *monitors,
+		    int                 n_monitors)
+{
+	int i;
+	int width, height;
+
+	GdkPixbuf *back = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
+					  gdk_pixbuf_get_has_alpha (pb),
+					  8,
+					  gdk_screen_width (),
+					  gdk_screen_height ());
+
+	width = gdk_pixbuf_get_width (pb);
+	height = gdk_pixbuf_get_height (pb);
+
+	for (i = 0; i < n_monitors; i++) {
+		gdk_pixbuf_scale (pb, back,
+				  monitors[i].x,
+				  monitors[i].y,
+				  monitors[i].width,
+				  monitors[i].height,
+				  monitors[i].x /* offset_x */,
+				  monitors[i].y /* offset_y */,
+				  (double) monitors[i].width / width,
+				  (double) monitors[i].height / height,
+				  GDK_INTERP_BILINEAR);
+	}
+
+	return back;
+}
+
+static void
+add_color_to_pb (GdkPixbuf *pb, GdkColor *color)
+{
+	if ( ! gdk_pixbuf_get_has_alpha (pb))
+		return;
+
+	mdm_pixops_over_color (gdk_pixbuf_get_pixels (pb),
+			       gdk_pixbuf_get_width (pb),
+			       gdk_pixbuf_get_height (pb),
+			       gdk_pixbuf_get_rowstride (pb),
+			       ((color->red >> 8) << 16) |
+			       ((color->green >> 8) << 8) |
+			       (color->blue >> 8));
+}
+
+/**
+ * mdm_common_set_root_background_image
+ *
+ * Sets @image, scaled to each of @monitors, as the root window
+ * background.  With @blend_color transparent parts show @color.
+ * Returns FALSE if the image cannot be loaded.
+ */
+gboolean
+mdm_common_set_root_background_image (const gchar        *image,
+				      const gchar        *color,
+				      gboolean            blend_color,
+				      const GdkRectangle *monitors,
+				      gint                n_monitors)
+{
+	GdkColor   c;
+	GdkPixbuf *pb;
+	GdkPixbuf *back = NULL;
+	char      *file = NULL;
+	char      *key = NULL;
+
+	if (blend_color &&
+	    (ve_string_empty (color) || ! gdk_color_parse (color, &c)))
+		gdk_color_parse ("#000000", &c);
+
+	if (mdm_config_get_bool (MDM_KEY_BACKGROUND_CACHE)) {
+		file = bg_cache_file ();
+		key = bg_cache_key (image, blend_color ? &c : NULL, monitors, n_monitors);
+		if (file != NULL && key != NULL)
+			back = bg_cache_load (file, key);
+	}
+
+	if (back == NULL) {
+		pb = gdk_pixbuf_new_from_file (image, NULL);
+		if (pb == NULL) {
+			g_free (file);
+			g_free (key);
+			return FALSE;
+		}
+
+		if (blend_color)
+			add_color_to_pb (pb, &c);
+
+		back = render_scaled_back (pb, monitors, n_monitors);
+		g_object_unref (G_OBJECT (pb));
+
+		if (file != NULL && key != NULL)
+			bg_cache_save (file, key, back);
+	} else {
+		mdm_common_debug ("Background for %s from the cache", image);
+	}
+
+	mdm_common_set_root_background (back);
+	g_object_unref (G_OBJECT (back));
+	g_free (file);
+	g_free (key);
+
+	return TRUE;
+}
 
 gchar *
 mdm_common_get_welcomemsg (void)
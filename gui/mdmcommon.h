@@ -45,6 +45,9 @@ void	  mdm_common_debug		    (const gchar *format, ...)
 					     G_GNUC_PRINTF (1, 2);
 
 /* Misc. Common Functions */
+guint	  mdm_common_timeout_add_seconds    (guint        interval,
+					     GSourceFunc  func,
+					     gpointer     data);
 void	  mdm_common_setup_cursor	    (GdkCursorType type);
 
 void      mdm_common_setup_builtin_icons    (void);
@@ -55,6 +58,7 @@ void      mdm_common_login_sound            (const gchar *MdmSoundProgram,
 
 void	  mdm_common_setup_blinking	    (void);
 void	  mdm_common_setup_blinking_entry   (GtkWidget *entry);
+void	  mdm_common_setup_reaping	    (void (*cleanup) (void));
 
 GdkPixbuf *mdm_common_get_face              (const char *filename,
                                              const char *fallback_filename,
@@ -67,6 +71,11 @@ gchar*	  mdm_common_get_custom_config_file (void);
 gboolean  mdm_common_select_time_format	    (void);
 void	  mdm_common_setup_background_color (gchar *bg_color);
 void      mdm_common_set_root_background    (GdkPixbuf *pb);
+gboolean  mdm_common_set_root_background_image (const gchar        *image,
+                                             const gchar        *color,
+                                             gboolean            blend_color,
+                                             const GdkRectangle *monitors,
+                                             gint                n_monitors);
 gchar*	  mdm_common_get_welcomemsg	    (void);
 void	  mdm_common_pre_fetch_launch       (void);
 void      mdm_common_atspi_launch           (void);
@@ -27,6 +27,8 @@
 #include <locale.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 
 #include "mdm.h"
 #include "mdmwm.h"
@@ -35,10 +37,17 @@
 #include "mdmlanguages.h"
 
 #include "mdm-socket-protocol.h"
+#include "mdm-daemon-config-keys.h"
 
 #define LAST_LANGUAGE "Last"
 #define DEFAULT_LANGUAGE "Default"
 
+/* Resolving the locale file costs a setlocale() per candidate plus a
+ * collation pass, so the result is kept in ServAuthDir.  The first line
+ * of the cache records everything the result depends on. */
+#define LANG_CACHE_MAGIC "MDM-LANGUAGES 1"
+#define LANG_CACHE_LOCALEDIR "/usr/lib/locale"
+
 /*
  * This function does nothing for mdmlogin, but for mdmgreeter it sets the
  * custom list when the language list has changed in the language dialog
@@ -545,8 +554,33 @@ lang_collate (gconstpointer a, gconstpointer b)
 	return strcmp (l1->collate_key, l2->collate_key);
 }
 
-GList *
-mdm_lang_read_locale_file (const char *locale_file)
+static Language *
+lang_add (const char *name, const char *lang)
+{
+	Language *language;
+	const char *p;
+
+	language = g_new0 (Language, 1);
+	language->name = g_strdup (name);
+	/* only store the "lang_country" part of the locale code, so that we notice
+	 * if there is more than one encoding of this language. See bug 132629. */
+	p = strchr (lang, '.');
+	if (p == NULL)
+		p = strchr (lang, '@');
+	if (p != NULL)
+		language->code = g_strndup (lang, (p - lang));
+	else
+		language->code = g_strdup (lang);
+	language->untranslated = NULL;
+	g_hash_table_insert (lang_names,
+			     language->code,
+			     language);
+
+	return language;
+}
+
+static GList *
+lang_parse_locale_file (const char *locale_file)
 {
 	FILE *langlist;
 	char curline[256];
@@ -612,30 +646,21 @@ mdm_lang_read_locale_file (const char *locale_file)
 		if (language != NULL) {
 			language->found++;
 		} else {
-			language = g_new0 (Language, 1);
-			language->found = 1;
 			/* add a space before an open bracket to match
 			   the style used in the internal list.
 			   e.g. change "English(India)" to "English (India)" */
 			p = strchr (name, '(');
 			if (p != NULL && p > name && *(p-1) != ' ') {
-			  *p = 0;
-			  language->name= g_strconcat (name, " (", p+1, NULL);
-			} else
-			  language->name = g_strdup (name);
- 			/* only store the "lang_country" part of the locale code, so that we notice
- 			 * if there is more than one encoding of this language. See bug 132629. */
-			p = strchr (lang, '.');
- 			if (p == NULL)
- 			  p = strchr (lang, '@');
- 			if (p != NULL)
- 			  language->code = g_strndup (lang, (p - lang));
- 			else
- 			  language->code = g_strdup (lang);
-			language->untranslated = NULL;
-			g_hash_table_insert (lang_names,
-					     language->code,
-					     language);
+				char *spaced;
+
+				*p = 0;
+				spaced = g_strconcat (name, " (", p+1, NULL);
+				language = lang_add (spaced, lang);
+				g_free (spaced);
+			} else {
+				language = lang_add (name, lang);
+			}
+			language->found = 1;
 		}
 
 		langs = g_list_prepend (langs, g_strdup (lang));
@@ -655,6 +680,188 @@ mdm_lang_read_locale_file (const char *locale_file)
 	return langs;
 }
 
+static char *
+lang_cache_file (void)
+{
+	const char *dir;
+	const char *locale;
+	char *name;
+	char *file;
+
+	dir = mdm_config_get_string (MDM_KEY_SERV_AUTHDIR);
+	if (ve_string_empty (dir))
+		return NULL;
+
+	/* The display names and the collation order depend on the
+	 * greeter's own locale, so keep one cache per locale */
+	locale = setlocale (LC_MESSAGES, NULL);
+	if (ve_string_empty (locale))
+		locale = "C";
+
+	name = g_strdup_printf (".mdm-languages-%s", locale);
+	g_strdelimit (name, "/", '_');
+	file = g_build_filename (dir, name, NULL);
+	g_free (name);
+
+	return file;
+}
+
+static char *
+lang_cache_stamp (const char *locale_file)
+{
+	struct stat s;
+	struct stat dir_s;
+	struct stat archive_s;
+	const char *collate;
+	const char *language;
+
+	if (stat (locale_file, &s) != 0)
+		return NULL;
+
+	/* localedef adds locales either to the archive or as directories
+	 * next to it, so the mtime of both covers newly installed ones */
+	if (stat (LANG_CACHE_LOCALEDIR, &dir_s) != 0)
+		dir_s.st_mtime = 0;
+	if (stat (LANG_CACHE_LOCALEDIR "/locale-archive", &archive_s) != 0)
+		archive_s.st_mtime = 0;
+
+	collate = setlocale (LC_COLLATE, NULL);
+	language = g_getenv ("LANGUAGE");
+
+	return g_strdup_printf (LANG_CACHE_MAGIC "\t%s\t%ld\t%ld\t%ld\t%ld\t%s\t%s\t%s",
+				locale_file,
+				(long)s.st_mtime,
+				(long)s.st_size,
+				(long)dir_s.st_mtime,
+				(long)archive_s.st_mtime,
+				ve_sure_string (setlocale (LC_MESSAGES, NULL)),
+				ve_sure_string (collate),
+				ve_sure_string (language));
+}
+
+/* Each line after the stamp is "locale<TAB>found<TAB>name", already in
+ * collation order.  Returns NULL unless the whole cache is usable. */
+static GList *
+lang_cache_load (const char *file, const char *stamp)
+{
+	GList *langs = NULL;
+	char *contents;
+	char **lines;
+	gboolean ok;
+	int i;
+
+	if (!g_file_get_contents (file, &contents, NULL, NULL))
+		return NULL;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	ok = (lines[0] != NULL && strcmp (lines[0], stamp) == 0);
+
+	for (i = 1; ok && lines[i] != NULL; i++) {
+		char **fields;
+		Language *language;
+		gboolean clean;
+
+		if (lines[i][0] == '\0')
+			continue;
+
+		fields = g_strsplit (lines[i], "\t", 3);
+		if (g_strv_length (fields) != 3 ||
+		    fields[0][0] == '\0') {
+			g_strfreev (fields);
+			ok = FALSE;
+			break;
+		}
+
+		language = find_lang (fields[0], &clean);
+		if (language == NULL)
+			language = lang_add (fields[2], fields[0]);
+		language->found = atoi (fields[1]);
+
+		langs = g_list_prepend (langs, g_strdup (fields[0]));
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+
+	if (!ok) {
+		g_list_foreach (langs, (GFunc) g_free, NULL);
+		g_list_free (langs);
+		return NULL;
+	}
+
+	return g_list_reverse (langs);
+}
+
+static void
+lang_cache_save (const char *file, const char *stamp, GList *langs)
+{
+	GString *str;
+	GList *li;
+
+	str = g_string_new (stamp);
+	g_string_append_c (str, '\n');
+
+	for (li = langs; li != NULL; li = li->next) {
+		Language *language;
+		gboolean clean;
+
+		language = find_lang (li->data, &clean);
+		if (language == NULL)
+			continue;
+
+		g_string_append_printf (str, "%s\t%d\t%s\n",
+					(char *)li->data,
+					language->found,
+					language->name);
+	}
+
+	/* g_file_set_contents writes a temporary file and renames it
+	 * into place, so a greeter never reads a half written cache */
+	if (!g_file_set_contents (file, str->str, str->len, NULL))
+		mdm_common_debug ("Could not write the language cache %s", file);
+
+	g_string_free (str, TRUE);
+}
+
+GList *
+mdm_lang_read_locale_file (const char *locale_file)
+{
+	GList *langs;
+	char *file;
+	char *stamp;
+
+	if (locale_file == NULL)
+		return NULL;
+
+	mdm_lang_init ();
+
+	file = lang_cache_file ();
+	stamp = lang_cache_stamp (locale_file);
+
+	if (file != NULL && stamp != NULL) {
+		langs = lang_cache_load (file, stamp);
+		if (langs != NULL) {
+			mdm_common_debug ("Read %d languages from %s",
+					  g_list_length (langs), file);
+			g_free (file);
+			g_free (stamp);
+			return langs;
+		}
+	}
+
+	langs = lang_parse_locale_file (locale_file);
+
+	if (langs != NULL && file != NULL && stamp != NULL)
+		lang_cache_save (file, stamp, langs);
+
+	g_free (file);
+	g_free (stamp);
+
+	return langs;
+}
+
 GtkListStore *
 mdm_lang_get_model (void)
 {
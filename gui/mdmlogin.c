@@ -58,6 +58,7 @@
 #include "mdmlanguages.h"
 #include "mdmwm.h"
 #include "mdmconfig.h"
+#include "mdmtrace.h"
 #include "misc.h"
 
 #include "mdm-common.h"
@@ -112,6 +113,7 @@ static gboolean login_is_local = FALSE;
 
 static GtkWidget *browser;
 static GtkTreeModel *browser_model;
+static GtkTreeModel *browser_filter;
 static GdkPixbuf *defface;
 
 /* Eew. Loads of global vars. It's hard to be event controlled while maintaining state */
@@ -154,6 +156,8 @@ extern gboolean session_dir_whacked_out;
 extern gint mdm_timed_delay;
 
 static gboolean first_prompt = TRUE;
+/* the entry is asking for the username, so typing narrows the browser */
+static gboolean login_prompt = FALSE;
 
 static void login_window_resize (gboolean force);
 
@@ -301,9 +305,9 @@ back_prog_launch_after_timeout ()
 	
 	back_prog_delayed = FALSE;
 	back_prog_watch_events ();
-	back_prog_timeout_event_id = g_timeout_add (timeout * 1000,
-						    back_prog_on_timeout,
-						    NULL);
+	back_prog_timeout_event_id = mdm_common_timeout_add_seconds (timeout,
+								     back_prog_on_timeout,
+								     NULL);
 }
 
 static GtkWidget *
@@ -484,38 +488,12 @@ mdm_timer_up_delay (GSignalInvocationHint *ihint,
 	return TRUE;
 }
 
-/* The reaping stuff */
-static time_t last_reap_delay = 0;
-
-static gboolean
-delay_reaping (GSignalInvocationHint *ihint,
-	       guint	           n_param_values,
-	       const GValue	  *param_values,
-	       gpointer		   data)
-{
-	last_reap_delay = time (NULL);
-	return TRUE;
-}      
-
 static void
 mdm_kill_thingies (void)
 {
 	back_prog_stop ();
 }
 
-static gboolean
-reap_flexiserver (gpointer data)
-{
-	int reapminutes = mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES);
-
-	if (reapminutes > 0 &&
-	    ((time (NULL) - last_reap_delay) / 60) > reapminutes) {
-		mdm_kill_thingies ();
-		_exit (DISPLAY_REMANAGE);
-	}
-	return TRUE;
-}
-
 
 static gboolean
 mdm_event (GSignalInvocationHint *ihint,
@@ -769,7 +747,9 @@ mdm_login_session_init (GtkWidget *menu)
 
     current_session = NULL;
 
+    mdm_trace_begin ("mdm_session_list_init");
     mdm_session_list_init ();
+    mdm_trace_end ("mdm_session_list_init");
 
     for (tmp = sessions; tmp != NULL; tmp = tmp->next) {
 	    MdmSession *session;
@@ -827,7 +807,9 @@ mdm_login_language_menu_new (void)
     GtkWidget *menu;
     GtkWidget *item;
 
+    mdm_trace_begin ("mdm_lang_initialize_model");
     mdm_lang_initialize_model (mdm_config_get_string (MDM_KEY_LOCALE_FILE));
+    mdm_trace_end ("mdm_lang_initialize_model");
 
     menu = gtk_menu_new ();
 
@@ -1021,9 +1003,12 @@ process_operation (guchar       op_code,
 					mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE),
 					mdm_config_get_bool   (MDM_KEY_SOUND_ON_LOGIN));
 		gtk_label_set_text_with_mnemonic (GTK_LABEL (label), _("_Username:"));
+		login_prompt = TRUE;
+		mdm_users_filter (NULL);
 	} else {
 		if (tmp != NULL)
 			gtk_label_set_text (GTK_LABEL (label), tmp);
+		login_prompt = FALSE;
 	}
 	g_free (tmp);
 
@@ -1051,6 +1036,7 @@ process_operation (guchar       op_code,
 
     case MDM_NOECHO:
 	tmp = ve_locale_to_utf8 (args);
+	login_prompt = FALSE;
 	if (tmp != NULL && strcmp (tmp, _("Password:")) == 0) {
 		gtk_label_set_text_with_mnemonic (GTK_LABEL (label), _("_Password:"));
 	} else {
@@ -1129,9 +1115,9 @@ process_operation (guchar       op_code,
 	if (ve_string_empty (args))
 		err_box_clear_handler = 0;
 	else
-		err_box_clear_handler = g_timeout_add (30000,
-						       err_box_clear,
-						       NULL);
+		err_box_clear_handler = mdm_common_timeout_add_seconds (30,
+									err_box_clear,
+									NULL);
 	printf ("%c\n", STX);
 	fflush (stdout);
 
@@ -1291,7 +1277,7 @@ process_operation (guchar       op_code,
 	    ! ve_string_empty (mdm_config_get_string (MDM_KEY_TIMED_LOGIN)) &&
 	    mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY) > 0) {
 		mdm_timed_delay = mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY);
-		timed_handler_id  = g_timeout_add (1000, mdm_timer, NULL);
+		timed_handler_id  = mdm_common_timeout_add_seconds (1, mdm_timer, NULL);
 	}
 	printf ("%c\n", STX);
 	fflush (stdout);
@@ -1380,33 +1366,56 @@ process_operation (guchar       op_code,
 
 
 static void
-mdm_login_browser_populate (void)
+mdm_login_browser_add_user (MdmUser *usr)
+{
+    GtkTreeIter iter = {0};
+    char *label;
+    char *login, *gecos;
+
+    login = mdm_common_text_to_escaped_utf8 (usr->login);
+    gecos = mdm_common_text_to_escaped_utf8 (usr->gecos);
+
+    label = g_strdup_printf ("<b>%s</b>\n%s",
+			     login,
+			     gecos);
+
+    g_free (login);
+    g_free (gecos);
+    gtk_list_store_append (GTK_LIST_STORE (browser_model), &iter);
+    gtk_list_store_set (GTK_LIST_STORE (browser_model), &iter,
+			GREETER_ULIST_ICON_COLUMN, usr->picture,
+			GREETER_ULIST_LOGIN_COLUMN, usr->login,
+			GREETER_ULIST_LABEL_COLUMN, label,
+			-1);
+    mdm_users_set_picture_row (usr, &iter);
+    g_free (label);
+}
+
+static void
+mdm_login_browser_show_users (GList *visible, gpointer data)
 {
+    GtkTreeSelection *selection;
     GList *li;
 
-    for (li = users; li != NULL; li = li->next) {
-	    MdmUser *usr = li->data;
-	    GtkTreeIter iter = {0};
-	    char *label;
-	    char *login, *gecos;
-
-	    login = mdm_common_text_to_escaped_utf8 (usr->login);
-	    gecos = mdm_common_text_to_escaped_utf8 (usr->gecos);
-
-	    label = g_strdup_printf ("<b>%s</b>\n%s",
-				     login,
-				     gecos);
-
-	    g_free (login);
-	    g_free (gecos);
-	    gtk_list_store_append (GTK_LIST_STORE (browser_model), &iter);
-	    gtk_list_store_set (GTK_LIST_STORE (browser_model), &iter,
-				GREETER_ULIST_ICON_COLUMN, usr->picture,
-				GREETER_ULIST_LOGIN_COLUMN, usr->login,
-				GREETER_ULIST_LABEL_COLUMN, label,
-				-1);
-	    g_free (label);
+    /* rows stay once added, the filter hides the ones not matching */
+    for (li = visible; li != NULL; li = li->next) {
+	    if ( ! mdm_users_has_picture_row (li->data))
+		    mdm_login_browser_add_user (li->data);
     }
+    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (browser_filter));
+
+    /* the selected user may have been filtered out and back in */
+    selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (browser));
+    if (selected_user != NULL &&
+	! gtk_tree_selection_get_selected (selection, NULL, NULL))
+	    browser_set_user (selected_user);
+}
+
+static void
+mdm_login_browser_populate (void)
+{
+    /* only the users matching what has been typed are shown */
+    mdm_users_set_view_func (mdm_login_browser_show_users, NULL);
     return;
 }
 
@@ -1467,11 +1476,12 @@ update_clock (void)
 	gtk_label_set_text (GTK_LABEL (clock_label), str);
 	g_free (str);
 
-	/* account for leap seconds */
-	time_til_next_min = 60 - the_tm->tm_sec;
+	/* account for leap seconds, and wait a second longer as the
+	 * timeout may fire a little early and show the old minute again */
+	time_til_next_min = 60 - the_tm->tm_sec + 1;
 	time_til_next_min = (time_til_next_min>=0?time_til_next_min:0);
 
-	g_timeout_add (time_til_next_min*1000, (GSourceFunc)update_clock, NULL);
+	mdm_common_timeout_add_seconds (time_til_next_min, (GSourceFunc)update_clock, NULL);
 	return FALSE;
 }
 
@@ -1589,6 +1599,9 @@ key_release_event (GtkWidget *entry, GdkEventKey *event, gpointer data)
 	else
 		gtk_widget_set_sensitive (ok_button, FALSE);
 
+	if (login_prompt && browser_model != NULL)
+		mdm_users_filter (login_string);
+
 	return FALSE;
 }
 
@@ -1652,6 +1665,7 @@ mdm_login_gui_init (void)
 			    (GDestroyNotify) g_object_unref);
 
     gtk_widget_set_events (login, GDK_ALL_EVENTS_MASK);
+    mdm_trace_first_expose (login);
 
     g_signal_connect (G_OBJECT (login), "key_press_event",
                       G_CALLBACK (key_press_event), NULL);
@@ -1828,7 +1842,16 @@ mdm_login_gui_init (void)
 	    browser_model = (GtkTreeModel *)gtk_list_store_new (3,
 	             GDK_TYPE_PIXBUF, G_TYPE_STRING, G_TYPE_STRING);
 
-	    gtk_tree_view_set_model (GTK_TREE_VIEW (browser), browser_model);
+	    browser_filter = gtk_tree_model_filter_new (browser_model, NULL);
+	    gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (browser_filter),
+						    mdm_users_row_visible,
+						    GINT_TO_POINTER (GREETER_ULIST_LOGIN_COLUMN),
+						    NULL);
+
+	    gtk_tree_view_set_model (GTK_TREE_VIEW (browser), browser_filter);
+	    mdm_users_set_picture_store (GTK_LIST_STORE (browser_model),
+					 GREETER_ULIST_ICON_COLUMN);
+	    mdm_trace_mark_expose (browser, "face_browser_expose");
 	    column = gtk_tree_view_column_new_with_attributes
 	        (_("Icon"),
 	         gtk_cell_renderer_pixbuf_new (),
@@ -2059,110 +2082,23 @@ mdm_login_gui_init (void)
 	}
 }
 
-static GdkPixbuf *
-render_scaled_back (const GdkPixbuf *pb)
-{
-	int i;
-	int width, height;
-
-	GdkPixbuf *back = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
-					  gdk_pixbuf_get_has_alpha (pb),
-					  8,
-					  gdk_screen_width (),
-					  gdk_screen_height ());
-
-	width = gdk_pixbuf_get_width (pb);
-	height = gdk_pixbuf_get_height (pb);
-
-	for (i = 0; i < mdm_wm_num_monitors; i++) {
-		gdk_pixbuf_scale (pb, back,
-				  mdm_wm_all_monitors[i].x,
-				  mdm_wm_all_monitors[i].y,
-				  mdm_wm_all_monitors[i].width,
-				  mdm_wm_all_monitors[i].height,
-				  mdm_wm_all_monitors[i].x /* offset_x */,
-				  mdm_wm_all_monitors[i].y /* offset_y */,
-				  (double) mdm_wm_all_monitors[i].width / width,
-				  (double) mdm_wm_all_monitors[i].height / height,
-				  GDK_INTERP_BILINEAR);
-	}
-
-	return back;
-}
-
-static void
-add_color_to_pb (GdkPixbuf *pb, GdkColor *color)
-{
-	int width = gdk_pixbuf_get_width (pb);
-	int height = gdk_pixbuf_get_height (pb);
-	int rowstride = gdk_pixbuf_get_rowstride (pb);
-	guchar *pixels = gdk_pixbuf_get_pixels (pb);
-	gboolean has_alpha = gdk_pixbuf_get_has_alpha (pb);
-	int i;
-	int cr = color->red >> 8;
-	int cg = color->green >> 8;
-	int cb = color->blue >> 8;
-
-	if ( ! has_alpha)
-		return;
-
-	for (i = 0; i < height; i++) {
-		int ii;
-		guchar *p = pixels + (rowstride * i);
-		for (ii = 0; ii < width; ii++) {
-			int r = p[0];
-			int g = p[1];
-			int b = p[2];
-			int a = p[3];
-
-			p[0] = (r * a + cr * (255 - a)) >> 8;
-			p[1] = (g * a + cg * (255 - a)) >> 8;
-			p[2] = (b * a + cb * (255 - a)) >> 8;
-			p[3] = 255;
-
-			p += 4;
-		}
-	}
-}
-
 /* setup background color/image */
 static void
 setup_background (void)
 {
-	GdkColor color;
-	GdkPixbuf *pb = NULL;
 	gchar *bg_color = mdm_config_get_string (MDM_KEY_BACKGROUND_COLOR);
 	gchar *bg_image = mdm_config_get_string (MDM_KEY_BACKGROUND_IMAGE);
-	gint   bg_type  = mdm_config_get_int    (MDM_KEY_BACKGROUND_TYPE); 
+	gint   bg_type  = mdm_config_get_int    (MDM_KEY_BACKGROUND_TYPE);
 
+	/* Load background image */
 	if ((bg_type == MDM_BACKGROUND_IMAGE ||
 	     bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) &&
-	    ! ve_string_empty (bg_image))
-		pb = gdk_pixbuf_new_from_file (bg_image, NULL);
-
-	/* Load background image */
-	if (pb != NULL) {
-		if (gdk_pixbuf_get_has_alpha (pb)) {
-			if (bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) {
-				if (bg_color == NULL ||
-				    bg_color[0] == '\0' ||
-				    ! gdk_color_parse (bg_color,
-					       &color)) {
-					gdk_color_parse ("#000000", &color);
-				}
-				add_color_to_pb (pb, &color);
-			}
-		}
-		
-		GdkPixbuf *spb = render_scaled_back (pb);
-		g_object_unref (G_OBJECT (pb));
-		pb = spb;		
-
-		/* paranoia */
-		if (pb != NULL) {
-			mdm_common_set_root_background (pb);
-			g_object_unref (G_OBJECT (pb));
-		}
+	    ! ve_string_empty (bg_image) &&
+	    mdm_common_set_root_background_image (bg_image, bg_color,
+	                                          bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR,
+	                                          mdm_wm_all_monitors,
+	                                          mdm_wm_num_monitors)) {
+		return;
 	/* Load background color */
 	} else if (bg_type != MDM_BACKGROUND_NONE &&
 	           bg_type != MDM_BACKGROUND_IMAGE) {
@@ -2215,6 +2151,7 @@ mdm_read_config (void)
 	mdm_config_get_string (MDM_KEY_INFO_MSG_FILE);
 	mdm_config_get_string (MDM_KEY_INFO_MSG_FONT);
 	mdm_config_get_string (MDM_KEY_LOCALE_FILE);	
+	mdm_config_get_string (MDM_KEY_SERV_AUTHDIR);
 	mdm_config_get_string (MDM_KEY_REBOOT);	
 	mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR);
 	mdm_config_get_string (MDM_KEY_SOUND_PROGRAM);
@@ -2231,6 +2168,7 @@ mdm_read_config (void)
 	mdm_config_get_int    (MDM_KEY_BACKGROUND_PROGRAM_RESTART_DELAY);
 	mdm_config_get_int    (MDM_KEY_FLEXI_REAP_DELAY_MINUTES);
 	mdm_config_get_int    (MDM_KEY_MAX_ICON_HEIGHT);
+	mdm_config_get_int    (MDM_KEY_FACE_DECODE_THREADS);
 	mdm_config_get_int    (MDM_KEY_MAX_ICON_WIDTH);
 	mdm_config_get_int    (MDM_KEY_MINIMAL_UID);
 	mdm_config_get_int    (MDM_KEY_TIMED_LOGIN_DELAY);
@@ -2250,6 +2188,7 @@ mdm_read_config (void)
 	mdm_config_get_bool   (MDM_KEY_SYSTEM_MENU);
 	mdm_config_get_bool   (MDM_KEY_TIMED_LOGIN_ENABLE);	
 	mdm_config_get_bool   (MDM_KEY_ADD_GTK_MODULES);
+	mdm_config_get_bool   (MDM_KEY_BACKGROUND_CACHE);
 
 	/* Keys not to include in reread_config */	
 	mdm_config_get_string (MDM_KEY_PRE_FETCH_PROGRAM);	
@@ -2370,6 +2309,8 @@ main (int argc, char *argv[])
     GIOChannel *ctrlch;
     guint sid;
 
+    mdm_trace_init ("mdmlogin");
+
     if (g_getenv ("DOING_MDM_DEVELOPMENT") != NULL)
 	    DOING_MDM_DEVELOPMENT = TRUE;
 
@@ -2388,6 +2329,7 @@ main (int argc, char *argv[])
     }
 
     gtk_init (&argc, &argv);
+    mdm_trace_mark ("gtk_init");
 
     if (ve_string_empty (g_getenv ("MDM_IS_LOCAL")))
 	disable_system_menu_buttons = TRUE;
@@ -2398,7 +2340,9 @@ main (int argc, char *argv[])
     mdm_common_setup_builtin_icons ();
 
     /* Read all configuration at once, so the values get cached */
+    mdm_trace_begin ("mdm_read_config");
     mdm_read_config ();
+    mdm_trace_end ("mdm_read_config");
     
     setlocale (LC_ALL, "");
 
@@ -2420,10 +2364,15 @@ main (int argc, char *argv[])
     }
 
     if (mdm_config_get_bool (MDM_KEY_BROWSER)) {
+    	mdm_users_set_operation_func (process_operation);
+    	mdm_trace_begin ("mdm_users_init");
     	mdm_users_init (&users, &users_string, NULL, defface, &size_of_users, login_is_local, !DOING_MDM_DEVELOPMENT);
+    	mdm_trace_end ("mdm_users_init");
     }
 
+    mdm_trace_begin ("mdm_login_gui_init");
     mdm_login_gui_init ();
+    mdm_trace_end ("mdm_login_gui_init");
 
     if (mdm_config_get_bool (MDM_KEY_BROWSER)) {
 		mdm_login_browser_populate ();
@@ -2516,37 +2465,7 @@ main (int argc, char *argv[])
     }
 
     /* if a flexiserver, reap self after some time */
-    if (mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES) > 0 &&
-	! ve_string_empty (g_getenv ("MDM_FLEXI_SERVER")) &&
-	/* but don't reap nested flexis */
-	ve_string_empty (g_getenv ("MDM_PARENT_DISPLAY"))) {
-	    sid = g_signal_lookup ("activate",
-				   GTK_TYPE_MENU_ITEM);
-	    g_signal_add_emission_hook (sid,
-					0 /* detail */,
-					delay_reaping,
-					NULL /* data */,
-					NULL /* destroy_notify */);
-
-	    sid = g_signal_lookup ("key_release_event",
-				   GTK_TYPE_WIDGET);
-	    g_signal_add_emission_hook (sid,
-					0 /* detail */,
-					delay_reaping,
-					NULL /* data */,
-					NULL /* destroy_notify */);
-
-	    sid = g_signal_lookup ("button_press_event",
-				   GTK_TYPE_WIDGET);
-	    g_signal_add_emission_hook (sid,
-					0 /* detail */,
-					delay_reaping,
-					NULL /* data */,
-					NULL /* destroy_notify */);
-
-	    last_reap_delay = time (NULL);
-	    g_timeout_add (60*1000, reap_flexiserver, NULL);
-    }
+    mdm_common_setup_reaping (mdm_kill_thingies);
 
     sid = g_signal_lookup ("event",
                            GTK_TYPE_WIDGET);
@@ -2628,6 +2547,7 @@ main (int argc, char *argv[])
     mdm_common_setup_cursor (GDK_LEFT_PTR);
 	mdm_wm_center_cursor ();
     mdm_common_pre_fetch_launch ();
+    mdm_trace_mark ("gtk_main");
     gtk_main ();
 
     mdm_kill_thingies ();
@@ -0,0 +1,594 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "mdmpixops.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define PIXOPS_X86 1
+#include <immintrin.h>
+#define PIXOPS_TARGET(isa) __attribute__ ((target (isa)))
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define PIXOPS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* The tint factors for a run of bytes from the start of a row, long
+ * enough for whole 16 and 32 byte vectors of both RGB and RGBA */
+#define PATTERN_LEN 96
+
+typedef struct {
+	void (* tint_row)    (guchar *p, int width, int n_channels, const guchar *pattern);
+	void (* over_row)    (guchar *p, int width, guint32 rgb);
+	void (* premul_row)  (guchar *p, int width);
+} MdmPixopsFuncs;
+
+/* t / 255 for t <= 255 * 255, without the divide */
+static inline guint
+div255 (guint t)
+{
+	return (t + 1 + (t >> 8)) >> 8;
+}
+
+/* The same, rounded to nearest */
+static inline guint
+div255_round (guint t)
+{
+	t += 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static void
+scalar_tint_row (guchar *p, int width, int n_channels, const guchar *pattern)
+{
+	int i;
+
+	for (i = 0; i < width; i++) {
+		p[0] = div255 (p[0] * pattern[0]);
+		p[1] = div255 (p[1] * pattern[1]);
+		p[2] = div255 (p[2] * pattern[2]);
+		p += n_channels;
+	}
+}
+
+/* This is what add_color_to_pb always did, the >> 8 included */
+static void
+scalar_over_row (guchar *p, int width, guint32 rgb)
+{
+	guint cr = (rgb >> 16) & 0xff;
+	guint cg = (rgb >> 8) & 0xff;
+	guint cb = rgb & 0xff;
+	int   i;
+
+	for (i = 0; i < width; i++) {
+		guint a = p[3];
+
+		p[0] = (p[0] * a + cr * (255 - a)) >> 8;
+		p[1] = (p[1] * a + cg * (255 - a)) >> 8;
+		p[2] = (p[2] * a + cb * (255 - a)) >> 8;
+		p[3] = 255;
+		p += 4;
+	}
+}
+
+static void
+scalar_premul_row (guchar *p, int width)
+{
+	int i;
+
+	for (i = 0; i < width; i++) {
+		guint a = p[3];
+
+		p[0] = div255_round (p[0] * a);
+		p[1] = div255_round (p[1] * a);
+		p[2] = div255_round (p[2] * a);
+		p += 4;
+	}
+}
+
+#ifdef PIXOPS_X86
+
+/*
+ * The vector versions work on 16 bit lanes: bytes are unpacked against
+ * zero, multiplied, divided with the shifts above and packed back.
+ * Rows rarely start aligned, so everything uses unaligned loads.
+ */
+
+PIXOPS_TARGET ("sse2") static inline __m128i
+sse2_div255 (__m128i t)
+{
+	t = _mm_add_epi16 (t, _mm_srli_epi16 (t, 8));
+	t = _mm_add_epi16 (t, _mm_set1_epi16 (1));
+	return _mm_srli_epi16 (t, 8);
+}
+
+PIXOPS_TARGET ("sse2") static inline __m128i
+sse2_div255_round (__m128i t)
+{
+	t = _mm_add_epi16 (t, _mm_set1_epi16 (128));
+	t = _mm_add_epi16 (t, _mm_srli_epi16 (t, 8));
+	return _mm_srli_epi16 (t, 8);
+}
+
+/* Copies the alpha of each pixel over its other three lanes */
+PIXOPS_TARGET ("sse2") static inline __m128i
+sse2_broadcast_alpha (__m128i v)
+{
+	v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (3, 3, 3, 3));
+	return _mm_shufflehi_epi16 (v, _MM_SHUFFLE (3, 3, 3, 3));
+}
+
+PIXOPS_TARGET ("sse2") static void
+sse2_tint_row (guchar *p, int width, int n_channels, const guchar *pattern)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	__m128i       f_lo[PATTERN_LEN / 16];
+	__m128i       f_hi[PATTERN_LEN / 16];
+	int           blocks = width * n_channels / PATTERN_LEN;
+	int           i, k;
+
+	for (k = 0; k < PATTERN_LEN / 16; k++) {
+		__m128i f = _mm_loadu_si128 ((const __m128i *) (pattern + 16 * k));
+
+		f_lo[k] = _mm_unpacklo_epi8 (f, zero);
+		f_hi[k] = _mm_unpackhi_epi8 (f, zero);
+	}
+
+	for (i = 0; i < blocks; i++) {
+		for (k = 0; k < PATTERN_LEN / 16; k++) {
+			__m128i v = _mm_loadu_si128 ((const __m128i *) p);
+			__m128i lo = _mm_unpacklo_epi8 (v, zero);
+			__m128i hi = _mm_unpackhi_epi8 (v, zero);
+
+			lo = sse2_div255 (_mm_mullo_epi16 (lo, f_lo[k]));
+			hi = sse2_div255 (_mm_mullo_epi16 (hi, f_hi[k]));
+			_mm_storeu_si128 ((__m128i *) p, _mm_packus_epi16 (lo, hi));
+			p += 16;
+		}
+	}
+
+	scalar_tint_row (p, width - blocks * PATTERN_LEN / n_channels, n_channels, pattern);
+}
+
+PIXOPS_TARGET ("sse2") static void
+sse2_over_row (guchar *p, int width, guint32 rgb)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i full = _mm_set1_epi16 (255);
+	const __m128i opaque = _mm_set1_epi32 ((int) 0xff000000);
+	const __m128i color = _mm_set_epi16 (0, rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff,
+					     0, rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff);
+	int           i;
+
+	for (i = 0; i + 4 <= width; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *) p);
+		__m128i lo = _mm_unpacklo_epi8 (v, zero);
+		__m128i hi = _mm_unpackhi_epi8 (v, zero);
+		__m128i a_lo = sse2_broadcast_alpha (lo);
+		__m128i a_hi = sse2_broadcast_alpha (hi);
+
+		lo = _mm_add_epi16 (_mm_mullo_epi16 (lo, a_lo),
+				    _mm_mullo_epi16 (color, _mm_sub_epi16 (full, a_lo)));
+		hi = _mm_add_epi16 (_mm_mullo_epi16 (hi, a_hi),
+				    _mm_mullo_epi16 (color, _mm_sub_epi16 (full, a_hi)));
+		lo = _mm_srli_epi16 (lo, 8);
+		hi = _mm_srli_epi16 (hi, 8);
+		v = _mm_or_si128 (_mm_packus_epi16 (lo, hi), opaque);
+		_mm_storeu_si128 ((__m128i *) p, v);
+		p += 16;
+	}
+
+	scalar_over_row (p, width - i, rgb);
+}
+
+PIXOPS_TARGET ("sse2") static void
+sse2_premul_row (guchar *p, int width)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i keep = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i one = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+	int           i;
+
+	for (i = 0; i + 4 <= width; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *) p);
+		__m128i lo = _mm_unpacklo_epi8 (v, zero);
+		__m128i hi = _mm_unpackhi_epi8 (v, zero);
+		__m128i a_lo = _mm_or_si128 (_mm_and_si128 (sse2_broadcast_alpha (lo), keep), one);
+		__m128i a_hi = _mm_or_si128 (_mm_and_si128 (sse2_broadcast_alpha (hi), keep), one);
+
+		lo = sse2_div255_round (_mm_mullo_epi16 (lo, a_lo));
+		hi = sse2_div255_round (_mm_mullo_epi16 (hi, a_hi));
+		_mm_storeu_si128 ((__m128i *) p, _mm_packus_epi16 (lo, hi));
+		p += 16;
+	}
+
+	scalar_premul_row (p, width - i);
+}
+
+/* The AVX2 unpacks and packs work within each 128 bit half, which
+ * keeps the bytes in order just the same */
+
+PIXOPS_TARGET ("avx2") static inline __m256i
+avx2_div255 (__m256i t)
+{
+	t = _mm256_add_epi16 (t, _mm256_srli_epi16 (t, 8));
+	t = _mm256_add_epi16 (t, _mm256_set1_epi16 (1));
+	return _mm256_srli_epi16 (t, 8);
+}
+
+PIXOPS_TARGET ("avx2") static inline __m256i
+avx2_div255_round (__m256i t)
+{
+	t = _mm256_add_epi16 (t, _mm256_set1_epi16 (128));
+	t = _mm256_add_epi16 (t, _mm256_srli_epi16 (t, 8));
+	return _mm256_srli_epi16 (t, 8);
+}
+
+PIXOPS_TARGET ("avx2") static inline __m256i
+avx2_broadcast_alpha (__m256i v)
+{
+	v = _mm256_shufflelo_epi16 (v, _MM_SHUFFLE (3, 3, 3, 3));
+	return _mm256_shufflehi_epi16 (v, _MM_SHUFFLE (3, 3, 3, 3));
+}
+
+PIXOPS_TARGET ("avx2") static void
+avx2_tint_row (guchar *p, int width, int n_channels, const guchar *pattern)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	__m256i       f_lo[PATTERN_LEN / 32];
+	__m256i       f_hi[PATTERN_LEN / 32];
+	int           blocks = width * n_channels / PATTERN_LEN;
+	int           i, k;
+
+	for (k = 0; k < PATTERN_LEN / 32; k++) {
+		__m256i f = _mm256_loadu_si256 ((const __m256i *) (pattern + 32 * k));
+
+		f_lo[k] = _mm256_unpacklo_epi8 (f, zero);
+		f_hi[k] = _mm256_unpackhi_epi8 (f, zero);
+	}
+
+	for (i = 0; i < blocks; i++) {
+		for (k = 0; k < PATTERN_LEN / 32; k++) {
+			__m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+			__m256i lo = _mm256_unpacklo_epi8 (v, zero);
+			__m256i hi = _mm256_unpackhi_epi8 (v, zero);
+
+			lo = avx2_div255 (_mm256_mullo_epi16 (lo, f_lo[k]));
+			hi = avx2_div255 (_mm256_mullo_epi16 (hi, f_hi[k]));
+			_mm256_storeu_si256 ((__m256i *) p, _mm256_packus_epi16 (lo, hi));
+			p += 32;
+		}
+	}
+
+	scalar_tint_row (p, width - blocks * PATTERN_LEN / n_channels, n_channels, pattern);
+}
+
+PIXOPS_TARGET ("avx2") static void
+avx2_over_row (guchar *p, int width, guint32 rgb)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i full = _mm256_set1_epi16 (255);
+	const __m256i opaque = _mm256_set1_epi32 ((int) 0xff000000);
+	const __m256i color = _mm256_set_epi16 (0, rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff,
+						0, rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff,
+						0, rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff,
+						0, rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff);
+	int           i;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+		__m256i lo = _mm256_unpacklo_epi8 (v, zero);
+		__m256i hi = _mm256_unpackhi_epi8 (v, zero);
+		__m256i a_lo = avx2_broadcast_alpha (lo);
+		__m256i a_hi = avx2_broadcast_alpha (hi);
+
+		lo = _mm256_add_epi16 (_mm256_mullo_epi16 (lo, a_lo),
+				       _mm256_mullo_epi16 (color, _mm256_sub_epi16 (full, a_lo)));
+		hi = _mm256_add_epi16 (_mm256_mullo_epi16 (hi, a_hi),
+				       _mm256_mullo_epi16 (color, _mm256_sub_epi16 (full, a_hi)));
+		lo = _mm256_srli_epi16 (lo, 8);
+		hi = _mm256_srli_epi16 (hi, 8);
+		v = _mm256_or_si256 (_mm256_packus_epi16 (lo, hi), opaque);
+		_mm256_storeu_si256 ((__m256i *) p, v);
+		p += 32;
+	}
+
+	scalar_over_row (p, width - i, rgb);
+}
+
+PIXOPS_TARGET ("avx2") static void
+avx2_premul_row (guchar *p, int width)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i keep = _mm256_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1,
+					       0, -1, -1, -1, 0, -1, -1, -1);
+	const __m256i one = _mm256_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0,
+					      255, 0, 0, 0, 255, 0, 0, 0);
+	int           i;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+		__m256i lo = _mm256_unpacklo_epi8 (v, zero);
+		__m256i hi = _mm256_unpackhi_epi8 (v, zero);
+		__m256i a_lo = _mm256_or_si256 (_mm256_and_si256 (avx2_broadcast_alpha (lo), keep), one);
+		__m256i a_hi = _mm256_or_si256 (_mm256_and_si256 (avx2_broadcast_alpha (hi), keep), one);
+
+		lo = avx2_div255_round (_mm256_mullo_epi16 (lo, a_lo));
+		hi = avx2_div255_round (_mm256_mullo_epi16 (hi, a_hi));
+		_mm256_storeu_si256 ((__m256i *) p, _mm256_packus_epi16 (lo, hi));
+		p += 32;
+	}
+
+	scalar_premul_row (p, width - i);
+}
+
+#endif /* PIXOPS_X86 */
+
+#ifdef PIXOPS_NEON
+
+/* NEON loads split the channels out, so no factor pattern is needed */
+
+static inline uint8x8_t
+neon_div255 (uint16x8_t t)
+{
+	t = vaddq_u16 (t, vshrq_n_u16 (t, 8));
+	t = vaddq_u16 (t, vdupq_n_u16 (1));
+	return vshrn_n_u16 (t, 8);
+}
+
+static inline uint8x8_t
+neon_div255_round (uint16x8_t t)
+{
+	t = vaddq_u16 (t, vdupq_n_u16 (128));
+	t = vaddq_u16 (t, vshrq_n_u16 (t, 8));
+	return vshrn_n_u16 (t, 8);
+}
+
+static void
+neon_tint_row (guchar *p, int width, int n_channels, const guchar *pattern)
+{
+	const uint8x8_t r = vdup_n_u8 (pattern[0]);
+	const uint8x8_t g = vdup_n_u8 (pattern[1]);
+	const uint8x8_t b = vdup_n_u8 (pattern[2]);
+	int             i;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		if (n_channels == 4) {
+			uint8x8x4_t v = vld4_u8 (p);
+
+			v.val[0] = neon_div255 (vmull_u8 (v.val[0], r));
+			v.val[1] = neon_div255 (vmull_u8 (v.val[1], g));
+			v.val[2] = neon_div255 (vmull_u8 (v.val[2], b));
+			vst4_u8 (p, v);
+		} else {
+			uint8x8x3_t v = vld3_u8 (p);
+
+			v.val[0] = neon_div255 (vmull_u8 (v.val[0], r));
+			v.val[1] = neon_div255 (vmull_u8 (v.val[1], g));
+			v.val[2] = neon_div255 (vmull_u8 (v.val[2], b));
+			vst3_u8 (p, v);
+		}
+		p += 8 * n_channels;
+	}
+
+	scalar_tint_row (p, width - i, n_channels, pattern);
+}
+
+static void
+neon_over_row (guchar *p, int width, guint32 rgb)
+{
+	const uint8x8_t cr = vdup_n_u8 ((rgb >> 16) & 0xff);
+	const uint8x8_t cg = vdup_n_u8 ((rgb >> 8) & 0xff);
+	const uint8x8_t cb = vdup_n_u8 (rgb & 0xff);
+	int             i;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		uint8x8x4_t v = vld4_u8 (p);
+		uint8x8_t   a = v.val[3];
+		uint8x8_t   ia = vmvn_u8 (a);
+
+		v.val[0] = vshrn_n_u16 (vmlal_u8 (vmull_u8 (v.val[0], a), cr, ia), 8);
+		v.val[1] = vshrn_n_u16 (vmlal_u8 (vmull_u8 (v.val[1], a), cg, ia), 8);
+		v.val[2] = vshrn_n_u16 (vmlal_u8 (vmull_u8 (v.val[2], a), cb, ia), 8);
+		v.val[3] = vdup_n_u8 (255);
+		vst4_u8 (p, v);
+		p += 32;
+	}
+
+	scalar_over_row (p, width - i, rgb);
+}
+
+static void
+neon_premul_row (guchar *p, int width)
+{
+	int i;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		uint8x8x4_t v = vld4_u8 (p);
+		uint8x8_t   a = v.val[3];
+
+		v.val[0] = neon_div255_round (vmull_u8 (v.val[0], a));
+		v.val[1] = neon_div255_round (vmull_u8 (v.val[1], a));
+		v.val[2] = neon_div255_round (vmull_u8 (v.val[2], a));
+		vst4_u8 (p, v);
+		p += 32;
+	}
+
+	scalar_premul_row (p, width - i);
+}
+
+#endif /* PIXOPS_NEON */
+
+static const MdmPixopsFuncs impls[MDM_PIXOPS_N_IMPLS] = {
+	/* MDM_PIXOPS_SCALAR */
+	{ scalar_tint_row, scalar_over_row, scalar_premul_row },
+#ifdef PIXOPS_X86
+	/* MDM_PIXOPS_SSE2 */
+	{ sse2_tint_row, sse2_over_row, sse2_premul_row },
+	/* MDM_PIXOPS_AVX2 */
+	{ avx2_tint_row, avx2_over_row, avx2_premul_row },
+#else
+	{ NULL, NULL, NULL },
+	{ NULL, NULL, NULL },
+#endif
+#ifdef PIXOPS_NEON
+	/* MDM_PIXOPS_NEON */
+	{ neon_tint_row, neon_over_row, neon_premul_row },
+#else
+	{ NULL, NULL, NULL },
+#endif
+};
+
+static const char *impl_names[MDM_PIXOPS_N_IMPLS] = {
+	"scalar", "sse2", "avx2", "neon"
+};
+
+static MdmPixopsImpl  current_impl = MDM_PIXOPS_N_IMPLS;
+static const MdmPixopsFuncs *funcs = NULL;
+
+static gboolean
+impl_supported (MdmPixopsImpl impl)
+{
+	if ((guint) impl >= MDM_PIXOPS_N_IMPLS ||
+	    impls[impl].tint_row == NULL)
+		return FALSE;
+
+#ifdef PIXOPS_X86
+	__builtin_cpu_init ();
+	if (impl == MDM_PIXOPS_SSE2)
+		return __builtin_cpu_supports ("sse2");
+	if (impl == MDM_PIXOPS_AVX2)
+		return __builtin_cpu_supports ("avx2");
+#endif
+
+	return TRUE;
+}
+
+static const MdmPixopsFuncs *
+get_funcs (void)
+{
+	static const MdmPixopsImpl best[] = {
+		MDM_PIXOPS_AVX2, MDM_PIXOPS_NEON, MDM_PIXOPS_SSE2, MDM_PIXOPS_SCALAR
+	};
+	int i;
+
+	if (funcs != NULL)
+		return funcs;
+
+	for (i = 0; i < G_N_ELEMENTS (best); i++) {
+		if (impl_supported (best[i])) {
+			mdm_pixops_set_impl (best[i]);
+			break;
+		}
+	}
+
+	return funcs;
+}
+
+void
+mdm_pixops_tint (guchar  *pixels,
+		 int      width,
+		 int      height,
+		 int      rowstride,
+		 int      n_channels,
+		 guint32  rgb)
+{
+	const MdmPixopsFuncs *f = get_funcs ();
+	guchar                pattern[PATTERN_LEN];
+	int                   i;
+
+	g_return_if_fail (n_channels == 3 || n_channels == 4);
+
+	/* Alpha gets multiplied by 255 / 255 */
+	for (i = 0; i < PATTERN_LEN; i += n_channels) {
+		pattern[i] = (rgb >> 16) & 0xff;
+		pattern[i + 1] = (rgb >> 8) & 0xff;
+		pattern[i + 2] = rgb & 0xff;
+		if (n_channels == 4)
+			pattern[i + 3] = 0xff;
+	}
+
+	for (i = 0; i < height; i++)
+		f->tint_row (pixels + (gsize) i * rowstride, width, n_channels, pattern);
+}
+
+void
+mdm_pixops_over_color (guchar  *pixels,
+		       int      width,
+		       int      height,
+		       int      rowstride,
+		       guint32  rgb)
+{
+	const MdmPixopsFuncs *f = get_funcs ();
+	int                   i;
+
+	for (i = 0; i < height; i++)
+		f->over_row (pixels + (gsize) i * rowstride, width, rgb);
+}
+
+void
+mdm_pixops_premultiply (guchar  *pixels,
+			int      width,
+			int      height,
+			int      rowstride)
+{
+	const MdmPixopsFuncs *f = get_funcs ();
+	int                   i;
+
+	for (i = 0; i < height; i++)
+		f->premul_row (pixels + (gsize) i * rowstride, width);
+}
+
+MdmPixopsImpl
+mdm_pixops_get_impl (void)
+{
+	get_funcs ();
+
+	return current_impl;
+}
+
+/**
+ * mdm_pixops_set_impl
+ *
+ * Makes the operations use @impl, which is for comparing them.
+ * Returns FALSE if this CPU cannot run it.
+ */
+gboolean
+mdm_pixops_set_impl (MdmPixopsImpl impl)
+{
+	if ( ! impl_supported (impl))
+		return FALSE;
+
+	current_impl = impl;
+	funcs = &impls[impl];
+
+	return TRUE;
+}
+
+const char *
+mdm_pixops_impl_name (MdmPixopsImpl impl)
+{
+	g_return_val_if_fail ((guint) impl < MDM_PIXOPS_N_IMPLS, NULL);
+
+	return impl_names[impl];
+}
@@ -0,0 +1,60 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_PIXOPS_H
+#define MDM_PIXOPS_H
+
+#include <glib.h>
+
+/* Per-pixel operations on 8 bit RGB and RGBA pixbuf data.  The vector
+ * versions give exactly the same results as the scalar one, the best
+ * one the CPU has is picked on first use. */
+typedef enum {
+	MDM_PIXOPS_SCALAR,
+	MDM_PIXOPS_SSE2,
+	MDM_PIXOPS_AVX2,
+	MDM_PIXOPS_NEON,
+	MDM_PIXOPS_N_IMPLS
+} MdmPixopsImpl;
+
+/* Multiplies the colour channels by those of @rgb (0xRRGGBB) */
+void		mdm_pixops_tint		(guchar        *pixels,
+					 int            width,
+					 int            height,
+					 int            rowstride,
+					 int            n_channels,
+					 guint32        rgb);
+
+/* Puts RGBA pixels over @rgb, leaving them opaque */
+void		mdm_pixops_over_color	(guchar        *pixels,
+					 int            width,
+					 int            height,
+					 int            rowstride,
+					 guint32        rgb);
+
+/* Multiplies the colour channels of RGBA pixels by their alpha */
+void		mdm_pixops_premultiply	(guchar        *pixels,
+					 int            width,
+					 int            height,
+					 int            rowstride);
+
+MdmPixopsImpl	mdm_pixops_get_impl	(void);
+gboolean	mdm_pixops_set_impl	(MdmPixopsImpl  impl);
+const char *	mdm_pixops_impl_name	(MdmPixopsImpl  impl);
+
+#endif /* MDM_PIXOPS_H */
@@ -26,7 +26,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <dirent.h>
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 
@@ -91,6 +90,42 @@ mdm_session_list_init ()
 	_mdm_session_list_init (&sessnames, &sessions, &default_session, &current_session);
 }
 
+/* The daemon keeps the catalogue of all sessions up to date in
+ * ServAuthDir, only scan the directories ourselves if that is missing
+ * or was built for other directories */
+static GKeyFile *
+mdm_session_load_catalogue (void)
+{
+    GKeyFile *sessions;
+    char *file;
+    char *dirs;
+
+    file = g_build_filename (mdm_config_get_string (MDM_KEY_SERV_AUTHDIR),
+			     MDM_SESSION_CATALOGUE, NULL);
+    sessions = mdm_common_config_load (file, NULL);
+    g_free (file);
+
+    if (sessions != NULL) {
+	    dirs = NULL;
+	    mdm_common_config_get_string (sessions, MDM_SESSIONS_GROUP "/SessionDesktopDir", &dirs, NULL);
+	    if (strcmp (ve_sure_string (dirs),
+			ve_sure_string (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR))) != 0) {
+		    g_key_file_free (sessions);
+		    sessions = NULL;
+	    }
+	    g_free (dirs);
+    }
+
+    if (sessions == NULL) {
+	    mdm_common_debug ("mdm_session_list_init: No session catalogue, scanning %s",
+			      ve_sure_string (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR)));
+	    sessions = mdm_common_config_load_sessions (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR),
+							mdm_config_get_string (MDM_KEY_PATH));
+    }
+
+    return sessions;
+}
+
 /* The real mdm_session_list_init */
 void
 _mdm_session_list_init (GHashTable **sessnames, GList **sessions, gchar **default_session, const gchar **current_session)
@@ -99,143 +134,96 @@ _mdm_session_list_init (GHashTable **sessnames, GList **sessions, gchar **defaul
     MdmSession *session = NULL;
     gboolean some_dir_exists = FALSE;
     gboolean searching_for_default = TRUE;
-    struct dirent *dent;
-    char **vec;
-    char *name;
-    DIR *sessdir;
+    GKeyFile *catalogue;
+    char **groups;
     int i;
 
     *sessnames = g_hash_table_new (g_str_hash, g_str_equal);
 
-    vec = g_strsplit (mdm_config_get_string (MDM_KEY_SESSION_DESKTOP_DIR),
-	 ":", -1);
-    for (i = 0; vec != NULL && vec[i] != NULL; i++) {
-	    const char *dir = vec[i];
+    catalogue = mdm_session_load_catalogue ();
+    mdm_common_config_get_boolean (catalogue, MDM_SESSIONS_GROUP "/DirsFound=false", &some_dir_exists, NULL);
 
-	    /* Check that session dir is readable */
-	    if G_UNLIKELY (dir == NULL || access (dir, R_OK|X_OK) != 0)
-		    continue;
+    groups = g_key_file_get_groups (catalogue, NULL);
+    for (i = 0; groups != NULL && groups[i] != NULL; i++) {
+	    const char *file = groups[i];
+	    char *exec;
+	    char *comment;
+	    char *name;
+	    char *key;
+	    gboolean hidden;
+	    gboolean available;
 
-	    some_dir_exists = TRUE;
-
-	    /* Read directory entries in session dir */
-	    sessdir = opendir (dir);
-
-	    if G_LIKELY (sessdir != NULL)
-		    dent = readdir (sessdir);
-	    else
-		    dent = NULL;
-
-	    while (dent != NULL) {
-		    GKeyFile *cfg;
-		    char *exec;
-		    char *comment;
-		    char *s;
-		    char *tryexec;
-		    char *ext;
-		    gboolean hidden;
-
-		    /* ignore everything but the .desktop files */
-		    ext = strstr (dent->d_name, ".desktop");
-		    if (ext == NULL ||
-			strcmp (ext, ".desktop") != 0) {
-			    dent = readdir (sessdir);
-			    continue;
-		    }
+	    if (strcmp (file, MDM_SESSIONS_GROUP) == 0)
+		    continue;
 
-		    /* already found this session, ignore */
-		    if (g_hash_table_lookup (*sessnames, dent->d_name) != NULL) {
-			    dent = readdir (sessdir);
-			    continue;
-		    }
+	    hidden = FALSE;
+	    key = g_strconcat (file, "/Hidden=false", NULL);
+	    mdm_common_config_get_boolean (catalogue, key, &hidden, NULL);
+	    g_free (key);
+	    if (hidden)
+		    continue;
 
-		    s = g_strconcat (dir, "/", dent->d_name, NULL);
-		    cfg = mdm_common_config_load (s, NULL);
-		    g_free (s);
+	    available = TRUE;
+	    key = g_strconcat (file, "/X-Mdm-Available=true", NULL);
+	    mdm_common_config_get_boolean (catalogue, key, &available, NULL);
+	    g_free (key);
+	    if ( ! available) {
+		    session = g_new0 (MdmSession, 1);
+		    session->name      = g_strdup (file);
+		    g_hash_table_insert (*sessnames, g_strdup (file), session);
+		    continue;
+	    }
 
-		    hidden = FALSE;
-		    mdm_common_config_get_boolean (cfg, "Desktop Entry/Hidden=false", &hidden, NULL);
-		    if (hidden) {
-			    g_key_file_free (cfg);
-			    dent = readdir (sessdir);
-			    continue;
-		    }
+	    exec = NULL;
+	    name = NULL;
+	    comment = NULL;
+	    key = g_strconcat (file, "/Exec", NULL);
+	    mdm_common_config_get_string (catalogue, key, &exec, NULL);
+	    g_free (key);
+	    key = g_strconcat (file, "/Name", NULL);
+	    mdm_common_config_get_translated_string (catalogue, key, &name, NULL);
+	    g_free (key);
+	    key = g_strconcat (file, "/Comment", NULL);
+	    mdm_common_config_get_translated_string (catalogue, key, &comment, NULL);
+	    g_free (key);
+
+	    if G_UNLIKELY (ve_string_empty (exec) || ve_string_empty (name)) {
+		    session = g_new0 (MdmSession, 1);
+		    session->name      = g_strdup (file);
+		    g_hash_table_insert (*sessnames, g_strdup (file), session);
+		    g_free (exec);
+		    g_free (name);
+		    g_free (comment);
+		    continue;
+	    }
 
-		    tryexec = NULL;
-		    mdm_common_config_get_string (cfg, "Desktop Entry/TryExec", &tryexec, NULL);
-		    if ( ! ve_string_empty (tryexec)) {
-			    char **tryexecvec = g_strsplit (tryexec, " ", -1);
-			    char *full = NULL;
-
-			    /* Do not pass any arguments to g_find_program_in_path */
-			    if (tryexecvec != NULL)
-				full = g_find_program_in_path (tryexecvec[0]);
-
-			    if (full == NULL) {
-				    session = g_new0 (MdmSession, 1);
-				    session->name      = g_strdup (dent->d_name);
-				    g_hash_table_insert (*sessnames, g_strdup (dent->d_name),
-					 session);
-				    g_free (tryexec);
-				    g_key_file_free (cfg);
-				    dent = readdir (sessdir);
-				    continue;
-			    }
-			    g_strfreev (tryexecvec);
-			    g_free (full);
-		    }
-		    g_free (tryexec);
-
-		    exec = NULL;
-		    name = NULL;
-		    comment = NULL;
-		    mdm_common_config_get_string (cfg, "Desktop Entry/Exec", &exec, NULL);
-		    mdm_common_config_get_translated_string (cfg, "Desktop Entry/Name", &name, NULL);
-		    mdm_common_config_get_translated_string (cfg, "Desktop Entry/Comment", &comment, NULL);
-		    g_key_file_free (cfg);
-
-		    if G_UNLIKELY (ve_string_empty (exec) || ve_string_empty (name)) {
-			    session = g_new0 (MdmSession, 1);
-			    session->name      = g_strdup (dent->d_name);
-			    g_hash_table_insert (*sessnames, g_strdup (dent->d_name), session);
-			    g_free (exec);
-			    g_free (name);
-			    g_free (comment);
-			    dent = readdir (sessdir);
-			    continue;
+	    /* if we found the default session */
+	    if (default_session != NULL) {
+		    if ( ! ve_string_empty (mdm_config_get_string (MDM_KEY_DEFAULT_SESSION)) &&
+			 strcmp (file, mdm_config_get_string (MDM_KEY_DEFAULT_SESSION)) == 0) {
+			    g_free (*default_session);
+			    *default_session = g_strdup (file);
+			    searching_for_default = FALSE;
 		    }
 
-		    /* if we found the default session */
-		    if (default_session != NULL) {
-			    if ( ! ve_string_empty (mdm_config_get_string (MDM_KEY_DEFAULT_SESSION)) &&
-				 strcmp (dent->d_name, mdm_config_get_string (MDM_KEY_DEFAULT_SESSION)) == 0) {
-				    g_free (*default_session);
-				    *default_session = g_strdup (dent->d_name);
-				    searching_for_default = FALSE;
-			    }
-
-			    /* if there is a session called Default */
-			    if (searching_for_default &&
-				g_ascii_strcasecmp (dent->d_name, "default.desktop") == 0) {
-				    g_free (*default_session);
-				    *default_session = g_strdup (dent->d_name);
-			    }
+		    /* if there is a session called Default */
+		    if (searching_for_default &&
+			g_ascii_strcasecmp (file, "default.desktop") == 0) {
+			    g_free (*default_session);
+			    *default_session = g_strdup (file);
 		    }
-
-		    session = g_new0 (MdmSession, 1);
-		    session->name      = g_strdup (name);
-		    session->comment   = g_strdup (comment);
-		    g_hash_table_insert (*sessnames, g_strdup (dent->d_name), session);
-		    g_free (exec);
-		    g_free (comment);
-		    dent = readdir (sessdir);
 	    }
 
-	    if G_LIKELY (sessdir != NULL)
-		    closedir (sessdir);
+	    session = g_new0 (MdmSession, 1);
+	    session->name      = g_strdup (name);
+	    session->comment   = g_strdup (comment);
+	    g_hash_table_insert (*sessnames, g_strdup (file), session);
+	    g_free (exec);
+	    g_free (comment);
     }
 
-    g_strfreev (vec);
+    g_strfreev (groups);
+    g_key_file_free (catalogue);
 
     /* Check that session dir is readable */
     if G_UNLIKELY ( ! some_dir_exists) {
@@ -0,0 +1,256 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "mdmcommon.h"
+#include "mdmtrace.h"
+
+typedef struct {
+	const char *name;
+	gint64      start;
+	gint64      end;	/* -1 while the phase runs */
+} MdmTracePhase;
+
+static GArray   *phases  = NULL;
+static gint64    origin  = 0;
+static char     *program = NULL;
+static gboolean  dirty   = FALSE;
+
+static void
+trace_add (const char *name, gint64 start, gint64 end)
+{
+	MdmTracePhase phase;
+
+	if (phases == NULL)
+		return;
+
+	phase.name  = g_intern_string (name);
+	phase.start = start;
+	phase.end   = end;
+	g_array_append_val (phases, phase);
+	dirty = TRUE;
+}
+
+static void
+trace_log (void)
+{
+	guint i;
+
+	for (i = 0; i < phases->len; i++) {
+		MdmTracePhase *p = &g_array_index (phases, MdmTracePhase, i);
+
+		if (p->end < 0)
+			mdm_common_debug ("mdm_trace: %s at %.1f ms, not finished",
+					  p->name, (p->start - origin) / 1000.0);
+		else if (p->end == p->start)
+			mdm_common_debug ("mdm_trace: %s at %.1f ms",
+					  p->name, (p->start - origin) / 1000.0);
+		else
+			mdm_common_debug ("mdm_trace: %s at %.1f ms took %.1f ms",
+					  p->name, (p->start - origin) / 1000.0,
+					  (p->end - p->start) / 1000.0);
+	}
+}
+
+static void
+trace_write_file (const char *file)
+{
+	GString *json;
+	GError  *error = NULL;
+	guint    i;
+
+	/* Absolute monotonic times so that whoever started us can work
+	 * out how long the exec took */
+	json = g_string_new (NULL);
+	g_string_append_printf (json,
+				"{\n  \"program\": \"%s\",\n  \"pid\": %d,\n"
+				"  \"origin_us\": %" G_GINT64_FORMAT ",\n  \"phases\": [",
+				program, (int) getpid (), origin);
+
+	for (i = 0; i < phases->len; i++) {
+		MdmTracePhase *p = &g_array_index (phases, MdmTracePhase, i);
+
+		g_string_append_printf (json,
+					"%s\n    { \"name\": \"%s\", \"start_us\": %" G_GINT64_FORMAT
+					", \"end_us\": %" G_GINT64_FORMAT " }",
+					i > 0 ? "," : "", p->name, p->start,
+					p->end < 0 ? p->start : p->end);
+	}
+	g_string_append (json, "\n  ]\n}\n");
+
+	if ( ! g_file_set_contents (file, json->str, json->len, &error)) {
+		mdm_common_warning ("mdm_trace: Cannot write %s: %s", file, error->message);
+		g_error_free (error);
+	}
+	g_string_free (json, TRUE);
+}
+
+static void
+trace_at_exit (void)
+{
+	mdm_trace_mark ("exit");
+	mdm_trace_flush ();
+}
+
+/**
+ * mdm_trace_init
+ *
+ * Starts the clock.  Call first thing in main().
+ */
+void
+mdm_trace_init (const char *prog)
+{
+	if (phases != NULL)
+		return;
+
+	origin  = g_get_monotonic_time ();
+	program = g_strdup (prog);
+	phases  = g_array_new (FALSE, FALSE, sizeof (MdmTracePhase));
+
+	trace_add ("start", origin, origin);
+	g_atexit (trace_at_exit);
+}
+
+void
+mdm_trace_begin (const char *phase)
+{
+	trace_add (phase, g_get_monotonic_time (), -1);
+}
+
+void
+mdm_trace_end (const char *phase)
+{
+	const char *name;
+	guint       i;
+
+	if (phases == NULL)
+		return;
+
+	name = g_intern_string (phase);
+	for (i = phases->len; i > 0; i--) {
+		MdmTracePhase *p = &g_array_index (phases, MdmTracePhase, i - 1);
+
+		if (p->name == name && p->end < 0) {
+			p->end = g_get_monotonic_time ();
+			dirty = TRUE;
+			return;
+		}
+	}
+}
+
+void
+mdm_trace_mark (const char *event)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	trace_add (event, now, now);
+}
+
+static gboolean
+trace_mark_expose (GtkWidget *widget, GdkEventExpose *event, gpointer data)
+{
+	mdm_trace_mark (data);
+
+	g_signal_handlers_disconnect_by_func (widget, trace_mark_expose, data);
+	return FALSE;
+}
+
+/**
+ * mdm_trace_mark_expose
+ *
+ * Marks @event the first time @widget gets painted, for parts of the
+ * greeter like the user list.
+ */
+void
+mdm_trace_mark_expose (GtkWidget *widget, const char *event)
+{
+	if (phases == NULL)
+		return;
+
+	g_signal_connect (widget, "expose_event",
+			  G_CALLBACK (trace_mark_expose),
+			  (gpointer) g_intern_string (event));
+}
+
+/* The greeter can be used once the main loop gets idle after the first
+ * paint, the timed items and pending signals have run by then */
+static gboolean
+trace_interactive (gpointer data)
+{
+	mdm_trace_mark ("interactive");
+	mdm_trace_flush ();
+
+	return FALSE;
+}
+
+static gboolean
+trace_expose (GtkWidget *widget, GdkEventExpose *event, gpointer data)
+{
+	mdm_trace_mark ("first_expose");
+	g_idle_add (trace_interactive, NULL);
+
+	g_signal_handlers_disconnect_by_func (widget, trace_expose, data);
+	return FALSE;
+}
+
+/**
+ * mdm_trace_first_expose
+ *
+ * Marks the first time @widget, the main greeter window, gets painted
+ * and the point after that where the greeter becomes interactive.
+ * Startup is over then, so this also flushes the trace.
+ */
+void
+mdm_trace_first_expose (GtkWidget *widget)
+{
+	if (phases == NULL)
+		return;
+
+	g_signal_connect (widget, "expose_event",
+			  G_CALLBACK (trace_expose), NULL);
+}
+
+/**
+ * mdm_trace_flush
+ *
+ * Writes what was recorded so far to the debug log, and to the file
+ * named by MDM_TRACE_FILE.  The greeters mostly leave with _exit(), so
+ * do not rely on this happening at exit.
+ */
+void
+mdm_trace_flush (void)
+{
+	const char *file;
+
+	if (phases == NULL || ! dirty)
+		return;
+	dirty = FALSE;
+
+	trace_log ();
+
+	file = g_getenv (MDM_TRACE_FILE_ENV);
+	if (file != NULL && file[0] != '\0')
+		trace_write_file (file);
+}
@@ -0,0 +1,38 @@
+/* MDM - The MDM Display Manager
+ * Copyright (C) 1998, 1999, 2000 Martin K. Petersen <mkp@mkp.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MDM_TRACE_H
+#define MDM_TRACE_H
+
+#include <gtk/gtk.h>
+
+/* Startup phase timing for the greeters.  The phases go to the debug
+ * log once the greeter is interactive, and to a JSON file as well if
+ * MDM_TRACE_FILE is set in the environment. */
+#define MDM_TRACE_FILE_ENV	"MDM_TRACE_FILE"
+
+void	mdm_trace_init			(const char *program);
+void	mdm_trace_begin			(const char *phase);
+void	mdm_trace_end			(const char *phase);
+void	mdm_trace_mark			(const char *event);
+void	mdm_trace_mark_expose		(GtkWidget  *widget,
+					 const char *event);
+void	mdm_trace_first_expose		(GtkWidget  *widget);
+void	mdm_trace_flush			(void);
+
+#endif /* MDM_TRACE_H */
@@ -25,7 +25,11 @@
 #include <locale.h>
 #include <glib/gi18n.h>
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <pwd.h>
 
@@ -34,25 +38,495 @@
 #include "mdmcommon.h"
 #include "mdmuser.h"
 #include "mdmconfig.h"
+#include "mdmtrace.h"
 
 #include "mdm-socket-protocol.h"
 #include "mdm-daemon-config-keys.h"
 
-static time_t time_started;
+/* How many logins to ask the slave for at a time */
+#define MDM_PICTURES_PER_BATCH 64
+
+/* With IncludeAll, how many users to list before the greeter comes up,
+ * the rest are listed from the main loop this many microseconds at a
+ * time */
+#define MDM_USERS_FIRST_CHUNK 100
+#define MDM_USERS_SLICE_USEC 10000
+
+/* Where listing the password database is at */
+typedef struct {
+	GList **users;
+	/* listed but not yet merged into users */
+	GList *fresh;
+	GList **users_string;
+	GHashTable *seen;
+	char **excludes;
+	char *exclude_user;
+	GdkPixbuf *defface;
+	gboolean is_local;
+	gboolean read_faces;
+	int count;
+	int max_users;
+	gint64 deadline;
+	guint idle_id;
+} MdmUserListing;
+
+static MdmUserListing *listing = NULL;
+
+/*
+ * Type-ahead index: the casefolded login, full name and every word of
+ * the full name of each user, kept sorted so that the users matching a
+ * prefix are a binary search and a short walk away.  Once something
+ * has been typed the greeters only show the first MDM_USERS_VISIBLE_MAX
+ * matches of it, with nothing typed they show everybody.
+ */
+#define MDM_USERS_VISIBLE_MAX 100
+
+typedef struct {
+	char *key;
+	MdmUser *user;
+} MdmUserIndexEntry;
+
+static GArray *user_index = NULL;
+/* user_index is sorted up to here, the rest is still to be merged in */
+static guint user_index_merged = 0;
+
+static GList **all_users = NULL;
+static char *users_filter = NULL;
+static GList *users_visible = NULL;
+/* The logins in users_visible, for mdm_users_row_visible */
+static GHashTable *users_visible_logins = NULL;
+
+static MdmUserViewFunc user_view_func = NULL;
+static gpointer user_view_data = NULL;
+
+/* /etc/shells, read once */
+static GHashTable *valid_shells = NULL;
+
+/* Users that still need their picture from the slave */
+static GPtrArray *pending_pictures = NULL;
+
+/* What the greeter does with a command from the slave */
+static MdmUserOperationFunc operation_func = NULL;
+
+/*
+ * Faces are decoded on a few threads once the list is up, and swapped
+ * in from the main loop.  The list store the greeter shows the users
+ * in, if any, gets the new pictures too.
+ */
+typedef struct {
+	MdmUser *user;
+	guchar *data;
+	gsize size;
+	GdkPixbuf *img;
+} MdmPictureJob;
+
+static GThreadPool *decode_pool = NULL;
+static guint decode_pending = 0;
+static gint64 users_init_started = 0;
+
+static GtkListStore *picture_store = NULL;
+static gint picture_store_icon_column;
+/* MdmUser to the GtkTreeRowReference of its row in picture_store */
+static GHashTable *picture_rows = NULL;
+
+/* Our own buffering of stdin while talking to the slave, so that we
+ * don't have to read() every byte on its own.  The slave never sends
+ * anything past a message until we've answered it, so nothing that
+ * belongs to the main loop ends up in here */
+static guchar pic_buf[PIPE_SIZE];
+static gsize pic_pos = 0;
+static gsize pic_len = 0;
+
+static gboolean
+pic_fill (void)
+{
+	ssize_t n;
+
+	VE_IGNORE_EINTR (n = read (STDIN_FILENO, pic_buf, sizeof (pic_buf)));
+	if (n <= 0)
+		return FALSE;
+
+	pic_pos = 0;
+	pic_len = n;
+	return TRUE;
+}
+
+static int
+pic_getc (void)
+{
+	if (pic_pos >= pic_len && ! pic_fill ())
+		return -1;
+	return pic_buf[pic_pos++];
+}
+
+/* Skip to the next STX and return the line after it, without the \n */
+static char *
+pic_get_message (void)
+{
+	GString *gs;
+	int c;
+
+	do {
+		c = pic_getc ();
+	} while (c != -1 && c != STX);
+
+	if (c == -1)
+		return NULL;
+
+	gs = g_string_new (NULL);
+	while ((c = pic_getc ()) != -1 && c != '\n')
+		g_string_append_c (gs, c);
+
+	return g_string_free (gs, FALSE);
+}
+
+/* Keep @msg, a command that came before the one we wait for, in @other
+ * if it's still free, and drop it otherwise */
+static void
+pic_keep_other (char *msg, char **other)
+{
+	if (other != NULL && *other == NULL)
+		*other = msg;
+	else
+		g_free (msg);
+}
+
+/* Answer the MDM_NEEDPIC after the last batch with nothing, after that
+ * the slave is done with pictures */
+static gboolean
+pic_finish (char **other)
+{
+	char *msg;
+
+	do {
+		msg = pic_get_message ();
+		if (msg == NULL)
+			return FALSE;
+		if (msg[0] == MDM_NEEDPIC)
+			break;
+		pic_keep_other (msg, other);
+	} while (TRUE);
+	g_free (msg);
+
+	printf ("%c\n", STX);
+	fflush (stdout);
+
+	return TRUE;
+}
+
+/* Read a header line, a "<login> <size>" */
+static char *
+pic_get_line (void)
+{
+	GString *gs;
+	int c;
+
+	gs = g_string_new (NULL);
+	while ((c = pic_getc ()) != -1 && c != '\n')
+		g_string_append_c (gs, c);
+
+	if (c == -1) {
+		g_string_free (gs, TRUE);
+		return NULL;
+	}
+	return g_string_free (gs, FALSE);
+}
+
+/* Read @size bytes of stdin into a new buffer */
+static guchar *
+pic_read_bytes (gsize size)
+{
+	guchar *data;
+	gsize got = 0;
+
+	data = g_malloc (size);
+	while (got < size) {
+		gsize n;
+
+		if (pic_pos >= pic_len && ! pic_fill ()) {
+			g_free (data);
+			return NULL;
+		}
+
+		n = MIN (size - got, pic_len - pic_pos);
+		memcpy (data + got, &pic_buf[pic_pos], n);
+		pic_pos += n;
+		got += n;
+	}
+	return data;
+}
+
+/* Decode and scale a face, this is safe to call from the decode pool */
+static GdkPixbuf *
+pic_decode (const guchar *data, gsize size)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf *img;
+
+	loader = gdk_pixbuf_loader_new ();
+	gdk_pixbuf_loader_write (loader, data, size, NULL);
+	gdk_pixbuf_loader_close (loader, NULL);
+
+	img = gdk_pixbuf_loader_get_pixbuf (loader);
+	if (img != NULL)
+		img = gdk_pixbuf_scale_simple (img, MDM_FACE_THUMB_SIZE,
+					       MDM_FACE_THUMB_SIZE, GDK_INTERP_BILINEAR);
+
+	g_object_unref (G_OBJECT (loader));
+
+	return img;
+}
+
+static void
+pic_unmap (guchar *pixels, gpointer data)
+{
+	munmap (pixels, GPOINTER_TO_SIZE (data));
+}
+
+/* Map a thumbnail from the face cache, it's already raw RGBA at the
+ * right size so there is nothing to decode */
+static GdkPixbuf *
+pic_map_thumbnail (const char *file)
+{
+	gsize size = MDM_FACE_THUMB_SIZE * MDM_FACE_THUMB_SIZE * 4;
+	GdkPixbuf *img;
+	struct stat s;
+	void *pixels;
+	int fd;
+
+	VE_IGNORE_EINTR (fd = open (file, O_RDONLY));
+	if (fd < 0)
+		return NULL;
+
+	if (fstat (fd, &s) != 0 || s.st_size != size) {
+		VE_IGNORE_EINTR (close (fd));
+		return NULL;
+	}
+
+	/* private, so that nobody drawing on the picture writes to the cache */
+	pixels = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	VE_IGNORE_EINTR (close (fd));
+	if (pixels == MAP_FAILED)
+		return NULL;
+
+	img = gdk_pixbuf_new_from_data (pixels, GDK_COLORSPACE_RGB, TRUE, 8,
+					MDM_FACE_THUMB_SIZE, MDM_FACE_THUMB_SIZE,
+					MDM_FACE_THUMB_SIZE * 4,
+					pic_unmap, GSIZE_TO_POINTER (size));
+	if (img == NULL)
+		munmap (pixels, size);
+
+	return img;
+}
+
+/* Keep the list height in step with @user getting a picture @height high */
+static void
+pic_account_height (MdmUser *user, int height, int *size_of_users)
+{
+	if (user->picture != NULL)
+		*size_of_users -= gdk_pixbuf_get_height (user->picture) + 2;
+	else
+		*size_of_users -= mdm_config_get_int (MDM_KEY_MAX_ICON_HEIGHT);
+	*size_of_users += height + 2;
+}
+
+static void
+pic_set_picture (MdmUser *user, GdkPixbuf *img)
+{
+	GtkTreeRowReference *row;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	if (user->picture != NULL)
+		g_object_unref (G_OBJECT (user->picture));
+	user->picture = img;
+
+	if (picture_rows == NULL ||
+	    (row = g_hash_table_lookup (picture_rows, user)) == NULL ||
+	    (path = gtk_tree_row_reference_get_path (row)) == NULL)
+		return;
+
+	if (gtk_tree_model_get_iter (GTK_TREE_MODEL (picture_store), &iter, path))
+		gtk_list_store_set (picture_store, &iter,
+				    picture_store_icon_column, user->picture,
+				    -1);
+	gtk_tree_path_free (path);
+}
+
+/* Back on the main loop with a decoded face */
+static gboolean
+pic_job_done (gpointer data)
+{
+	MdmPictureJob *job = data;
+
+	if (job->img != NULL)
+		pic_set_picture (job->user, job->img);
+
+	g_free (job->data);
+	g_free (job);
+
+	if (--decode_pending == 0) {
+		mdm_trace_mark ("faces_decoded");
+		mdm_common_debug ("mdm_users: all faces in %d ms after listing users started",
+				  (int) ((g_get_monotonic_time () - users_init_started) / 1000));
+	}
+
+	return FALSE;
+}
+
+static void
+pic_job_run (gpointer data, gpointer user_data)
+{
+	MdmPictureJob *job = data;
+
+	job->img = pic_decode (job->data, job->size);
+	g_idle_add (pic_job_done, job);
+}
+
+/*
+ * Get the pictures of @n users starting at @users from the slave in
+ * one go.  A command that comes before the MDM_NEEDPIC is kept in
+ * @other, if given.  Returns FALSE if talking to the slave didn't work
+ * out.
+ */
+static gboolean
+mdm_users_read_pictures (MdmUser **users, guint n, GdkPixbuf *defface,
+			 int *size_of_users, char **other)
+{
+	GString *logins;
+	char *msg;
+	int count;
+	guint i;
+
+	/* read initial request */
+	do {
+		msg = pic_get_message ();
+		if (msg == NULL)
+			return FALSE;
+		if (msg[0] == MDM_NEEDPIC)
+			break;
+		pic_keep_other (msg, other);
+	} while (TRUE);
+	g_free (msg);
+
+	logins = g_string_new (NULL);
+	for (i = 0; i < n; i++) {
+		if (i > 0)
+			g_string_append_c (logins, ' ');
+		g_string_append (logins, users[i]->login);
+	}
+	printf ("%c%s\n", STX, logins->str);
+	fflush (stdout);
+	g_string_free (logins, TRUE);
+
+	do {
+		msg = pic_get_message ();
+		if (msg == NULL)
+			return FALSE;
+		if (msg[0] == MDM_READPIC)
+			break;
+		g_free (msg);
+	} while (TRUE);
+
+	if (sscanf (&msg[1], "batch:%d", &count) != 1 || count != n) {
+		g_free (msg);
+		/* the daemon is now free to go on */
+		printf ("%c\n", STX);
+		fflush (stdout);
+		return TRUE;
+	}
+	g_free (msg);
+
+	/* the daemon will now print the records */
+	printf ("%cOK\n", STX);
+	fflush (stdout);
+
+	/* skip to the STX that starts them */
+	{
+		int c;
+		do {
+			c = pic_getc ();
+		} while (c != -1 && c != STX);
+		if (c == -1)
+			return FALSE;
+	}
+
+	for (i = 0; i < n; i++) {
+		MdmUser *user = users[i];
+		GdkPixbuf *img;
+		guchar *data;
+		char *line;
+		char *p;
+		long size;
+
+		line = pic_get_line ();
+		if (line == NULL)
+			return FALSE;
+
+		/* "<login> <size>" or "<login> @<cached thumbnail>" */
+		p = strchr (line, ' ');
+		if (p != NULL && p[1] == '@') {
+			img = pic_map_thumbnail (p + 2);
+			g_free (line);
+			if (img != NULL) {
+				pic_account_height (user, gdk_pixbuf_get_height (img),
+						    size_of_users);
+				pic_set_picture (user, img);
+			}
+			continue;
+		}
+
+		size = (p != NULL) ? atol (p + 1) : 0;
+		g_free (line);
+
+		if (size <= 0)
+			continue;
+
+		data = pic_read_bytes (size);
+		if (data == NULL)
+			return FALSE;
+
+		if (decode_pool != NULL) {
+			MdmPictureJob *job = g_new0 (MdmPictureJob, 1);
+
+			/* it will come out at the thumbnail size */
+			pic_account_height (user, MDM_FACE_THUMB_SIZE, size_of_users);
+
+			job->user = user;
+			job->data = data;
+			job->size = size;
+			decode_pending++;
+			g_thread_pool_push (decode_pool, job, NULL);
+			continue;
+		}
+
+		img = pic_decode (data, size);
+		g_free (data);
+		if (img == NULL)
+			continue;
+
+		pic_account_height (user, gdk_pixbuf_get_height (img), size_of_users);
+		pic_set_picture (user, img);
+	}
+
+	/* read the "done" bit, but don't check */
+	g_free (pic_get_message ());
+
+	/* the daemon is now free to go on */
+	printf ("%c\n", STX);
+	fflush (stdout);
+
+	return TRUE;
+}
 
 static MdmUser * 
 mdm_user_alloc (const gchar *logname,
 		uid_t uid,
 		const gchar *homedir,
 		const char *gecos,
-		GdkPixbuf *defface,
-		gboolean read_faces)
+		GdkPixbuf *defface)
 {
 	MdmUser *user;
-	GdkPixbuf *img = NULL;
-	gchar buf[PIPE_SIZE];
-	size_t size;
-	int bufsize;
 	char *p;
 
 	user = g_new0 (MdmUser, 1);
@@ -79,100 +553,6 @@ mdm_user_alloc (const gchar *logname,
 	if (defface != NULL)
 		user->picture = (GdkPixbuf *)g_object_ref (G_OBJECT (defface));
 
-	if (ve_string_empty (logname))
-		return user;
-
-	/* don't read faces, since that requires the daemon */
-	if (!read_faces)
-		return user;
-
-	/* read initial request */
-	do {
-		while (read (STDIN_FILENO, buf, 1) == 1)
-			if (buf[0] == STX)
-				break;
-		size = read (STDIN_FILENO, buf, sizeof (buf));
-		if (size <= 0)
-			return user;
-	} while (buf[0] != MDM_NEEDPIC);
-
-	printf ("%c%s\n", STX, logname);
-	fflush (stdout);
-
-	do {
-		while (read (STDIN_FILENO, buf, 1) == 1)
-			if (buf[0] == STX)
-				break;
-		size = read (STDIN_FILENO, buf, sizeof (buf));
-		if (size <= 0)
-			return user;
-	} while (buf[0] != MDM_READPIC);
-
-	/* both nul terminate and wipe the trailing \n */
-	buf[size-1] = '\0';
-
-	if (size < 2) {
-		img = NULL;
-	} else if (sscanf (&buf[1], "buffer:%d", &bufsize) == 1) {
-		unsigned char buffer[2048];
-		int pos = 0;
-		int n;
-		GdkPixbufLoader *loader;
-		/* we trust the daemon, even if it wanted to give us
-		 * bogus bufsize */
-		/* the daemon will now print the buffer */
-		printf ("%cOK\n", STX);
-		fflush (stdout);
-
-		while (read (STDIN_FILENO, buf, 1) == 1)
-			if (buf[0] == STX)
-				break;
-
-		loader = gdk_pixbuf_loader_new ();
-
-		while ((n = read (STDIN_FILENO, buffer,
-				  MIN (sizeof (buffer), bufsize-pos))) > 0) {
-			gdk_pixbuf_loader_write (loader, buffer, n, NULL);
-			pos += n;
-			if (pos >= bufsize)
-			       break;	
-		}
-
-		gdk_pixbuf_loader_close (loader, NULL);
-
-		img = gdk_pixbuf_loader_get_pixbuf (loader);
-		if (img != NULL) {
-			g_object_ref (G_OBJECT (img));
-			GdkPixbuf *img2;
-			img2 = gdk_pixbuf_scale_simple (img, 48, 48, GDK_INTERP_BILINEAR);
-			g_object_unref (img);
-			img = img2;		    
-		}
-				
-		g_object_unref (G_OBJECT (loader));
-
-		/* read the "done" bit, but don't check */
-		read (STDIN_FILENO, buf, sizeof (buf));
-	} else if (g_access (&buf[1], R_OK) == 0) {
-		img = mdm_common_get_face (&buf[1],
-					   NULL,
-					   mdm_config_get_int (MDM_KEY_MAX_ICON_WIDTH),
-					   mdm_config_get_int (MDM_KEY_MAX_ICON_HEIGHT));
-	} else {
-		img = NULL;
-	}
-
-	/* the daemon is now free to go on */
-	printf ("%c\n", STX);
-	fflush (stdout);
-
-	if (img != NULL) {
-		if (user->picture != NULL)
-			g_object_unref (G_OBJECT (user->picture));
-
-		user->picture = img;
-	}
-
 	return user;
 }
 
@@ -209,24 +589,25 @@ mdm_check_exclude (struct passwd *pwent, char **excludes, gboolean is_local)
 static gboolean
 mdm_check_shell (const gchar *usersh)
 {
-    gint found = 0;
     gchar *csh;
 
     if (strcmp (usersh, NOLOGIN) == 0 ||
 	strcmp (usersh, "/bin/true") == 0 ||
 	strcmp (usersh, "/bin/false") == 0) {
-      return 0;
+      return FALSE;
     }
 
-    setusershell ();
-
-    while ((csh = getusershell ()) != NULL)
-        if (! strcmp (csh, usersh))
-            found = 1;
+    if (valid_shells == NULL) {
+	valid_shells = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, NULL);
 
-    endusershell ();
+	setusershell ();
+	while ((csh = getusershell ()) != NULL)
+	    g_hash_table_add (valid_shells, g_strdup (csh));
+	endusershell ();
+    }
 
-    return (found);
+    return g_hash_table_contains (valid_shells, usersh);
 }
 
 static gint
@@ -241,58 +622,463 @@ mdm_sort_func (gpointer d1, gpointer d2)
     return (strcmp (a->login, b->login));
 }
 
+static gint
+index_entry_compare (gconstpointer a, gconstpointer b)
+{
+    const MdmUserIndexEntry *ea = a;
+    const MdmUserIndexEntry *eb = b;
+
+    return strcmp (ea->key, eb->key);
+}
+
+/* First entry whose key is not less than @key */
+static guint
+index_lower_bound (const char *key)
+{
+    guint lo = 0, hi = user_index_merged;
+
+    while (lo < hi) {
+	guint mid = lo + (hi - lo) / 2;
+
+	if (strcmp (g_array_index (user_index, MdmUserIndexEntry, mid).key, key) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+static void
+index_add_key (MdmUser *user, const char *text)
+{
+    MdmUserIndexEntry entry;
+
+    if (ve_string_empty (text))
+	return;
+
+    entry.key = g_utf8_casefold (text, -1);
+    entry.user = user;
+
+    g_array_append_val (user_index, entry);
+}
+
+/* Sort the keys added since the last time and merge them in */
+static void
+index_merge (void)
+{
+    GArray *merged;
+    MdmUserIndexEntry *old, *added;
+    guint n_old, n_added, i = 0, j = 0;
+
+    if (user_index == NULL || user_index_merged == user_index->len)
+	return;
+
+    n_old = user_index_merged;
+    n_added = user_index->len - n_old;
+    old = &g_array_index (user_index, MdmUserIndexEntry, 0);
+    added = &g_array_index (user_index, MdmUserIndexEntry, n_old);
+
+    qsort (added, n_added, sizeof (MdmUserIndexEntry), index_entry_compare);
+
+    if (n_old == 0) {
+	user_index_merged = user_index->len;
+	return;
+    }
+
+    merged = g_array_sized_new (FALSE, FALSE, sizeof (MdmUserIndexEntry),
+				user_index->len);
+    while (i < n_old || j < n_added) {
+	if (j == n_added ||
+	    (i < n_old && index_entry_compare (&old[i], &added[j]) <= 0))
+	    g_array_append_val (merged, old[i++]);
+	else
+	    g_array_append_val (merged, added[j++]);
+    }
+
+    g_array_free (user_index, TRUE);
+    user_index = merged;
+    user_index_merged = user_index->len;
+}
+
+static void
+index_add_user (MdmUser *user)
+{
+    char **words;
+    int i;
+
+    if (user_index == NULL)
+	user_index = g_array_new (FALSE, FALSE, sizeof (MdmUserIndexEntry));
+
+    index_add_key (user, user->login);
+    index_add_key (user, user->gecos);
+
+    /* so that "smi" finds "John Smith" too */
+    words = g_strsplit (user->gecos, " ", -1);
+    /* an empty gecos has no words at all, the first is covered
+     * by the full name */
+    for (i = 1; words[0] != NULL && words[i] != NULL; i++)
+	index_add_key (user, words[i]);
+    g_strfreev (words);
+}
+
+/*
+ * Up to @max users whose login, full name or a word of it starts with
+ * @prefix, case insensitively.  With an empty @prefix these are just
+ * the first users.  Free the list with g_list_free.
+ */
+GList *
+mdm_users_lookup (const char *prefix, guint max)
+{
+    GList *found = NULL;
+    char *key;
+    gsize len;
+    guint i, n = 0;
+
+    if (ve_string_empty (prefix)) {
+	GList *li;
+
+	for (li = all_users ? *all_users : NULL; li != NULL && n < max; li = li->next, n++)
+	    found = g_list_prepend (found, li->data);
+	return g_list_reverse (found);
+    }
+
+    if (user_index == NULL)
+	return NULL;
+
+    key = g_utf8_casefold (prefix, -1);
+    len = strlen (key);
+
+    for (i = index_lower_bound (key); i < user_index_merged && n < max; i++) {
+	MdmUserIndexEntry *e = &g_array_index (user_index, MdmUserIndexEntry, i);
+
+	if (strncmp (e->key, key, len) != 0)
+	    break;
+
+	/* the login and the name can both match */
+	if (g_list_find (found, e->user) == NULL) {
+	    found = g_list_prepend (found, e->user);
+	    n++;
+	}
+    }
+    g_free (key);
+
+    return g_list_reverse (found);
+}
 
 static gboolean
-setup_user (struct passwd *pwent,
-	    GList **users,
-	    GList **users_string,
-	    char **excludes,
-	    char *exclude_user,
-	    GdkPixbuf *defface,
+same_users (GList *a, GList *b)
+{
+    while (a != NULL && b != NULL && a->data == b->data) {
+	a = a->next;
+	b = b->next;
+    }
+    return (a == NULL && b == NULL);
+}
+
+/* Tell the greeter what to show, if that changed or @force */
+static void
+users_update_view (gboolean force)
+{
+    GList *visible;
+
+    visible = mdm_users_lookup (users_filter,
+				ve_string_empty (users_filter) ?
+				G_MAXUINT : MDM_USERS_VISIBLE_MAX);
+
+    if ( ! force && same_users (visible, users_visible)) {
+	g_list_free (visible);
+	return;
+    }
+
+    g_list_free (users_visible);
+    users_visible = visible;
+
+    if (users_visible_logins == NULL)
+	users_visible_logins = g_hash_table_new (g_str_hash, g_str_equal);
+    g_hash_table_remove_all (users_visible_logins);
+    for (; visible != NULL; visible = visible->next) {
+	MdmUser *user = visible->data;
+	g_hash_table_insert (users_visible_logins, user->login, user);
+    }
+
+    if (user_view_func != NULL)
+	(*user_view_func) (users_visible, user_view_data);
+}
+
+/* Only show the users matching @filter, what's been typed of a login */
+void
+mdm_users_filter (const char *filter)
+{
+    if (g_strcmp0 (filter, users_filter) == 0 ||
+	(ve_string_empty (filter) && ve_string_empty (users_filter)))
+	return;
+
+    g_free (users_filter);
+    users_filter = g_strdup (filter);
+
+    users_update_view (FALSE);
+}
+
+/*
+ * @func is called with the users to show now, and every time that
+ * changes, because of mdm_users_filter or users listed later.  The
+ * greeters keep a row for every user they have been given and hide the
+ * others with mdm_users_row_visible.
+ */
+void
+mdm_users_set_view_func (MdmUserViewFunc func, gpointer data)
+{
+    user_view_func = func;
+    user_view_data = data;
+
+    users_update_view (TRUE);
+}
+
+/*
+ * A GtkTreeModelFilter visible function showing only the rows of the
+ * users last passed to the view function.  @data is the login column.
+ */
+gboolean
+mdm_users_row_visible (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+    char *login = NULL;
+    gboolean visible;
+
+    if (users_visible_logins == NULL)
+	return FALSE;
+
+    gtk_tree_model_get (model, iter, GPOINTER_TO_INT (data), &login, -1);
+    visible = (login != NULL &&
+	       g_hash_table_lookup (users_visible_logins, login) != NULL);
+    g_free (login);
+
+    return visible;
+}
+
+/*
+ * Add @pwent to the list if it passes the checks.  Returns the new user,
+ * which only shows up in the list once listing_merge has been called.
+ * Sets *@stop when the budget has run out.
+ */
+static MdmUser *
+setup_user (MdmUserListing *ls,
+	    struct passwd *pwent,
 	    int *size_of_users,
-	    gboolean is_local,
-	    gboolean read_faces)
+	    gboolean *stop)
 {
     MdmUser *user;
-    int cnt = 0;
-
-    if (pwent->pw_shell && 
-	mdm_check_shell (pwent->pw_shell) &&
-	!mdm_check_exclude (pwent, excludes, is_local) &&
-	(exclude_user == NULL ||
-	strcmp (ve_sure_string (exclude_user), pwent->pw_name)) != 0) {
-
-	    user = mdm_user_alloc (pwent->pw_name,
-				   pwent->pw_uid,
-				   pwent->pw_dir,
-				   ve_sure_string (pwent->pw_gecos),
-				   defface, read_faces);
-
-	    if ((user) &&
-		(! g_list_find_custom (*users, user, (GCompareFunc) mdm_sort_func))) {
-		cnt++;
-		*users = g_list_insert_sorted (*users, user,
-		     (GCompareFunc) mdm_sort_func);
-		*users_string = g_list_prepend (*users_string, g_strdup (pwent->pw_name));
-
-		if (user->picture != NULL) {
-			*size_of_users +=
-				gdk_pixbuf_get_height (user->picture) + 2;
-		} else {
-			*size_of_users += mdm_config_get_int (MDM_KEY_MAX_ICON_HEIGHT);
-		}
-	    }
 
-	    if (cnt > 1000 || time_started + 5 <= time (NULL)) {
-		*users = g_list_append (*users,
-			g_strdup (_("Too many users to list here...")));
-		*users_string = g_list_append (*users_string,
-			g_strdup (_("Too many users to list here...")));
+    *stop = FALSE;
 
-		return (FALSE);
-	    }
+    if (pwent->pw_shell == NULL ||
+	! mdm_check_shell (pwent->pw_shell) ||
+	mdm_check_exclude (pwent, ls->excludes, ls->is_local) ||
+	(ls->exclude_user != NULL &&
+	 strcmp (ls->exclude_user, pwent->pw_name) == 0) ||
+	g_hash_table_contains (ls->seen, pwent->pw_name))
+	    return NULL;
+
+    user = mdm_user_alloc (pwent->pw_name,
+			   pwent->pw_uid,
+			   pwent->pw_dir,
+			   ve_sure_string (pwent->pw_gecos),
+			   ls->defface);
+
+    g_hash_table_add (ls->seen, g_strdup (pwent->pw_name));
+    ls->count++;
+
+    index_add_user (user);
+
+    ls->fresh = g_list_prepend (ls->fresh, user);
+    *ls->users_string = g_list_prepend (*ls->users_string, g_strdup (pwent->pw_name));
+
+    if (size_of_users != NULL) {
+	if (user->picture != NULL) {
+		*size_of_users +=
+			gdk_pixbuf_get_height (user->picture) + 2;
+	} else {
+		*size_of_users += mdm_config_get_int (MDM_KEY_MAX_ICON_HEIGHT);
+	}
+    }
+
+    if (ls->count >= ls->max_users || g_get_monotonic_time () >= ls->deadline) {
+	*ls->users_string = g_list_append (*ls->users_string,
+		g_strdup (_("Too many users to list here...")));
+	*stop = TRUE;
     }
-    return (TRUE);
+
+    return user;
+}
+
+/*
+ * Sort the users listed since the last time and merge them into the
+ * list and the index, once for the whole lot rather than one by one.
+ */
+static void
+listing_merge (MdmUserListing *ls)
+{
+    GList *merged = NULL;
+    GList *a, *b;
+
+    index_merge ();
+
+    if (ls->fresh == NULL)
+	return;
+
+    ls->fresh = g_list_sort (ls->fresh, (GCompareFunc) mdm_sort_func);
+
+    a = *ls->users;
+    b = ls->fresh;
+    while (a != NULL || b != NULL) {
+	if (b == NULL || (a != NULL && mdm_sort_func (a->data, b->data) <= 0)) {
+	    merged = g_list_prepend (merged, a->data);
+	    a = a->next;
+	} else {
+	    merged = g_list_prepend (merged, b->data);
+	    b = b->next;
+	}
+    }
+
+    g_list_free (*ls->users);
+    g_list_free (ls->fresh);
+    ls->fresh = NULL;
+    *ls->users = g_list_reverse (merged);
+}
+
+static void
+listing_free (MdmUserListing *ls)
+{
+    if (ls->idle_id != 0)
+	g_source_remove (ls->idle_id);
+    g_hash_table_destroy (ls->seen);
+    g_strfreev (ls->excludes);
+    g_free (ls->exclude_user);
+    g_free (ls);
+}
+
+/*
+ * Stop listing users.  Typing doesn't stop it, the users listed later
+ * show up among the matches of what has been typed as they come.
+ */
+static void
+mdm_users_stop_listing (void)
+{
+    if (listing == NULL)
+	return;
+
+    mdm_common_debug ("mdm_users: stopped listing at %d users", listing->count);
+
+    endpwent ();
+    listing_free (listing);
+    listing = NULL;
+
+    if (pending_pictures != NULL) {
+	g_ptr_array_free (pending_pictures, TRUE);
+	pending_pictures = NULL;
+    }
+}
+
+static void
+pic_start_decoding (void)
+{
+    int threads;
+
+    if (decode_pool != NULL)
+	return;
+
+    threads = mdm_config_get_int (MDM_KEY_FACE_DECODE_THREADS);
+    if (threads > 0)
+	decode_pool = g_thread_pool_new (pic_job_run, NULL, threads,
+					 FALSE, NULL);
+}
+
+/*
+ * Get the faces of the users listed since the greeter came up.  The
+ * slave only sends pictures when it asks for them, so interrupt what
+ * it's waiting for with MDM_INTERRUPT_PICTURES.  It then asks just like
+ * at the start and goes back to waiting.  A command it had sent before
+ * that we hadn't read yet is passed on to the operation function once
+ * the pictures are through, it's still waiting for the answer to it.
+ */
+static void
+users_read_more_pictures (MdmUserListing *ls)
+{
+    char *other = NULL;
+    int size_of_users = 0;
+    gboolean ok = TRUE;
+    guint i;
+
+    if (operation_func == NULL) {
+	g_ptr_array_set_size (pending_pictures, 0);
+	return;
+    }
+
+    pic_start_decoding ();
+
+    printf ("%c%c%c\n", STX, BEL, MDM_INTERRUPT_PICTURES);
+    fflush (stdout);
+
+    for (i = 0; ok && i < pending_pictures->len; i += MDM_PICTURES_PER_BATCH)
+	ok = mdm_users_read_pictures ((MdmUser **) &pending_pictures->pdata[i],
+				      MIN (MDM_PICTURES_PER_BATCH, pending_pictures->len - i),
+				      ls->defface, &size_of_users, &other);
+    if (ok)
+	ok = pic_finish (&other);
+
+    /* things don't seem well with the slave, don't ask again */
+    ls->read_faces = ok;
+    g_ptr_array_set_size (pending_pictures, 0);
+
+    if (other != NULL) {
+	(*operation_func) ((guchar) other[0], other + 1);
+	g_free (other);
+    }
+}
+
+/* List some more of the password database, for a slice of time */
+static gboolean
+mdm_users_list_more (gpointer data)
+{
+    MdmUserListing *ls = data;
+    gint64 slice_end;
+    gboolean stop = FALSE;
+
+    slice_end = g_get_monotonic_time () + MDM_USERS_SLICE_USEC;
+
+    while ( ! stop && g_get_monotonic_time () < slice_end) {
+	struct passwd *pwent;
+	MdmUser *user;
+
+	pwent = getpwent ();
+	if (pwent == NULL) {
+	    stop = TRUE;
+	    break;
+	}
+
+	user = setup_user (ls, pwent, NULL, &stop);
+	if (user != NULL && ls->read_faces && ! ve_string_empty (user->login))
+	    g_ptr_array_add (pending_pictures, user);
+    }
+
+    listing_merge (ls);
+    users_update_view (FALSE);
+
+    /* the rows are there now, get their faces a batch at a time */
+    if (ls->read_faces &&
+	(pending_pictures->len >= MDM_PICTURES_PER_BATCH ||
+	 (stop && pending_pictures->len > 0)))
+	users_read_more_pictures (ls);
+
+    if ( ! stop)
+	return TRUE;
+
+    mdm_common_debug ("mdm_users: listed %d users in %d ms", ls->count,
+		      (int) ((g_get_monotonic_time () - users_init_started) / 1000));
+
+    /* we're the idle, don't remove us twice */
+    ls->idle_id = 0;
+    mdm_users_stop_listing ();
+    return FALSE;
 }
 
 gboolean
@@ -338,14 +1124,31 @@ mdm_users_init (GList **users,
 		gboolean is_local,
 		gboolean read_faces)
 {
+    MdmUserListing *ls;
     struct passwd *pwent;
     char **includes;
-    char **excludes;
     gboolean found_include = FALSE;
+    gboolean stop = FALSE;
+    MdmUser *user;
     int i;
 
-    time_started = time (NULL);
-	
+    mdm_users_stop_listing ();
+
+    users_init_started = g_get_monotonic_time ();
+    pending_pictures = g_ptr_array_new ();
+
+    ls = g_new0 (MdmUserListing, 1);
+    ls->users = users;
+    ls->users_string = users_string;
+    ls->seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    ls->exclude_user = g_strdup (exclude_user);
+    ls->defface = defface;
+    ls->is_local = is_local;
+    ls->read_faces = read_faces;
+    ls->max_users = mdm_config_get_int (MDM_KEY_INCLUDE_ALL_MAX_USERS);
+    ls->deadline = users_init_started +
+	    (gint64) mdm_config_get_int (MDM_KEY_INCLUDE_ALL_TIME_LIMIT) * G_USEC_PER_SEC;
+
     includes = g_strsplit (mdm_config_get_string (MDM_KEY_INCLUDE), ",", 0);
     for (i=0 ; includes != NULL && includes[i] != NULL ; i++) {
 	g_strstrip (includes[i]);
@@ -353,39 +1156,144 @@ mdm_users_init (GList **users,
            found_include = TRUE;
     }
 
-    excludes = g_strsplit (mdm_config_get_string (MDM_KEY_EXCLUDE), ",", 0);
-    for (i=0 ; excludes != NULL && excludes[i] != NULL ; i++)
-	g_strstrip (excludes[i]);
+    ls->excludes = g_strsplit (mdm_config_get_string (MDM_KEY_EXCLUDE), ",", 0);
+    for (i=0 ; ls->excludes != NULL && ls->excludes[i] != NULL ; i++)
+	g_strstrip (ls->excludes[i]);
 
     if (mdm_config_get_bool (MDM_KEY_INCLUDE_ALL) == TRUE) {
 	    setpwent ();
-	    pwent = getpwent ();
-	    while (pwent != NULL) {
-
-		if (! setup_user (pwent, users, users_string, excludes,
-			exclude_user, defface, size_of_users, is_local,
-			read_faces))
+	    while ( ! stop && ls->count < MDM_USERS_FIRST_CHUNK) {
+		pwent = getpwent ();
+		if (pwent == NULL) {
+			stop = TRUE;
 			break;
+		}
 
-		pwent = getpwent ();
-	}
-	endpwent ();
+		user = setup_user (ls, pwent, size_of_users, &stop);
+
+		/* faces come from the daemon, in batches once the
+		 * first chunk is listed */
+		if (user != NULL && read_faces && ! ve_string_empty (user->login))
+			g_ptr_array_add (pending_pictures, user);
+	    }
+
+	    /* the rest is listed once the greeter is up */
+	    if ( ! stop) {
+		    listing = ls;
+		    ls->idle_id = g_idle_add (mdm_users_list_more, ls);
+	    } else {
+		    endpwent ();
+	    }
 
     } else if (found_include == TRUE) {
-	for (i=0 ; includes != NULL && includes[i] != NULL ; i++) {
+	for (i=0 ; ! stop && includes != NULL && includes[i] != NULL ; i++) {
 		pwent = getpwnam (includes[i]);
+		if (pwent == NULL)
+			continue;
 
-		if (pwent != NULL) {
-			if (!setup_user (pwent, users, users_string, excludes,
-			    exclude_user, defface, size_of_users, is_local,
-			    read_faces))
-			break;
-
-		}
+		user = setup_user (ls, pwent, size_of_users, &stop);
+		if (user != NULL && read_faces && ! ve_string_empty (user->login))
+			g_ptr_array_add (pending_pictures, user);
 	}
     }
 
+    listing_merge (ls);
+    all_users = users;
+
+    if (listing == NULL)
+	    listing_free (ls);
+
     g_strfreev (includes);
-    g_strfreev (excludes);
+
+    if (pending_pictures->len > 0)
+	    pic_start_decoding ();
+
+    if (read_faces) {
+	    gboolean ok = TRUE;
+
+	    for (i = 0; ok && i < pending_pictures->len; i += MDM_PICTURES_PER_BATCH)
+		    ok = mdm_users_read_pictures ((MdmUser **) &pending_pictures->pdata[i],
+						  MIN (MDM_PICTURES_PER_BATCH, pending_pictures->len - i),
+						  defface, size_of_users, NULL);
+
+	    /* done with pictures before the main loop runs, so that
+	     * users listed later can ask for theirs */
+	    if (ok)
+		    ok = pic_finish (NULL);
+
+	    if (listing != NULL)
+		    listing->read_faces = ok;
+    }
+
+    if (listing != NULL && listing->read_faces) {
+	    g_ptr_array_set_size (pending_pictures, 0);
+    } else {
+	    g_ptr_array_free (pending_pictures, TRUE);
+	    pending_pictures = NULL;
+    }
+
+    mdm_common_debug ("mdm_users: listed users in %d ms, %u faces still decoding",
+		      (int) ((g_get_monotonic_time () - users_init_started) / 1000),
+		      decode_pending);
+}
+
+/*
+ * Commands from the slave that come in while users listed later get
+ * their faces are passed to @func, the greeter's process_operation.
+ * Without it those users keep the default face.
+ */
+void
+mdm_users_set_operation_func (MdmUserOperationFunc func)
+{
+	operation_func = func;
+}
+
+/*
+ * Faces that finish decoding after the list has been filled in are
+ * put into the @icon_column of the row of @store that was last given
+ * for the user with mdm_users_set_picture_row.
+ */
+void
+mdm_users_set_picture_store (GtkListStore *store,
+			     gint icon_column)
+{
+	picture_store = store;
+	picture_store_icon_column = icon_column;
+
+	if (picture_rows != NULL)
+		g_hash_table_remove_all (picture_rows);
 }
 
+/* Whether @user has been given a row with mdm_users_set_picture_row */
+gboolean
+mdm_users_has_picture_row (MdmUser *user)
+{
+	GtkTreeRowReference *row;
+
+	if (picture_rows == NULL)
+		return FALSE;
+
+	row = g_hash_table_lookup (picture_rows, user);
+	return (row != NULL && gtk_tree_row_reference_valid (row));
+}
+
+/* @iter in the picture store is where @user is shown */
+void
+mdm_users_set_picture_row (MdmUser *user, GtkTreeIter *iter)
+{
+	GtkTreePath *path;
+
+	if (picture_store == NULL)
+		return;
+
+	if (picture_rows == NULL)
+		picture_rows = g_hash_table_new_full (NULL, NULL, NULL,
+						      (GDestroyNotify) gtk_tree_row_reference_free);
+
+	path = gtk_tree_model_get_path (GTK_TREE_MODEL (picture_store), iter);
+	g_hash_table_replace (picture_rows, user,
+			      gtk_tree_row_reference_new (GTK_TREE_MODEL (picture_store), path));
+	gtk_tree_path_free (path);
+}
+
+
@@ -19,6 +19,8 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <gtk/gtk.h>
+
 #include "misc.h"
 
 #ifndef MDM_USER_H
@@ -33,6 +35,11 @@ struct _MdmUser {
     GdkPixbuf *picture;
 };
 
+/* The users the greeter should show now */
+typedef void (*MdmUserViewFunc) (GList *visible, gpointer data);
+/* Handles a command from the slave, like the greeter's own handler */
+typedef void (*MdmUserOperationFunc) (guchar op_code, const gchar *args);
+
 gboolean    mdm_is_user_valid		(const char *username);
 gint        mdm_user_uid                (const char *username);
 const char *get_root_user               (void);
@@ -40,5 +47,14 @@ void        mdm_users_init              (GList **users, GList **users_string,
 					char *exclude_user, GdkPixbuf *defface,
 					int *size_of_users, gboolean is_local,
 					gboolean read_faces);
+void        mdm_users_set_view_func     (MdmUserViewFunc func, gpointer data);
+void        mdm_users_set_operation_func (MdmUserOperationFunc func);
+void        mdm_users_filter            (const char *filter);
+gboolean    mdm_users_row_visible       (GtkTreeModel *model, GtkTreeIter *iter,
+					 gpointer data);
+GList      *mdm_users_lookup            (const char *prefix, guint max);
+void        mdm_users_set_picture_store (GtkListStore *store, gint icon_column);
+void        mdm_users_set_picture_row   (MdmUser *user, GtkTreeIter *iter);
+gboolean    mdm_users_has_picture_row   (MdmUser *user);
 
 #endif /* MDM_USER_H */
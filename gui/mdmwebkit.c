@@ -3,6 +3,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,10 +41,12 @@
 #include "mdmlanguages.h"
 #include "mdmwm.h"
 #include "mdmconfig.h"
+#include "mdmtrace.h"
 #include "misc.h"
 
 #include "mdm-common.h"
 #include "mdm-log.h"
+#include "mdm-template.h"
 #include "mdm-socket-protocol.h"
 #include "mdm-daemon-config-keys.h"
 
@@ -58,6 +61,13 @@ static gchar *current_language;
 static GtkWidget *login;
 static guint err_box_clear_handler = 0;
 
+/* Users are added with mdm_add_user once, the first time they are to be shown,
+ * which is all of them until something is typed.  Themes that send FILTER are
+ * also told with mdm_show_users which logins to show whenever that changes,
+ * separated by spaces, and hide the others */
+static gboolean theme_filters = FALSE;
+static GHashTable *users_shown = NULL;
+
 static GdkPixbuf *defface;
 
 /* Eew. Loads of global vars. It's hard to be event controlled while maintaining state */
@@ -129,45 +139,127 @@ static void check_for_displays (void) {
     g_strfreev (vec);
 }
 
-static gchar * str_replace(const char *string, const char *delimiter, const char *replacement) {
-    gchar **split;
-    gchar *ret;
-    g_return_val_if_fail(string != NULL, NULL);
-    g_return_val_if_fail(delimiter != NULL, NULL);
-    g_return_val_if_fail(replacement != NULL, NULL);
-
-    split = g_strsplit(string, delimiter, 0);
-    ret = g_strjoinv(replacement, split);
-    g_strfreev(split);
-    return ret;
+static char * html_encode(const char *string) {
+    return mdm_template_html_escape(string);
 }
 
-static char * html_encode(const char *string) {
-    char * ret;
-    ret = str_replace(string, "'", "&#39");
-    ret = str_replace(ret, "\"", "&#34");
-    ret = str_replace(ret, ";", "&#59");
-    ret = str_replace(ret, "<", "&#60");
-    ret = str_replace(ret, ">", "&#62");
-    ret = str_replace(ret, "\n", "<br/>");
-    return ret;
+/* Calls into the theme are queued and run as one script per main loop
+ * iteration, instead of one script per user, session and language.
+ * Themes that define mdm_batch get the whole queue at once as
+ * [[function, [arguments]], ...], the others get their functions
+ * called one by one as before. */
+static GString *bridge_calls = NULL;
+static guint bridge_flush_id = 0;
+static gboolean page_ready = FALSE;
+
+#define BRIDGE_DISPATCH \
+    "(function (calls) {" \
+    " if ((typeof mdm_batch) === 'function') { mdm_batch(calls); return; }" \
+    " for (var i = 0; i < calls.length; i++) {" \
+    "  var f = window[calls[i][0]];" \
+    "  if ((typeof f) === 'function') { try { f.apply(window, calls[i][1]); } catch (e) { } }" \
+    " }" \
+    "})(["
+
+static void bridge_append_string (GString *str, const char *s) {
+    const guchar *p;
+
+    g_string_append_c (str, '"');
+    for (p = (const guchar *) s; *p != '\0'; p++) {
+        switch (*p) {
+            case '\n':
+                /* the themes never got these */
+                break;
+            case '"':
+                g_string_append (str, "\\\"");
+                break;
+            case '\\':
+                g_string_append (str, "\\\\");
+                break;
+            case 0xe2:
+                /* U+2028 and U+2029 end a JavaScript string */
+                if (p[1] == 0x80 && (p[2] == 0xa8 || p[2] == 0xa9)) {
+                    g_string_append_printf (str, "\\u%04x", p[2] == 0xa8 ? 0x2028 : 0x2029);
+                    p += 2;
+                    break;
+                }
+                g_string_append_c (str, *p);
+                break;
+            default:
+                if (*p < 0x20)
+                    g_string_append_printf (str, "\\u%04x", *p);
+                else
+                    g_string_append_c (str, *p);
+                break;
+        }
+    }
+    g_string_append_c (str, '"');
 }
 
-void webkit_execute_script(const gchar * function, const gchar * arguments) {
-    if (webkit_ready) {
-        gchar * tmp;
+static gboolean webkit_flush_calls (gpointer data) {
+    bridge_flush_id = 0;
 
-        if (arguments == NULL) {
-            tmp = g_strdup_printf("if ((typeof %s) === 'function') { %s(); }", function, function);
-        }
-        else {
-            tmp = g_strdup_printf("if ((typeof %s) === 'function') { %s(\"%s\"); }", function, function, str_replace(arguments, "\n", ""));
+    if (bridge_calls != NULL && bridge_calls->len > 0) {
+        g_string_prepend (bridge_calls, BRIDGE_DISPATCH);
+        g_string_append (bridge_calls, "]);");
+        webkit_web_view_execute_script(webView, bridge_calls->str);
+        g_string_truncate (bridge_calls, 0);
+    }
+
+    /* everything the page got in webkit_on_loaded has been run */
+    if (!page_ready) {
+        page_ready = TRUE;
+        mdm_trace_mark ("page_ready");
+        mdm_trace_flush ();
+    }
+
+    return FALSE;
+}
+
+/* Queues a call of the theme's @function with the string arguments
+ * that follow, up to a NULL */
+static void webkit_call (const gchar * function, ...) {
+    va_list args;
+    const gchar *arg;
+    gboolean first = TRUE;
+
+    if (!webkit_ready) {
+        return;
+    }
+
+    if (bridge_calls == NULL) {
+        bridge_calls = g_string_sized_new (4096);
+    }
+
+    if (bridge_calls->len > 0) {
+        g_string_append_c (bridge_calls, ',');
+    }
+    g_string_append_c (bridge_calls, '[');
+    bridge_append_string (bridge_calls, function);
+    g_string_append (bridge_calls, ",[");
+
+    va_start (args, function);
+    while ((arg = va_arg (args, const gchar *)) != NULL) {
+        if (!first) {
+            g_string_append_c (bridge_calls, ',');
         }
-        webkit_web_view_execute_script(webView, tmp);
-        g_free (tmp);
+        bridge_append_string (bridge_calls, arg);
+        first = FALSE;
+    }
+    va_end (args);
+
+    g_string_append (bridge_calls, "]]");
+
+    /* before the redraw, so the page is painted with all of it */
+    if (bridge_flush_id == 0) {
+        bridge_flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE, webkit_flush_calls, NULL, NULL);
     }
 }
 
+void webkit_execute_script(const gchar * function, const gchar * arguments) {
+    webkit_call (function, arguments, NULL);
+}
+
 gboolean webkit_on_message(WebKitWebView *view, WebKitWebFrame *frame, gchar *message, gpointer user_data) {
     gchar ** message_parts = g_strsplit (message, "###", -1);
     gchar * command = message_parts[0];
@@ -187,6 +279,10 @@ gboolean webkit_on_message(WebKitWebView *view, WebKitWebFrame *frame, gchar *me
     else if (strcmp(command, "SESSION") == 0) {
         current_session = message_parts[2];
     }
+    else if (strcmp(command, "FILTER") == 0) {
+        theme_filters = TRUE;
+        mdm_users_filter (message_parts[1]);
+    }
     else if (strcmp(command, "SHUTDOWN") == 0) {
         if (mdm_wm_warn_dialog (_("Are you sure you want to shut down the computer?"), "", _("Shut _Down"), NULL, TRUE) == GTK_RESPONSE_YES) {
             _exit (DISPLAY_HALT);
@@ -243,6 +339,7 @@ void webkit_on_resource_failed (WebKitWebView *web_view, WebKitWebFrame *web_fra
 void webkit_on_loaded(WebKitWebView *view, WebKitWebFrame *frame, gpointer user_data) {
     GIOChannel *ctrlch;
     webkit_ready = TRUE;
+    mdm_trace_mark ("page_loaded");
     mdm_common_login_sound (mdm_config_get_string (MDM_KEY_SOUND_PROGRAM), mdm_config_get_string (MDM_KEY_SOUND_ON_LOGIN_FILE), mdm_config_get_bool   (MDM_KEY_SOUND_ON_LOGIN));
     mdm_set_welcomemsg ();
     update_clock ();
@@ -280,14 +377,10 @@ void webkit_on_loaded(WebKitWebView *view, WebKitWebFrame *frame, gpointer user_
             untranslated = mdm_lang_untranslated_name (current_lang, TRUE);
 
             if (untranslated != NULL) {
-                gchar * args = g_strdup_printf("%s\", \"%s", untranslated, current_lang);
-                webkit_execute_script("mdm_set_current_language", args);
-                g_free (args);
+                webkit_call("mdm_set_current_language", untranslated, current_lang, NULL);
             }
             else {
-                gchar * args = g_strdup_printf("%s\", \"%s", name, current_lang);
-                webkit_execute_script("mdm_set_current_language", args);
-                g_free (args);
+                webkit_call("mdm_set_current_language", name, current_lang, NULL);
             }
         }
         g_free (name);
@@ -346,22 +439,6 @@ static gboolean mdm_timer_up_delay (GSignalInvocationHint *ihint, guint n_param_
     return TRUE;
 }
 
-// The reaping stuff
-static time_t last_reap_delay = 0;
-
-static gboolean delay_reaping (GSignalInvocationHint *ihint, guint  n_param_values, const GValue *param_values, gpointer data) {
-    last_reap_delay = time (NULL);
-    return TRUE;
-}
-
-static gboolean reap_flexiserver (gpointer data) {
-    int reapminutes = mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES);
-    if (reapminutes > 0 && ((time (NULL) - last_reap_delay) / 60) > reapminutes) {
-        _exit (DISPLAY_REMANAGE);
-    }
-    return TRUE;
-}
-
 static void mdm_login_done (int sig) {
     _exit (EXIT_SUCCESS);
 }
@@ -384,9 +461,7 @@ void mdm_login_session_init () {
         label = g_strdup (session->name);
         num++;
 
-        gchar * args = g_strdup_printf("%s\", \"%s", label, file);
-        webkit_execute_script("mdm_add_session", args);
-        g_free (args);
+        webkit_call("mdm_add_session", label, file, NULL);
         g_free (label);
     }
 
@@ -428,14 +503,10 @@ void mdm_login_lang_init (gchar * locale_file) {
         untranslated = mdm_lang_untranslated_name (lang, TRUE);
 
         if (untranslated != NULL) {
-            gchar * args = g_strdup_printf("%s\", \"%s", untranslated, lang);
-            webkit_execute_script("mdm_add_language", args);
-            g_free (args);
+            webkit_call("mdm_add_language", untranslated, lang, NULL);
         }
         else {
-            gchar * args = g_strdup_printf("%s\", \"%s", name, lang);
-            webkit_execute_script("mdm_add_language", args);
-            g_free (args);
+            webkit_call("mdm_add_language", name, lang, NULL);
         }
 
         g_free (name);
@@ -509,7 +580,9 @@ void process_operation (guchar op_code, const gchar *args) {
     switch (op_code) {
 
         case MDM_SETLOGIN:
-            webkit_execute_script("mdm_set_current_user", html_encode(args));
+            tmp = html_encode(args);
+            webkit_execute_script("mdm_set_current_user", tmp);
+            g_free (tmp);
             printf ("%c\n", STX);
             fflush (stdout);
             break;
@@ -602,7 +675,7 @@ void process_operation (guchar op_code, const gchar *args) {
                 err_box_clear_handler = 0;
             }
             else {
-                err_box_clear_handler = g_timeout_add (30000, err_box_clear, NULL);
+                err_box_clear_handler = mdm_common_timeout_add_seconds (30, err_box_clear, NULL);
             }
             printf ("%c\n", STX);
             fflush (stdout);
@@ -643,9 +716,7 @@ void process_operation (guchar op_code, const gchar *args) {
         case MDM_SETSESS:
             current_session = args;
             gchar * session_file = g_strdup_printf("%s.desktop", args);
-            gchar * wargs = g_strdup_printf("%s\", \"%s", mdm_session_name(session_file), session_file);
-            webkit_execute_script("mdm_set_current_session", wargs);
-            g_free (wargs);
+            webkit_call("mdm_set_current_session", mdm_session_name(session_file), session_file, NULL);
             mdm_debug("mdm_verify_set_user_settings: mdm_set_current_session '%s'.", args);
             printf ("%c\n", STX);
             fflush (stdout);
@@ -662,14 +733,10 @@ void process_operation (guchar op_code, const gchar *args) {
                     untranslated = mdm_lang_untranslated_name (args, TRUE);
 
                     if (untranslated != NULL) {
-                        gchar * wargs = g_strdup_printf("%s\", \"%s", untranslated, args);
-                        webkit_execute_script("mdm_set_current_language", wargs);
-                        g_free (wargs);
+                        webkit_call("mdm_set_current_language", untranslated, args, NULL);
                     }
                     else {
-                        gchar * wargs = g_strdup_printf("%s\", \"%s", name, args);
-                        webkit_execute_script("mdm_set_current_language", wargs);
-                        g_free (wargs);
+                        webkit_call("mdm_set_current_language", name, args, NULL);
                     }
                 }
                 g_free (name);
@@ -730,7 +797,7 @@ void process_operation (guchar op_code, const gchar *args) {
         case MDM_STARTTIMER:
             if (timed_handler_id == 0 && mdm_config_get_bool (MDM_KEY_TIMED_LOGIN_ENABLE) && ! ve_string_empty (mdm_config_get_string (MDM_KEY_TIMED_LOGIN)) && mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY) > 0) {
                 mdm_timed_delay = mdm_config_get_int (MDM_KEY_TIMED_LOGIN_DELAY);
-                timed_handler_id  = g_timeout_add (1000, mdm_timer, NULL);
+                timed_handler_id  = mdm_common_timeout_add_seconds (1, mdm_timer, NULL);
             }
             printf ("%c\n", STX);
             fflush (stdout);
@@ -805,33 +872,64 @@ void process_operation (guchar op_code, const gchar *args) {
 }
 
 
-void mdm_login_browser_populate (void) {
-    check_for_displays ();
+static void mdm_login_browser_add_user (MdmUser *usr) {
+    char *login, *gecos, *status, *facefile;
+
+    facefile = mdm_common_get_facefile(usr->homedir, usr->login, usr->uid);
+    login = mdm_common_text_to_escaped_utf8 (usr->login);
+    gecos = mdm_common_text_to_escaped_utf8 (usr->gecos);
+
+    if (displays_hash != NULL && g_hash_table_lookup (displays_hash, usr->login)) {
+        status = _("Already logged in");
+    }
+    else {
+        status = "";
+    }
+    webkit_call("mdm_add_user", login, gecos, status, facefile, NULL);
+    g_free (login);
+    g_free (gecos);
+    g_free (facefile);
+}
 
+static void mdm_login_browser_show_users (GList *visible, gpointer data) {
     GList *li;
-    for (li = users; li != NULL; li = li->next) {
-        MdmUser *usr = li->data;
-        char *login, *gecos, *status, *facefile;
-        facefile = mdm_common_get_facefile(usr->homedir, usr->login, usr->uid);
-        login = mdm_common_text_to_escaped_utf8 (usr->login);
-        gecos = mdm_common_text_to_escaped_utf8 (usr->gecos);
-
-        if (g_hash_table_lookup (displays_hash, usr->login)) {
-            status = _("Already logged in");
+
+    /* the theme gets the users once it's loaded, from the populate below */
+    if (!webkit_ready) {
+        return;
+    }
+
+    if (users_shown == NULL) {
+        users_shown = g_hash_table_new (NULL, NULL);
+    }
+
+    for (li = visible; li != NULL; li = li->next) {
+        if (!g_hash_table_contains (users_shown, li->data)) {
+            mdm_login_browser_add_user (li->data);
+            g_hash_table_add (users_shown, li->data);
         }
-        else {
-            status = "";
+    }
+
+    if (theme_filters) {
+        GString *logins = g_string_new (NULL);
+
+        for (li = visible; li != NULL; li = li->next) {
+            MdmUser *usr = li->data;
+            if (logins->len > 0) {
+                g_string_append_c (logins, ' ');
+            }
+            g_string_append (logins, usr->login);
         }
-        gchar * args = g_strdup_printf("%s\", \"%s\", \"%s\", \"%s", login, gecos, status, facefile);
-        webkit_execute_script("mdm_add_user", args);
-        g_free (args);
-        g_free (login);
-        g_free (gecos);
+        webkit_execute_script("mdm_show_users", logins->str);
+        g_string_free (logins, TRUE);
     }
+}
+
+void mdm_login_browser_populate (void) {
+    check_for_displays ();
 
-    /* we are done with the hash */
-    g_hash_table_destroy (displays_hash);
-    displays_hash = NULL;
+    /* only the users matching what has been typed are shown */
+    mdm_users_set_view_func (mdm_login_browser_show_users, NULL);
     return;
 }
 
@@ -844,11 +942,12 @@ gboolean update_clock (void) {
     webkit_execute_script("set_clock", str);
     g_free (str);
 
-    /* account for leap seconds */
-    time_til_next_min = 60 - the_tm->tm_sec;
+    /* account for leap seconds, and wait a second longer as the
+     * timeout may fire a little early and show the old minute again */
+    time_til_next_min = 60 - the_tm->tm_sec + 1;
     time_til_next_min = (time_til_next_min>=0?time_til_next_min:0);
 
-    g_timeout_add (time_til_next_min*1000, (GSourceFunc)update_clock, NULL);
+    mdm_common_timeout_add_seconds (time_til_next_min, (GSourceFunc)update_clock, NULL);
     return FALSE;
 }
 
@@ -871,14 +970,49 @@ static gboolean key_press_event (GtkWidget *widget, GdkEventKey *key, gpointer d
 }
 
 static void webkit_init (void) {
-    GError *error;
+    GError *error = NULL;
+    MdmTemplate *template;
     char *html;
-    gsize file_length;
+    char lsb_description[255] = "";
+    FILE *fp;
     gchar * theme_name = mdm_config_get_string (MDM_KEY_HTML_THEME);
     gchar * theme_dir = g_strdup_printf("file:///usr/share/mdm/html-themes/%s/", theme_name);
     gchar * theme_filename = g_strdup_printf("/usr/share/mdm/html-themes/%s/index.html", theme_name);
 
-    if (!g_file_get_contents (theme_filename, &html, &file_length, error)) {
+    fp = popen("lsb_release -d -s", "r");
+    if (fp != NULL) {
+        if (fgets(lsb_description, sizeof (lsb_description), fp) == NULL)
+            lsb_description[0] = '\0';
+        pclose(fp);
+    }
+
+    /* The labels get escaped, the rest goes in as it is */
+    MdmTemplateParam params[] = {
+        { "lsb_description", lsb_description, FALSE },
+        { "login_label", _("Login"), TRUE },
+        { "ok_label", _("OK"), TRUE },
+        { "cancel_label", _("Cancel"), TRUE },
+        { "enter_your_username_label", _("Please enter your username"), TRUE },
+        { "enter_your_password_label", _("Please enter your password"), TRUE },
+        { "hostname", g_get_host_name (), FALSE },
+        { "shutdown", _("Shutdown"), TRUE },
+        { "suspend", _("Suspend"), TRUE },
+        { "quit", _("Quit"), TRUE },
+        { "restart", _("Restart"), TRUE },
+        { "session", _("Session"), TRUE },
+        { "selectsession", _("Select a session"), TRUE },
+        { "defaultsession", _("Default session"), TRUE },
+        { "selectuser", _("Please select a user."), TRUE },
+        { "pressf1toenterusername", _("Press F1 to enter a username."), TRUE },
+        { "language", _("Language"), TRUE },
+        { "selectlanguage", _("Select a language"), TRUE },
+        { "areyousuretoquit", _("Are you sure you want to quit?"), TRUE },
+        { "close", _("Close"), TRUE },
+        { "locale", setlocale (LC_MESSAGES, NULL), FALSE },
+    };
+
+    template = mdm_template_load (theme_filename, params, G_N_ELEMENTS (params), &error);
+    if (template == NULL) {
         GtkWidget *dialog;
         char *s;
         char *tmp;
@@ -909,34 +1043,11 @@ static void webkit_init (void) {
 
     }
 
-    char lsb_description[255];
-    FILE *fp = popen("lsb_release -d -s", "r");
-    fgets(lsb_description, 255, fp);
-    pclose(fp);
-
-    html = str_replace(html, "$lsb_description", lsb_description);
-    html = str_replace(html, "$login_label", html_encode(_("Login")));
-    html = str_replace(html, "$ok_label", html_encode(_("OK")));
-    html = str_replace(html, "$cancel_label", html_encode(_("Cancel")));
-    html = str_replace(html, "$enter_your_username_label", html_encode(_("Please enter your username")));
-    html = str_replace(html, "$enter_your_password_label", html_encode(_("Please enter your password")));
-    html = str_replace(html, "$hostname", g_get_host_name());
-    html = str_replace(html, "$shutdown", html_encode(_("Shutdown")));
-    html = str_replace(html, "$suspend", html_encode(_("Suspend")));
-    html = str_replace(html, "$quit", html_encode(_("Quit")));
-    html = str_replace(html, "$restart", html_encode(_("Restart")));
-    html = str_replace(html, "$session", html_encode(_("Session")));
-    html = str_replace(html, "$selectsession", html_encode(_("Select a session")));
-    html = str_replace(html, "$defaultsession", html_encode(_("Default session")));
-    html = str_replace(html, "$selectuser", html_encode(_("Please select a user.")));
-    html = str_replace(html, "$pressf1toenterusername", html_encode(_("Press F1 to enter a username.")));
-    html = str_replace(html, "$language", html_encode(_("Language")));
-    html = str_replace(html, "$selectlanguage", html_encode(_("Select a language")));
-    html = str_replace(html, "$areyousuretoquit", html_encode(_("Are you sure you want to quit?")));
-    html = str_replace(html, "$close", html_encode(_("Close")));
-    html = str_replace(html, "$locale", g_strdup (setlocale (LC_MESSAGES, NULL)));
+    html = mdm_template_render (template, params);
+    mdm_template_unref (template);
 
     webView = WEBKIT_WEB_VIEW(webkit_web_view_new());
+    mdm_trace_first_expose (GTK_WIDGET (webView));
 
     WebKitWebSettings *settings = webkit_web_settings_new ();
     g_object_set (G_OBJECT(settings), "enable-default-context-menu", FALSE, NULL);
@@ -968,6 +1079,7 @@ static void webkit_init (void) {
     webkit_web_view_set_transparent (webView, TRUE);
 
     webkit_web_view_load_string(webView, html, "text/html", "UTF-8", theme_dir);
+    g_free (html);
 
     g_signal_connect(G_OBJECT(webView), "script-alert", G_CALLBACK(webkit_on_message), NULL);
     g_signal_connect(G_OBJECT(webView), "load-finished", G_CALLBACK(webkit_on_loaded), NULL);
@@ -978,111 +1090,23 @@ static void webkit_init (void) {
 }
 
 
-static GdkPixbuf *
-render_scaled_back (const GdkPixbuf *pb)
-{
-    int i;
-    int width, height;
-
-    GdkPixbuf *back = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
-                      gdk_pixbuf_get_has_alpha (pb),
-                      8,
-                      gdk_screen_width (),
-                      gdk_screen_height ());
-
-    width = gdk_pixbuf_get_width (pb);
-    height = gdk_pixbuf_get_height (pb);
-
-    for (i = 0; i < mdm_wm_num_monitors; i++) {
-        gdk_pixbuf_scale (pb, back,
-                  mdm_wm_all_monitors[i].x,
-                  mdm_wm_all_monitors[i].y,
-                  mdm_wm_all_monitors[i].width,
-                  mdm_wm_all_monitors[i].height,
-                  mdm_wm_all_monitors[i].x /* offset_x */,
-                  mdm_wm_all_monitors[i].y /* offset_y */,
-                  (double) mdm_wm_all_monitors[i].width / width,
-                  (double) mdm_wm_all_monitors[i].height / height,
-                  GDK_INTERP_BILINEAR);
-    }
-
-    return back;
-}
-
-static void
-add_color_to_pb (GdkPixbuf *pb, GdkColor *color)
-{
-    int width = gdk_pixbuf_get_width (pb);
-    int height = gdk_pixbuf_get_height (pb);
-    int rowstride = gdk_pixbuf_get_rowstride (pb);
-    guchar *pixels = gdk_pixbuf_get_pixels (pb);
-    gboolean has_alpha = gdk_pixbuf_get_has_alpha (pb);
-    int i;
-    int cr = color->red >> 8;
-    int cg = color->green >> 8;
-    int cb = color->blue >> 8;
-
-    if ( ! has_alpha)
-        return;
-
-    for (i = 0; i < height; i++) {
-        int ii;
-        guchar *p = pixels + (rowstride * i);
-        for (ii = 0; ii < width; ii++) {
-            int r = p[0];
-            int g = p[1];
-            int b = p[2];
-            int a = p[3];
-
-            p[0] = (r * a + cr * (255 - a)) >> 8;
-            p[1] = (g * a + cg * (255 - a)) >> 8;
-            p[2] = (b * a + cb * (255 - a)) >> 8;
-            p[3] = 255;
-
-            p += 4;
-        }
-    }
-}
-
-
 /* setup background color/image */
 static void
 setup_background (void)
 {
-    GdkColor color;
-    GdkPixbuf *pb = NULL;
     gchar *bg_color = mdm_config_get_string (MDM_KEY_BACKGROUND_COLOR);
     gchar *bg_image = mdm_config_get_string (MDM_KEY_BACKGROUND_IMAGE);
     gint   bg_type  = mdm_config_get_int    (MDM_KEY_BACKGROUND_TYPE);
 
+    /* Load background image */
     if ((bg_type == MDM_BACKGROUND_IMAGE ||
          bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) &&
-        ! ve_string_empty (bg_image))
-        pb = gdk_pixbuf_new_from_file (bg_image, NULL);
-
-    /* Load background image */
-    if (pb != NULL) {
-        if (gdk_pixbuf_get_has_alpha (pb)) {
-            if (bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR) {
-                if (bg_color == NULL ||
-                    bg_color[0] == '\0' ||
-                    ! gdk_color_parse (bg_color,
-                           &color)) {
-                    gdk_color_parse ("#000000", &color);
-                }
-                add_color_to_pb (pb, &color);
-            }
-        }
-
-        GdkPixbuf *spb = render_scaled_back (pb);
-        g_object_unref (G_OBJECT (pb));
-        pb = spb;
-
-        /* paranoia */
-        if (pb != NULL) {
-            mdm_common_set_root_background (pb);
-            g_object_unref (G_OBJECT (pb));
-        }
+        ! ve_string_empty (bg_image) &&
+        mdm_common_set_root_background_image (bg_image, bg_color,
+                                              bg_type == MDM_BACKGROUND_IMAGE_AND_COLOR,
+                                              mdm_wm_all_monitors,
+                                              mdm_wm_num_monitors)) {
+        return;
     /* Load background color */
     } else if (bg_type != MDM_BACKGROUND_NONE &&
                bg_type != MDM_BACKGROUND_IMAGE) {
@@ -1171,6 +1195,8 @@ int main (int argc, char *argv[]) {
     sigset_t mask;
     guint sid;
 
+    mdm_trace_init ("mdmwebkit");
+
     if (g_getenv ("DOING_MDM_DEVELOPMENT") != NULL) {
         DOING_MDM_DEVELOPMENT = TRUE;
     }
@@ -1180,6 +1206,7 @@ int main (int argc, char *argv[]) {
     textdomain (GETTEXT_PACKAGE);
 
     gtk_init (&argc, &argv);
+    mdm_trace_mark ("gtk_init");
 
     mdm_common_log_init ();
     mdm_common_log_set_debug (mdm_config_get_bool (MDM_KEY_DEBUG));
@@ -1198,12 +1225,23 @@ int main (int argc, char *argv[]) {
         mdm_common_warning ("mdmwebkit: Could not open DefaultFace: %s!", mdm_config_get_string (MDM_KEY_DEFAULT_FACE));
     }
 
+    mdm_trace_begin ("mdm_session_list_init");
     mdm_session_list_init ();
-    mdm_users_init (&users, &users_string, NULL, defface, &size_of_users, TRUE, !DOING_MDM_DEVELOPMENT);
-
+    mdm_trace_end ("mdm_session_list_init");
+    /* Themes load the faces themselves from the face file path given to
+     * mdm_add_user, so don't have the slave send them over only to decode
+     * them for nothing */
+    mdm_trace_begin ("mdm_users_init");
+    mdm_users_init (&users, &users_string, NULL, defface, &size_of_users, TRUE, FALSE);
+    mdm_trace_end ("mdm_users_init");
+
+    mdm_trace_begin ("webkit_init");
     webkit_init();
+    mdm_trace_end ("webkit_init");
 
+    mdm_trace_begin ("mdm_login_gui_init");
     mdm_login_gui_init ();
+    mdm_trace_end ("mdm_login_gui_init");
 
     hup.sa_handler = ve_signal_notify;
     hup.sa_flags = 0;
@@ -1250,19 +1288,7 @@ int main (int argc, char *argv[]) {
     }
 
     /* if a flexiserver, reap self after some time */
-    if (mdm_config_get_int (MDM_KEY_FLEXI_REAP_DELAY_MINUTES) > 0 && ! ve_string_empty (g_getenv ("MDM_FLEXI_SERVER")) ) {
-        sid = g_signal_lookup ("activate", GTK_TYPE_MENU_ITEM);
-        g_signal_add_emission_hook (sid, 0, delay_reaping, NULL, NULL);
-
-        sid = g_signal_lookup ("key_release_event", GTK_TYPE_WIDGET);
-        g_signal_add_emission_hook (sid, 0, delay_reaping, NULL, NULL);
-
-        sid = g_signal_lookup ("button_press_event", GTK_TYPE_WIDGET);
-        g_signal_add_emission_hook (sid, 0, delay_reaping, NULL, NULL);
-
-        last_reap_delay = time (NULL);
-        g_timeout_add (60*1000, reap_flexiserver, NULL);
-    }
+    mdm_common_setup_reaping (NULL);
 
     gtk_widget_queue_resize (login);
     gtk_widget_show_now (login);
@@ -1283,6 +1309,7 @@ int main (int argc, char *argv[]) {
 
     mdm_wm_center_cursor ();
 
+    mdm_trace_mark ("gtk_main");
     gtk_main ();
 
     return EXIT_SUCCESS;
@@ -59,7 +59,10 @@ struct _MdmWindow {
 	int ignore_next_unmap;
 };
 
+/* Managed windows, the newest first */
 static GList *windows = NULL;
+/* The same windows by XID, also under their deco and shadow windows */
+static GHashTable *window_hash = NULL;
 static gboolean focus_new_windows = FALSE;
 static int no_focus_login = 0;
 static Display *wm_disp = NULL;
@@ -365,33 +368,37 @@ wm_protocol_check_support (Window xwin,
   return is_supported;
 }
 
-static GList *
-find_window_list (Window w, gboolean deco_ok)
-{
-	GList *li;
-
-	for (li = windows; li != NULL; li = li->next) {
-		MdmWindow *gw = li->data;
+#define XID_KEY(w) GSIZE_TO_POINTER ((gsize) (w))
 
-		if (gw->win == w)
-			return li;
-		if (deco_ok &&
-		    (gw->deco == w ||
-		     gw->shadow == w))
-			return li;
-	}
+static void
+window_hash_add (MdmWindow *gw, Window w)
+{
+	if (w != None)
+		g_hash_table_insert (window_hash, XID_KEY (w), gw);
+}
 
-	return NULL;
+static void
+window_hash_remove (MdmWindow *gw, Window w)
+{
+	if (w != None &&
+	    g_hash_table_lookup (window_hash, XID_KEY (w)) == gw)
+		g_hash_table_remove (window_hash, XID_KEY (w));
 }
 
 static MdmWindow *
 find_window (Window w, gboolean deco_ok)
 {
-	GList *li = find_window_list (w, deco_ok);
-	if (li == NULL)
+	MdmWindow *gw;
+
+	if (window_hash == NULL || w == None)
 		return NULL;
-	else
-		return li->data;
+
+	gw = g_hash_table_lookup (window_hash, XID_KEY (w));
+	if (gw == NULL ||
+	    ( ! deco_ok && gw->win != w))
+		return NULL;
+
+	return gw;
 }
 
 void
@@ -675,6 +682,7 @@ add_deco (MdmWindow *w, gboolean is_mapped)
 						 black, black);
 
 		XMapWindow (wm_disp, w->shadow);
+		window_hash_add (w, w->shadow);
 	}
 
 	w->deco = XCreateSimpleWindow (wm_disp,
@@ -684,6 +692,7 @@ add_deco (MdmWindow *w, gboolean is_mapped)
 				       height + 2 + 2 * border,
 				       0, 
 				       black, black);
+	window_hash_add (w, w->deco);
 
 	XGetWindowAttributes (wm_disp, w->deco, &attribs);
 	XSelectInput (wm_disp, w->deco,
@@ -743,6 +752,7 @@ add_window (Window w, gboolean center, gboolean is_mapped)
 		gw = g_new0 (MdmWindow, 1);
 		gw->win = w;
 		windows = g_list_prepend (windows, gw);
+		window_hash_add (gw, w);
 
 		trap_push ();
 
@@ -814,15 +824,16 @@ add_window (Window w, gboolean center, gboolean is_mapped)
 static void
 remove_window (Window w)
 {
-	GList *li = find_window_list (w, FALSE);
+	MdmWindow *gw = find_window (w, FALSE);
 
 	if (w == wm_focus_window)
 		wm_focus_window = None;
 
-	if (li != NULL) {
-		MdmWindow *gw = li->data;
-
-		li->data = NULL;
+	if (gw != NULL) {
+		window_hash_remove (gw, gw->win);
+		window_hash_remove (gw, gw->deco);
+		window_hash_remove (gw, gw->shadow);
+		windows = g_list_remove (windows, gw);
 
 		trap_push ();
 
@@ -840,9 +851,6 @@ remove_window (Window w)
 		}
 		trap_pop ();
 
-		windows = g_list_remove_link (windows, li);
-		g_list_free_1 (li);
-
 		g_free (gw);
 	}
 }
@@ -937,6 +945,10 @@ shadow_follow (MdmWindow *gw)
 	trap_pop ();
 }
 
+/* Set when a strut changed, all windows get constrained once
+ * the events queued up so far are processed */
+static gboolean constrain_pending = FALSE;
+
 static void
 event_process (XEvent *ev)
 {
@@ -1088,7 +1100,7 @@ event_process (XEvent *ev)
 		{
 			mdm_wm_update_struts (ev->xproperty.display, 
 					      ev->xproperty.window);
-			constrain_all_windows ();
+			constrain_pending = TRUE;
 		}
 		break;
 	default:
@@ -1127,6 +1139,13 @@ process_events (void)
 		XNextEvent (wm_disp, &ev);
 		event_process (&ev);
 	}
+
+	if (constrain_pending) {
+		constrain_pending = FALSE;
+		trap_push ();
+		constrain_all_windows ();
+		trap_pop ();
+	}
 }
 
 static gboolean  
@@ -1190,6 +1209,7 @@ mdm_wm_init (Window login_window)
 
 	trap_push ();
 
+	window_hash = g_hash_table_new (NULL, NULL);
 	add_all_current_windows ();
 
 	source = g_source_new (&event_funcs, sizeof (GSource));
@@ -82,6 +82,11 @@ typedef struct {
 static int lineno = 0;
 static GSList *binding_list = NULL;
 
+/* The bindings in binding_list that can end with a crossing of each
+ * border, indexed by border_index () */
+#define N_BORDERS 4
+static GSList *bindings_by_border[N_BORDERS];
+
 extern char **environ;
 
 static guint enter_signal_id = 0;
@@ -97,6 +102,7 @@ static gchar * screen_exec_display_string (GdkScreen *screen, const char *old);
 static gchar ** get_exec_environment (GdkScreen *screen);
 static Binding * parse_line(gchar *buf);
 static gboolean binding_already_used (Binding *binding);
+static void index_bindings (void);
 static gboolean debug_gestures = FALSE;
 
 BindingType get_binding_type(char c);
@@ -410,6 +416,63 @@ load_bindings(gchar *path)
 		}
 	}
 	fclose (fp);
+
+	index_bindings ();
+}
+
+static int
+border_index (BindingType type)
+{
+	switch (type) {
+	case BINDING_DWELL_BORDER_TOP:
+		return 0;
+	case BINDING_DWELL_BORDER_BOTTOM:
+		return 1;
+	case BINDING_DWELL_BORDER_RIGHT:
+		return 2;
+	case BINDING_DWELL_BORDER_LEFT:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * A binding is recognized on the crossing of the last border in it,
+ * so each crossing only needs to check the bindings ending with that
+ * border.  The file order is kept.
+ */
+static void
+index_bindings (void)
+{
+	GSList *li;
+	int i;
+
+	for (i = 0; i < N_BORDERS; i++) {
+		g_slist_free (bindings_by_border[i]);
+		bindings_by_border[i] = NULL;
+	}
+
+	for (li = binding_list; li != NULL; li = li->next) {
+		Binding *binding = li->data;
+		int last;
+
+		if (binding->input.num_gestures == 0) {
+			/* no borders to check, any crossing will do */
+			for (i = 0; i < N_BORDERS; i++)
+				bindings_by_border[i] =
+					g_slist_prepend (bindings_by_border[i], binding);
+			continue;
+		}
+
+		last = border_index (binding->input.gesture[binding->input.num_gestures - 1]);
+		if (last >= 0)
+			bindings_by_border[last] =
+				g_slist_prepend (bindings_by_border[last], binding);
+	}
+
+	for (i = 0; i < N_BORDERS; i++)
+		bindings_by_border[i] = g_slist_reverse (bindings_by_border[i]);
 }
 
 static gboolean
@@ -435,6 +498,7 @@ leave_enter_emission_hook (GSignalInvocationHint        *ihint,
 	GdkRectangle rect;
 	GSList *li;
 	double mid_x, mid_y;
+	int border;
 	int i;
 
 	object = g_value_get_object (param_values + 0);
@@ -501,7 +565,9 @@ leave_enter_emission_hook (GSignalInvocationHint        *ihint,
 	crossings[cross_pos].time = event->time;
 
 	/* Check to see if a gesture has been completed */
-	for (li=binding_list; li != NULL; li = li->next) {
+	border = border_index (crossings[cross_pos].type);
+	for (li = (border >= 0) ? bindings_by_border[border] : NULL;
+	     li != NULL; li = li->next) {
 		Binding *curr_binding = (Binding *) li->data;
 		GSList *act_li;
 		gboolean retval;
@@ -611,6 +677,10 @@ create_event_watcher (void)
 
 	load_bindings(CONFIGFILE);
 
+	/* nothing to recognize, do not watch the crossings */
+	if (binding_list == NULL)
+		return;
+
 	crossings = g_new0(Crossings, max_crossings);
 
 	for (i=0; i < max_crossings; i++) {
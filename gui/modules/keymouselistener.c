@@ -102,17 +102,22 @@ static gboolean debug_gestures = FALSE;
 static GSList   *gesture_list  = NULL;
 static int      lineno         = 0;
 
+/* The first gesture in gesture_list for each input, see
+ * gesture_index_key () */
+static GHashTable *gesture_index  = NULL;
+/* Whether some key gestures have no keycode yet */
+static gboolean    unresolved_keys = FALSE;
+
 static gchar * screen_exec_display_string (GdkScreen *screen, const char *old);
 static void create_event_watcher (void);
 static void load_gestures(gchar *path);
+static void build_gesture_index (void);
 static gchar ** get_exec_environment (XEvent *xevent);
 static Gesture * parse_line(gchar *buf);
 static GdkFilterReturn gestures_filter (GdkXEvent *gdk_xevent, GdkEvent *event, gpointer data);
 static gint is_mouseX (const gchar *string);
 static gint is_switchX (const gchar *string);
 
-#define gesture_list_get_matches(a, b, c) (g_slist_find_custom (a, b, c))
-
 static void
 free_gesture (Gesture *gesture)
 {
@@ -295,6 +300,8 @@ load_gestures(gchar *path)
 		}
 	}
 	fclose (fp);
+
+	build_gesture_index ();
 }
 
 
@@ -576,60 +583,135 @@ keycodes_equal (XEvent *ev1, XEvent *ev2)
 	return FALSE;
 }
 
-static gint
-key_gesture_compare_func (gconstpointer a, gconstpointer b)
+/*
+ * Gestures are looked up by what they match rather than compared one
+ * by one for each event: key gestures by keycode and modifiers, mouse
+ * and switch gestures by button number.
+ */
+static guint
+gesture_index_key (GestureType type, guint code, guint state)
+{
+	return (type << 16) | ((state & USED_MODS) << 8) | code;
+}
+
+static void
+build_gesture_index (void)
 {
-	Gesture *gesture   = a;
-	const XEvent  *xev = b;
+	GSList *li;
 
-	if (gesture->type == GESTURE_TYPE_KEY) 
-	{
-	    /*
-	     * Using some Xservers, the parse_line function fails to get the
-	     * keycode because XKB is not initialized when mdmlogin starts.
-	     * If the keycode value is 0, try to set it again.
-	     */
-	    if (gesture->input.key.keycode == 0) {
-		static GdkDisplay *display = NULL;
-
-		if (!display)
-		    display = gdk_display_get_default();
-
-		if (display) {
-		    gesture->input.key.keycode =
+	if (gesture_index == NULL)
+		gesture_index = g_hash_table_new (NULL, NULL);
+	else
+		g_hash_table_remove_all (gesture_index);
+
+	unresolved_keys = FALSE;
+
+	for (li = gesture_list; li != NULL; li = li->next) {
+		Gesture *gesture = li->data;
+		guint key;
+
+		if (gesture->type == GESTURE_TYPE_KEY) {
+			if (gesture->input.key.keycode == 0) {
+				unresolved_keys = TRUE;
+				continue;
+			}
+			/* such gestures can never match */
+			if ((gesture->input.key.state & ~USED_MODS) != 0 ||
+			    gesture->input.key.keycode > 0xff)
+				continue;
+			key = gesture_index_key (gesture->type,
+						 gesture->input.key.keycode,
+						 gesture->input.key.state);
+		} else {
+			if (gesture->input.button.number > 0xff)
+				continue;
+			key = gesture_index_key (gesture->type,
+						 gesture->input.button.number,
+						 0);
+		}
+
+		/* the first one in the file wins */
+		if (g_hash_table_lookup (gesture_index, GUINT_TO_POINTER (key)) == NULL)
+			g_hash_table_insert (gesture_index,
+					     GUINT_TO_POINTER (key), gesture);
+	}
+}
+
+/*
+ * Using some Xservers, the parse_line function fails to get the
+ * keycode because XKB is not initialized when mdmlogin starts.
+ * Try to set the missing keycodes again.
+ */
+static void
+resolve_keycodes (void)
+{
+	static GdkDisplay *display = NULL;
+	gboolean resolved = FALSE;
+	GSList *li;
+
+	if (!display)
+		display = gdk_display_get_default();
+
+	if (!display) {
+		if (debug_gestures)
+			syslog (LOG_WARNING, "Failed to reset keycode to a real value");
+		return;
+	}
+
+	for (li = gesture_list; li != NULL; li = li->next) {
+		Gesture *gesture = li->data;
+
+		if (gesture->type != GESTURE_TYPE_KEY ||
+		    gesture->input.key.keycode != 0)
+			continue;
+
+		gesture->input.key.keycode =
 			XKeysymToKeycode (GDK_DISPLAY_XDISPLAY (display),
 			gesture->input.key.keysym);
 
-		    if (debug_gestures)
-			syslog (LOG_WARNING, "Reset keycode to a real value");
-		} else if (debug_gestures) {
-		   syslog (LOG_WARNING, "Failed to reset keycode to a real value");
+		if (gesture->input.key.keycode != 0) {
+			resolved = TRUE;
+			if (debug_gestures)
+				syslog (LOG_WARNING, "Reset keycode to a real value");
 		}
-	    }
+	}
 
-	    if (((xev->type == KeyPress) || (xev->type == KeyRelease)) &&
-		(xev->xkey.keycode == gesture->input.key.keycode) &&
-		((xev->xkey.state & USED_MODS) == gesture->input.key.state))
-		return 0;
-	    else if (((xev->type == xinput_types[XINPUT_TYPE_KEY_PRESS]) ||
-		     (xev->type == xinput_types[XINPUT_TYPE_KEY_RELEASE])) &&
-		     (xev->xkey.keycode == gesture->input.key.keycode) &&
-		     ((xev->xkey.state & USED_MODS) == gesture->input.key.state))
-		return 0;
-	    else
-		return 1;
+	if (resolved)
+		build_gesture_index ();
+}
+
+static Gesture *
+gesture_lookup (XEvent *xev)
+{
+	GestureType type;
+	guint code;
+	guint state = 0;
+
+	if ((xev->type == KeyPress) || (xev->type == KeyRelease) ||
+	    (xev->type == xinput_types[XINPUT_TYPE_KEY_PRESS]) ||
+	    (xev->type == xinput_types[XINPUT_TYPE_KEY_RELEASE])) {
+		type  = GESTURE_TYPE_KEY;
+		code  = xev->xkey.keycode;
+		state = xev->xkey.state;
+
+		if (unresolved_keys)
+			resolve_keycodes ();
+	} else if ((xev->type == ButtonPress) || (xev->type == ButtonRelease)) {
+		type = GESTURE_TYPE_MOUSE;
+		code = xev->xbutton.button;
+	} else if ((xev->type == xinput_types[XINPUT_TYPE_BUTTON_PRESS]) ||
+		   (xev->type == xinput_types[XINPUT_TYPE_BUTTON_RELEASE])) {
+		type = GESTURE_TYPE_BUTTON;
+		code = ((XDeviceButtonEvent *) xev)->button;
+	} else {
+		return NULL;
 	}
-	else if ((gesture->type == GESTURE_TYPE_MOUSE) &&
-		 ((xev->type == ButtonPress) || (xev->type == ButtonRelease)) &&
-		 (xev->xbutton.button == gesture->input.button.number))
-		return 0;
-	else if ((gesture->type == GESTURE_TYPE_BUTTON) &&
-		 ((xev->type == xinput_types[XINPUT_TYPE_BUTTON_PRESS]) ||
-		  (xev->type == xinput_types[XINPUT_TYPE_BUTTON_RELEASE])) &&
-		 ((XDeviceButtonEvent *) xev)->button == gesture->input.button.number)
-		return 0;
-	else
-		return 1;
+
+	if (gesture_index == NULL || code > 0xff)
+		return NULL;
+
+	return g_hash_table_lookup (gesture_index,
+		GUINT_TO_POINTER (gesture_index_key (type, code, state)));
 }
 
 #define event_is_gesture_type(xevent) (xevent->type == KeyPress ||\
@@ -647,7 +729,7 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		 gpointer data)
 {
 	XEvent  *xevent = (XEvent *)gdk_xevent;
-	GSList  *li, *act_li;
+	GSList  *act_li;
 	Gesture *curr_gesture = NULL;
 	XID xinput_device = None;
 	
@@ -695,11 +777,9 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		}
 
 		/* Find the associated gesture for this keycode & state */
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
+		curr_gesture = gesture_lookup (xevent);
 
-		if (li) {
-			curr_gesture = li->data;
+		if (curr_gesture) {
 			if (debug_gestures)
 			    syslog (LOG_WARNING,
 				"found a press match [%s]",
@@ -747,12 +827,9 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		 * otherwise key gestures based on modifier keys such as
 		 * Control_R won't work.
 		 */
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
-
-	        if (li) {
-			curr_gesture = li->data;
+		curr_gesture = gesture_lookup (xevent);
 
+	        if (curr_gesture) {
 			if (debug_gestures)
 		 	   syslog (LOG_WARNING, "found a release match [%s]",
 				 curr_gesture->gesture_str);
@@ -811,14 +888,11 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		/*
 		 * Find the associated gesture for this button.
 		 */
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
-		if (li) {
+		curr_gesture = gesture_lookup (xevent);
+		if (curr_gesture) {
 			if (debug_gestures)
 				syslog (LOG_WARNING, "found match for press");
 
-			curr_gesture = li->data;
-
 			if (curr_gesture->timeout > 0 && seq_count > 0) {
 
 				/* xevent time values are in milliseconds. */
@@ -876,13 +950,11 @@ gestures_filter (GdkXEvent *gdk_xevent,
 		}
 #endif
 
-		li = gesture_list_get_matches (gesture_list, xevent,
-			key_gesture_compare_func);
+		curr_gesture = gesture_lookup (xevent);
 
-		if (li) {
+		if (curr_gesture) {
 			if (debug_gestures)
 			    syslog (LOG_WARNING, "found match for release");
-			curr_gesture = li->data;
 			if ((curr_gesture->duration > 0) &&
 			    (elapsed_time (last_event, xevent) < curr_gesture->duration)) {
 				seq_count = 0;
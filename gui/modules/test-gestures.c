@@ -0,0 +1,215 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+
+/* The module's statics are what is tested, so take it in whole */
+#include "keymouselistener.c"
+
+/* Usage: test-gestures [events] */
+
+#define N_KEY_STATES 5
+
+static const guint key_states[N_KEY_STATES] = {
+        0,
+        GDK_SHIFT_MASK,
+        GDK_CONTROL_MASK,
+        GDK_MOD1_MASK,
+        GDK_CONTROL_MASK | GDK_MOD1_MASK
+};
+
+/* Never completed, so replaying events does not run anything */
+static Gesture *
+new_gesture (GestureType type, guint code, guint state)
+{
+        Gesture *gesture = g_new0 (Gesture, 1);
+
+        gesture->type = type;
+        if (type == GESTURE_TYPE_KEY) {
+                gesture->input.key.keycode = code;
+                gesture->input.key.state = state;
+        } else {
+                gesture->input.button.number = code;
+        }
+        gesture->gesture_str = g_strdup_printf ("gesture-%u-%u-%u", type, code, state);
+        gesture->actions = g_slist_append (NULL, g_strdup ("true"));
+        gesture->n_times = G_MAXINT;
+
+        return gesture;
+}
+
+static void
+set_gestures (int n_keys)
+{
+        int i;
+
+        g_slist_foreach (gesture_list, (GFunc) free_gesture, NULL);
+        g_slist_free (gesture_list);
+        gesture_list = NULL;
+
+        for (i = 0; i < n_keys; i++)
+                gesture_list = g_slist_append (gesture_list,
+                        new_gesture (GESTURE_TYPE_KEY, 10 + i / N_KEY_STATES,
+                                     key_states[i % N_KEY_STATES]));
+
+        /* Shadowed by the first one, as in a gestures file */
+        gesture_list = g_slist_append (gesture_list,
+                new_gesture (GESTURE_TYPE_KEY, 10, 0));
+        /* Can never match */
+        gesture_list = g_slist_append (gesture_list,
+                new_gesture (GESTURE_TYPE_KEY, 11, GDK_LOCK_MASK));
+
+        for (i = 1; i <= 5; i++)
+                gesture_list = g_slist_append (gesture_list,
+                        new_gesture (GESTURE_TYPE_MOUSE, i, 0));
+
+        build_gesture_index ();
+}
+
+/* The walk over all gestures the filter did before */
+static Gesture *
+linear_lookup (XEvent *xev)
+{
+        GSList *li;
+
+        for (li = gesture_list; li != NULL; li = li->next) {
+                Gesture *gesture = li->data;
+
+                if (gesture->type == GESTURE_TYPE_KEY) {
+                        if (((xev->type == KeyPress) || (xev->type == KeyRelease)) &&
+                            (xev->xkey.keycode == gesture->input.key.keycode) &&
+                            ((xev->xkey.state & USED_MODS) == gesture->input.key.state))
+                                return gesture;
+                } else if ((gesture->type == GESTURE_TYPE_MOUSE) &&
+                           ((xev->type == ButtonPress) || (xev->type == ButtonRelease)) &&
+                           (xev->xbutton.button == gesture->input.button.number)) {
+                        return gesture;
+                }
+        }
+
+        return NULL;
+}
+
+/* Presses and releases of keys and buttons, some with gestures and
+ * most without, with the lock modifiers thrown in */
+static XEvent *
+random_events (GRand *rand, int n_events)
+{
+        XEvent *events = g_new0 (XEvent, n_events);
+        int     i;
+
+        for (i = 0; i < n_events; i += 2) {
+                XEvent *ev = &events[i];
+                int     time = i * 50;
+
+                if (g_rand_int_range (rand, 0, 4) == 0) {
+                        ev->xbutton.type = ButtonPress;
+                        ev->xbutton.button = g_rand_int_range (rand, 1, 10);
+                        ev->xbutton.time = time;
+                } else {
+                        ev->xkey.type = KeyPress;
+                        ev->xkey.keycode = g_rand_int_range (rand, 8, 256);
+                        ev->xkey.state = key_states[g_rand_int_range (rand, 0, N_KEY_STATES)];
+                        if (g_rand_boolean (rand))
+                                ev->xkey.state |= GDK_LOCK_MASK;
+                        ev->xkey.time = time;
+                }
+
+                if (i + 1 < n_events) {
+                        events[i + 1] = *ev;
+                        if (ev->type == KeyPress) {
+                                events[i + 1].xkey.type = KeyRelease;
+                                events[i + 1].xkey.time += 20;
+                        } else {
+                                events[i + 1].xbutton.type = ButtonRelease;
+                                events[i + 1].xbutton.time += 20;
+                        }
+                }
+        }
+
+        return events;
+}
+
+static void
+check_lookup (XEvent *events, int n_events)
+{
+        int i, matched = 0;
+
+        for (i = 0; i < n_events; i++) {
+                Gesture *want = linear_lookup (&events[i]);
+
+                if (gesture_lookup (&events[i]) != want)
+                        g_error ("event %d: the index and the list disagree", i);
+                if (want != NULL)
+                        matched++;
+        }
+
+        g_message ("index matches the list, %d of %d events match a gesture",
+                   matched, n_events);
+}
+
+static double
+bench (int what, XEvent *events, int n_events)
+{
+        GTimer *timer = g_timer_new ();
+        double  ret;
+        int     i;
+
+        for (i = 0; i < n_events; i++) {
+                if (what == 0)
+                        linear_lookup (&events[i]);
+                else if (what == 1)
+                        gesture_lookup (&events[i]);
+                else
+                        gestures_filter ((GdkXEvent *) &events[i], NULL, NULL);
+        }
+        ret = g_timer_elapsed (timer, NULL);
+        g_timer_destroy (timer);
+
+        return ret / n_events;
+}
+
+int
+main (int argc, char **argv)
+{
+        static const int n_keys[] = { 10, 50, 250 };
+        static const char *what[] = { "list walk", "index lookup", "filter" };
+        GRand  *rand;
+        XEvent *events;
+        int     n_events = 200000;
+        int     i, j;
+
+        if (argc > 1)
+                n_events = MAX (2, atoi (argv[1]));
+
+        rand = g_rand_new_with_seed (1);
+        events = random_events (rand, n_events);
+
+        for (i = 0; i < G_N_ELEMENTS (n_keys); i++) {
+                set_gestures (n_keys[i]);
+                check_lookup (events, n_events);
+
+                for (j = 0; j < G_N_ELEMENTS (what); j++)
+                        g_message ("%d key gestures, %s: %.1f ns per event",
+                                   n_keys[i], what[j],
+                                   bench (j, events, n_events) * 1e9);
+        }
+
+        g_free (events);
+        g_rand_free (rand);
+        return 0;
+}
@@ -0,0 +1,218 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "mdmpixops.h"
+
+/* Usage: test-pixops [renders] */
+
+/* The loops the greeters had before, with the divides */
+static void
+ref_tint (guchar *pixels, int width, int height, int rowstride, int n_channels, guint32 rgb)
+{
+        guint r = (rgb >> 16) & 0xff;
+        guint g = (rgb >> 8) & 0xff;
+        guint b = rgb & 0xff;
+        int   i, j;
+
+        for (i = 0; i < height; i++) {
+                guchar *p = pixels + i * rowstride;
+
+                for (j = 0; j < width; j++) {
+                        p[0] = p[0] * r / 0xff;
+                        p[1] = p[1] * g / 0xff;
+                        p[2] = p[2] * b / 0xff;
+                        p += n_channels;
+                }
+        }
+}
+
+static void
+ref_over_color (guchar *pixels, int width, int height, int rowstride, guint32 rgb)
+{
+        int cr = (rgb >> 16) & 0xff;
+        int cg = (rgb >> 8) & 0xff;
+        int cb = rgb & 0xff;
+        int i, j;
+
+        for (i = 0; i < height; i++) {
+                guchar *p = pixels + i * rowstride;
+
+                for (j = 0; j < width; j++) {
+                        int a = p[3];
+
+                        p[0] = (p[0] * a + cr * (255 - a)) >> 8;
+                        p[1] = (p[1] * a + cg * (255 - a)) >> 8;
+                        p[2] = (p[2] * a + cb * (255 - a)) >> 8;
+                        p[3] = 255;
+                        p += 4;
+                }
+        }
+}
+
+static void
+ref_premultiply (guchar *pixels, int width, int height, int rowstride)
+{
+        int i, j;
+
+        for (i = 0; i < height; i++) {
+                guchar *p = pixels + i * rowstride;
+
+                for (j = 0; j < width; j++) {
+                        p[0] = (p[0] * p[3] + 127) / 255;
+                        p[1] = (p[1] * p[3] + 127) / 255;
+                        p[2] = (p[2] * p[3] + 127) / 255;
+                        p += 4;
+                }
+        }
+}
+
+static guchar *
+random_pixels (GRand *rand, gsize len)
+{
+        guchar *pixels = g_malloc (len);
+        gsize   i;
+
+        for (i = 0; i < len; i++)
+                pixels[i] = g_rand_int_range (rand, 0, 256);
+        return pixels;
+}
+
+/* Odd widths and row padding make sure the tails and the bytes past
+ * the end of each row are right as well */
+static void
+check_impl (MdmPixopsImpl impl, GRand *rand)
+{
+        int width, n_channels, op;
+
+        for (width = 0; width <= 100; width++) {
+                for (n_channels = 3; n_channels <= 4; n_channels++) {
+                        for (op = 0; op < 3; op++) {
+                                int     height = 3;
+                                int     rowstride = width * n_channels + 5;
+                                gsize   len = rowstride * height;
+                                guint32 rgb = g_rand_int (rand) & 0xffffff;
+                                guchar *got;
+                                guchar *want;
+
+                                if (op > 0 && n_channels != 4)
+                                        continue;
+
+                                got = random_pixels (rand, len);
+                                want = g_memdup (got, len);
+
+                                if (op == 0) {
+                                        mdm_pixops_tint (got, width, height, rowstride, n_channels, rgb);
+                                        ref_tint (want, width, height, rowstride, n_channels, rgb);
+                                } else if (op == 1) {
+                                        mdm_pixops_over_color (got, width, height, rowstride, rgb);
+                                        ref_over_color (want, width, height, rowstride, rgb);
+                                } else {
+                                        mdm_pixops_premultiply (got, width, height, rowstride);
+                                        ref_premultiply (want, width, height, rowstride);
+                                }
+
+                                if (memcmp (got, want, len) != 0)
+                                        g_error ("%s: operation %d differs for width %d with %d channels",
+                                                 mdm_pixops_impl_name (impl), op, width, n_channels);
+
+                                g_free (got);
+                                g_free (want);
+                        }
+                }
+        }
+
+        g_message ("%s matches the reference", mdm_pixops_impl_name (impl));
+}
+
+static double
+bench_op (int op, guchar *pixels, int width, int height, int renders)
+{
+        GTimer *timer = g_timer_new ();
+        double  ret;
+        int     i;
+
+        for (i = 0; i < renders; i++) {
+                if (op == 0)
+                        mdm_pixops_tint (pixels, width, height, width * 4, 4, 0xc0a080);
+                else if (op == 1)
+                        mdm_pixops_over_color (pixels, width, height, width * 4, 0x204060);
+                else
+                        mdm_pixops_premultiply (pixels, width, height, width * 4);
+        }
+        ret = g_timer_elapsed (timer, NULL) / renders;
+        g_timer_destroy (timer);
+
+        return ret;
+}
+
+static void
+bench_impl (MdmPixopsImpl impl, GRand *rand, int renders)
+{
+        static const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        static const char *ops[] = { "tint", "over_color", "premultiply" };
+        int i, op;
+
+        for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+                int     width = sizes[i][0];
+                int     height = sizes[i][1];
+                guchar *pixels = random_pixels (rand, (gsize) width * height * 4);
+
+                for (op = 0; op < G_N_ELEMENTS (ops); op++) {
+                        double secs = bench_op (op, pixels, width, height, renders);
+
+                        g_message ("%s %s %dx%d: %.2f ms, %.0f Mpixels/s",
+                                   mdm_pixops_impl_name (impl), ops[op], width, height,
+                                   secs * 1000, width * height / secs / 1e6);
+                }
+                g_free (pixels);
+        }
+}
+
+int
+main (int argc, char **argv)
+{
+        MdmPixopsImpl best;
+        MdmPixopsImpl impl;
+        GRand        *rand;
+        int           renders = 20;
+
+        if (argc > 1)
+                renders = MAX (1, atoi (argv[1]));
+
+        rand = g_rand_new_with_seed (1);
+        best = mdm_pixops_get_impl ();
+        g_message ("Using %s", mdm_pixops_impl_name (best));
+
+        for (impl = 0; impl < MDM_PIXOPS_N_IMPLS; impl++) {
+                if ( ! mdm_pixops_set_impl (impl))
+                        continue;
+                check_impl (impl, rand);
+                bench_impl (impl, rand, renders);
+        }
+
+        g_rand_free (rand);
+        return 0;
+}